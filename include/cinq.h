@@ -6,6 +6,50 @@
 #include "cinq/cinq.h"
 
 namespace cinq {
+// Passed as the last argument of Join, to promise that both sides are ordered by key.
+inline constexpr detail::OrderedByKeyTag ordered_by_key{};
+
+// Passed as the last argument of Union, to allow yielding the elements in an unspecified order. Union already inserts its sources into
+//   a single set one after another, which is the fastest order, so the elements are yielded in the order of their first occurrence.
+inline constexpr detail::UnorderedTag unordered{};
+
+// Passed as the last argument of Sum or Average, to sum floating point values pairwise.
+inline constexpr detail::PairwiseSummationTag pairwise_summation{};
+
+// Predicates for Where comparing the element with value, they can be combined by && and ||.
+// When the source is contiguous, and its elements are of 32 or 64 bits signed integers, float or double, which the value is
+//   converted to for comparison, the Where is evaluated in batches with vectorized kernels (SSE2, AVX2 or AVX-512, detected at runtime).
+template <class T>
+auto Equal(T value) {
+  return detail::ComparisonPredicate<detail::simd::CompareOp::Equal, T>(std::move(value));
+}
+
+template <class T>
+auto Less(T value) {
+  return detail::ComparisonPredicate<detail::simd::CompareOp::Less, T>(std::move(value));
+}
+
+template <class T>
+auto Greater(T value) {
+  return detail::ComparisonPredicate<detail::simd::CompareOp::Greater, T>(std::move(value));
+}
+
+template <class T>
+auto LessEqual(T value) {
+  return detail::ComparisonPredicate<detail::simd::CompareOp::LessEqual, T>(std::move(value));
+}
+
+template <class T>
+auto GreaterEqual(T value) {
+  return detail::ComparisonPredicate<detail::simd::CompareOp::GreaterEqual, T>(std::move(value));
+}
+
+// Whether the element is in [first, last].
+template <class T>
+auto Between(T first, T last) {
+  return GreaterEqual(std::move(first)) && LessEqual(std::move(last));
+}
+
 // Following function/function template overload set is the front barrier to maintain inner type consistency from user provided types.
 // Such consistency will greatly reduce both compile-time and run-time errors by simplifing the inner type design.
 // All user provided container type must be wrapped by class template EnumerableSource.
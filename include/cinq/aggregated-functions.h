@@ -1,16 +1,21 @@
 #pragma once
 
+#include <functional>
 #include <tuple>
 #include <type_traits>
+#include <utility>
+
+#include "detail/utility.h"
 
 namespace cinq::detail {
+// Calls the function objects in order, each one with the result of the previous one. It's the selector of fused Selects, see Cinq::Select.
 template <class... TFns>
 struct AggregatedFunctions {
   AggregatedFunctions(std::tuple<TFns...> &&fns) : fns_(std::move(fns)) {}
 
   template <class Fn>
   auto PushFn(Fn &&fn) && {
-    return AggregatedFunctions<TFns..., std::decay_t<Fn>>(std::tuple_cat(fns_, std::make_tuple(std::forward<Fn>(fn))));
+    return AggregatedFunctions<TFns..., std::decay_t<Fn>>(std::tuple_cat(std::move(fns_), std::make_tuple(std::forward<Fn>(fn))));
   }
 
   template <size_t index, class T>
@@ -59,13 +64,60 @@ struct AggregatedFunctions<> {
   }
 };
 
+template <class T>
+struct is_aggregated_functions : std::false_type {};
+template <class... TFns>
+struct is_aggregated_functions<AggregatedFunctions<TFns...>> : std::true_type {};
+template <class T>
+inline constexpr bool is_aggregated_functions_v = is_aggregated_functions<T>::value;
+
 template <class... TFn>
 auto CreateAggregatedFunctions(TFn&&... fn) {
   return AggregatedFunctions<std::decay_t<TFn>...>(std::make_tuple(std::forward<TFn>(fn)...));
 }
 
-auto CreateAggregatedFunctions() {
+inline auto CreateAggregatedFunctions() {
   return AggregatedFunctions<>();
 }
 
+// Converts the result of a selector to TResultType, the type yielded by the iterator of its Select.
+template <class TResultType>
+struct ResultCast {
+  template <class T>
+  TResultType operator()(T &&v) const {
+    return static_cast<TResultType>(std::forward<T>(v));
+  }
+};
+
+// Composes the selector of a Select with the selector fn of the following Select. The result of the former is passed to fn as the
+//   iterator of the former Select would pass it, i.e. converted to TResultType, which is the type it yields.
+template <class TResultType, class TFn, class Fn>
+auto ComposeSelectors(TFn &&selector, Fn &&fn) {
+  if constexpr (is_aggregated_functions_v<std::decay_t<TFn>>)
+    return std::forward<TFn>(selector).PushFn(ResultCast<TResultType>{}).PushFn(std::forward<Fn>(fn));
+  else
+    return CreateAggregatedFunctions(std::forward<TFn>(selector), ResultCast<TResultType>{}, std::forward<Fn>(fn));
+}
+
+// The predicate of two fused Wheres. rhs is only called with the elements satisfying lhs, which are passed to it as the iterator
+//   of the former Where would pass them, i.e. converted to TResultType, then to the function object argument type of ConstVersion.
+//   lhs mustn't consume the element, it's only forwarded to rhs.
+template <bool ConstVersion, class TResultType, class TLhs, class TRhs>
+class ConjoinedPredicates {
+public:
+  ConjoinedPredicates(TLhs lhs, TRhs rhs) : lhs_(std::move(lhs)), rhs_(std::move(rhs)) {}
+
+  template <class T>
+  bool operator()(T &&v) {
+    using RhsArgumentType = cinq::utility::transform_to_function_object_argument_t<ConstVersion, TResultType>;
+    if (!cinq::utility::InvokeWithoutConsuming<T &&>(lhs_, v))
+      return false;
+    return static_cast<bool>(std::invoke(rhs_, static_cast<RhsArgumentType>(static_cast<TResultType>(std::forward<T>(v)))));
+  }
+
+private:
+  TLhs lhs_;
+  TRhs rhs_;
+};
+
 } // namespace cinq::detail
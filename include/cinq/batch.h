@@ -0,0 +1,59 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <type_traits>
+#include <utility>
+
+namespace cinq::detail {
+// Number of elements passed between queries at a time in batched evaluation, see is_batch_evaluable.
+inline constexpr size_t batch_size = 1024;
+
+// A block of at most batch_size elements passed between queries in batched evaluation.
+// The elements are elements[selection[i]] for i in [0, size), or elements[i] if selection is null (i.e. the batch is dense).
+// TElement can be const. The elements are either the ones of a contiguous source, or the results of a Select stored in its buffer.
+template <class TElement>
+struct Batch {
+  TElement *elements;
+  const std::uint32_t *selection;
+  size_t size;
+
+  // Calls fn(element, index) with each element in order, until fn returns false. Returns false if it's stopped by fn.
+  template <class Fn>
+  bool ForEach(Fn &&fn) const {
+    if (selection) {
+      for (size_t i = 0; i < size; ++i) {
+        if (!fn(elements[selection[i]], selection[i]))
+          return false;
+      }
+    } else {
+      for (size_t i = 0; i < size; ++i) {
+        if (!fn(elements[i], static_cast<std::uint32_t>(i)))
+          return false;
+      }
+    }
+    return true;
+  }
+};
+
+// Builds the selection vector of the elements of batch satisfying pred in output (which can be batch.selection),
+//   and returns the number of selected elements.
+// The index is always written, and only kept if the predicate holds, so the loop has no branch on the predicate.
+template <class TElement, class Pred>
+size_t BuildSelectionVector(const Batch<TElement> &batch, std::uint32_t *output, Pred &&pred) {
+  size_t selected = 0;
+  batch.ForEach([output, &pred, &selected](auto &element, std::uint32_t index) {
+    output[selected] = index;
+    selected += static_cast<bool>(pred(element));
+    return true;
+  });
+  return selected;
+}
+
+// Builds the batches of a source of a query, which is an EnumerableSource or an Enumerable. Cinq provides its own overload.
+template <class TSource, class BatchSink>
+bool SourceForEachBatch(TSource &source, BatchSink &&batch_sink) {
+  return source.ForEachBatch(std::forward<BatchSink>(batch_sink));
+}
+
+} // namespace cinq::detail
@@ -9,15 +9,26 @@
 #endif
 
 #include <array>
+#include <cstdint>
 #include <functional>
 #include <iterator>
+#include <optional>
+#include <set>
+#include <stdexcept>
+#include <thread>
+#include <tuple>
 #include <type_traits>
 #include <utility>
 #include <vector>
 
+#include "detail/cinq-traits.h"
 #include "detail/concept.h"
+#include "aggregated-functions.h"
+#include "comparison-predicates.h"
 #include "enumerable.h"
 #include "enumerable-source.h"
+#include "numeric-aggregates.h"
+#include "parallel-cinq.h"
 
 namespace cinq::detail {
 template <bool ConstVersion, class TEnumerable>
@@ -78,10 +89,22 @@ public:
     return end();
   }
 
+  // A Select following a Select is fused into it, see fusible_query.
   template <class Fn>
   auto Select(Fn fn) && {
-    using SelectType = Enumerable<ConstVersion, QueryCategory::Select, std::tuple<Fn>, TEnumerable>;
-    return Cinq<ConstVersion, SelectType>(std::make_tuple(std::move(fn)), std::move(root_));
+    if constexpr (is_fusible_query_v<ConstVersion, QueryCategory::Select, TEnumerable>) {
+      using IntermediateType = decltype(*std::declval<ResultIterator>());
+      static_assert(concept::SelectorCheck<Fn, cinq::utility::transform_to_function_object_argument_t<ConstVersion, IntermediateType>>(),
+        "Bad selector");
+
+      using Fused = fusible_query<ConstVersion, QueryCategory::Select, TEnumerable>;
+      auto selector = ComposeSelectors<IntermediateType>(root_.ReleaseFn(), std::move(fn));
+      using SelectType = Enumerable<ConstVersion, QueryCategory::Select, std::tuple<decltype(selector)>, typename Fused::Source>;
+      return Cinq<ConstVersion, SelectType>(std::make_tuple(std::move(selector)), root_.ReleaseSource());
+    } else {
+      using SelectType = Enumerable<ConstVersion, QueryCategory::Select, std::tuple<Fn>, TEnumerable>;
+      return Cinq<ConstVersion, SelectType>(std::make_tuple(std::move(fn)), std::move(root_));
+    }
   }
 
   template <class Fn>
@@ -90,66 +113,90 @@ public:
     return Cinq<ConstVersion, SelectManyType>(std::make_tuple(std::move(fn)), std::move(root_));
   }
 
+  // A Where following a Where is fused into it, unless only one of the predicates is a comparison predicate, whose vectorized
+  //   evaluation would be lost. Two comparison predicates are combined by &&.
   template <class Fn>
   auto Where(Fn fn) && {
-    using WhereType = Enumerable<ConstVersion, QueryCategory::Where, std::tuple<Fn>, TEnumerable>;
-    return Cinq<ConstVersion, WhereType>(std::make_tuple(std::move(fn)), std::move(root_));
+    if constexpr (IsFusibleWhere<Fn>()) {
+      using IntermediateType = decltype(*std::declval<ResultIterator>());
+      static_assert(concept::PredicateCheck<Fn, cinq::utility::transform_to_function_object_argument_t<ConstVersion, IntermediateType>>(),
+        "Bad predicate");
+
+      using Fused = fusible_query<ConstVersion, QueryCategory::Where, TEnumerable>;
+      auto predicate = [this, &fn]() {
+        if constexpr (is_comparison_predicate_v<Fn>)
+          return root_.ReleaseFn() && std::move(fn);
+        else
+          return ConjoinedPredicates<ConstVersion, IntermediateType, typename Fused::Fn, Fn>(root_.ReleaseFn(), std::move(fn));
+      }();
+      using WhereType = Enumerable<ConstVersion, QueryCategory::Where, std::tuple<decltype(predicate)>, typename Fused::Source>;
+      return Cinq<ConstVersion, WhereType>(std::make_tuple(std::move(predicate)), root_.ReleaseSource());
+    } else {
+      using WhereType = Enumerable<ConstVersion, QueryCategory::Where, std::tuple<Fn>, TEnumerable>;
+      return Cinq<ConstVersion, WhereType>(std::make_tuple(std::move(fn)), std::move(root_));
+    }
   }
 
+  // The results are yielded in the order of the outer source, the ones of an outer element in the order of the inner source, whatever
+  //   the strategy chosen for the key (see JoinStrategy).
   template <class Inner, class OuterKeySelector, class InnerKeySelector, class ResultSelector>
   auto Join(Inner &&inner, OuterKeySelector outer_key_selector, InnerKeySelector inner_key_selector, ResultSelector result_selector) && {
-    auto self = std::move(*this);
-
-    using JoinType = Enumerable<ConstVersion, QueryCategory::Join,
-      std::tuple<OuterKeySelector, InnerKeySelector, ResultSelector>,
-      decltype(self),
-      std::remove_reference_t<
-        decltype(
-          CinqImpl<ConstVersion>(
-            std::forward<Inner>(inner)
-          )
-        )>
-    >;
+    return std::move(*this).JoinImpl(std::forward<Inner>(inner),
+      std::make_tuple(std::move(outer_key_selector), std::move(inner_key_selector), std::move(result_selector)));
+  }
 
-    return Cinq<ConstVersion, JoinType>(
-        std::make_tuple(std::move(outer_key_selector), std::move(inner_key_selector), std::move(result_selector)),
-        GetEnumerable(std::move(self)),
-        GetEnumerable(CinqImpl<ConstVersion>(std::forward<Inner>(inner)))
-      );
+  // Both sides must be ordered by key (in ascending order of operator<), they are then merged without being sorted or hashed.
+  template <class Inner, class OuterKeySelector, class InnerKeySelector, class ResultSelector>
+  auto Join(Inner &&inner, OuterKeySelector outer_key_selector, InnerKeySelector inner_key_selector, ResultSelector result_selector, OrderedByKeyTag tag) && {
+    return std::move(*this).JoinImpl(std::forward<Inner>(inner),
+      std::make_tuple(std::move(outer_key_selector), std::move(inner_key_selector), std::move(result_selector), tag));
   }
 
+  // The sources are merged if all of them are sorted in the order of the same type of comparator (see AssumeSorted). Integers are kept
+  //   in a DomainSet if their domain is known (see WithDomain). Otherwise the elements are hashed, or kept in a std::set if they aren't
+  //   hashable. Likewise for Union and Except.
   template <class Source, class... Rest>
   auto Intersect(Source &&source, Rest&&... rest) && {
-    auto self = std::move(*this).Distinct();
-
-    using IntersectType = Enumerable<ConstVersion, QueryCategory::Intersect, std::tuple<int>,
-      decltype(self),
-      std::remove_reference_t<decltype(CinqImpl<ConstVersion>(std::forward<Source>(source)).Distinct())>,
-      std::remove_reference_t<decltype(CinqImpl<ConstVersion>(std::forward<Rest>(rest)).Distinct())>...>;
-
-    return Cinq<ConstVersion, IntersectType>(
-        NoFunctionTag{},
-        GetEnumerable(std::move(self)),
-        GetEnumerable(CinqImpl<ConstVersion>(std::forward<Source>(source)).Distinct()),
-        GetEnumerable(CinqImpl<ConstVersion>(std::forward<Rest>(rest)).Distinct())...
-      );
+    if constexpr (IsMergeable<Source, Rest...>())
+      return std::move(*this).template Merge<QueryCategory::SortedIntersect>(std::forward<Source>(source), std::forward<Rest>(rest)...);
+    else if constexpr (IsDomainKnown<Cinq>() && IsSameElement<SourceCinq<Source>>() && (IsSameElement<SourceCinq<Rest>>() && ...))
+      return std::move(*this).template DomainSetOperation<DomainSetMode::Intersect>(std::forward<Source>(source), std::forward<Rest>(rest)...);
+    else
+      return std::move(*this).IntersectImpl(std::forward<Source>(source), std::forward<Rest>(rest)...);
   }
 
+  // The distinct elements of this enumerable then of each source, in the order of their first occurrence. The domain of the integers is
+  //   the one spanning the domains of all the sources. unordered (see cinq::unordered) may be passed as the last argument.
   template <class Source, class... Rest>
   auto Union(Source &&source, Rest&&... rest) && {
-    auto self = std::move(*this).Distinct();
-
-    using UnionType = Enumerable<ConstVersion, QueryCategory::Union, std::tuple<int>,
-      decltype(self),
-      std::remove_reference_t<decltype(CinqImpl<ConstVersion>(std::forward<Source>(source)).Distinct())>,
-      std::remove_reference_t<decltype(CinqImpl<ConstVersion>(std::forward<Rest>(rest)).Distinct())>...>;
+    using Last = std::tuple_element_t<sizeof...(Rest), std::tuple<Source, Rest...>>;
+    constexpr bool is_unordered = std::is_same_v<std::decay_t<Last>, UnorderedTag>;
+    return std::move(*this).UnionOf(std::forward_as_tuple(std::forward<Source>(source), std::forward<Rest>(rest)...),
+      std::make_index_sequence<sizeof...(Rest) + !is_unordered>());
+  }
 
-    return Cinq<ConstVersion, UnionType>(
-        NoFunctionTag{},
-        GetEnumerable(std::move(self)),
-        GetEnumerable(CinqImpl<ConstVersion>(std::forward<Source>(source)).Distinct()),
-        GetEnumerable(CinqImpl<ConstVersion>(std::forward<Rest>(rest)).Distinct())...
-      );
+  // The distinct elements which aren't in any of the sources, in the order of this one.
+  template <class Source, class... Rest>
+  auto Except(Source &&source, Rest&&... rest) && {
+    if constexpr (IsMergeable<Source, Rest...>()) {
+      return std::move(*this).template Merge<QueryCategory::SortedExcept>(std::forward<Source>(source), std::forward<Rest>(rest)...);
+    } else if constexpr (IsDomainKnown<Cinq>() && IsSameElement<SourceCinq<Source>>() && (IsSameElement<SourceCinq<Rest>>() && ...)) {
+      return std::move(*this).template DomainSetOperation<DomainSetMode::Except>(std::forward<Source>(source), std::forward<Rest>(rest)...);
+    } else {
+      auto self = std::move(*this).Unique();
+
+      using ExceptType = Enumerable<ConstVersion, QueryCategory::Except, std::tuple<int>,
+        decltype(self),
+        std::remove_reference_t<decltype(CinqImpl<ConstVersion>(std::forward<Source>(source)))>,
+        std::remove_reference_t<decltype(CinqImpl<ConstVersion>(std::forward<Rest>(rest)))>...>;
+
+      return Cinq<ConstVersion, ExceptType>(
+          NoFunctionTag{},
+          GetEnumerable(std::move(self)),
+          GetEnumerable(CinqImpl<ConstVersion>(std::forward<Source>(source))),
+          GetEnumerable(CinqImpl<ConstVersion>(std::forward<Rest>(rest)))...
+        );
+    }
   }
 
   template <class Source, class... Rest>
@@ -165,45 +212,469 @@ public:
       );
   }
 
+  // Distinct is dropped if the elements are already unique (see EnumerableTraits), and yielded as const lvalues as Distinct does.
+  // The adjacent equivalent elements of a sorted enumerable (see AssumeSorted) are skipped without internal storage. Integers whose
+  //   domain is known (see WithDomain) are kept in a DomainSet.
   auto Distinct() && {
-    using DistinctType = Enumerable<ConstVersion, QueryCategory::Distinct, std::tuple<int>, TEnumerable>;
-    return Cinq<ConstVersion, DistinctType>(NoFunctionTag{}, std::move(root_));
+    using Yield = decltype(*std::declval<ResultIterator>());
+    if constexpr (cinq::utility::EnumerableTraits<TEnumerable>::is_elements_unique &&
+        std::is_same_v<Yield, const std::decay_t<Yield> &>) {
+      return std::move(*this);
+    } else if constexpr (cinq::utility::EnumerableTraits<TEnumerable>::is_sorted) {
+      using Compare = typename cinq::utility::EnumerableTraits<TEnumerable>::Compare;
+      using DistinctType = Enumerable<ConstVersion, QueryCategory::SortedDistinct, std::tuple<Compare>, TEnumerable>;
+      auto compare = root_.SortCompare();
+      return Cinq<ConstVersion, DistinctType>(std::make_tuple(std::move(compare)), std::move(root_));
+    } else if constexpr (IsDomainKnown<Cinq>()) {
+      return std::move(*this).template DomainSetOperation<DomainSetMode::Distinct>();
+    } else {
+      using DistinctType = Enumerable<ConstVersion, QueryCategory::Distinct, std::tuple<int>, TEnumerable>;
+      return Cinq<ConstVersion, DistinctType>(NoFunctionTag{}, std::move(root_));
+    }
+  }
+
+  // Promises that the elements are sorted in the order of compare (operator< by default), so that the following Distinct, Intersect,
+  //   Union and Except merge their sources. The comparators of the sources of a set operation must be of the same type (e.g. the same
+  //   lambda), a std::set or a std::map ordered by operator< is sorted by std::less<>. The merges yield the elements in sorted order.
+  template <class Compare = std::less<>>
+  auto AssumeSorted(Compare compare = Compare()) && {
+    using AssumeSortedType = Enumerable<ConstVersion, QueryCategory::AssumeSorted, std::tuple<Compare>, TEnumerable>;
+    return Cinq<ConstVersion, AssumeSortedType>(std::make_tuple(std::move(compare)), std::move(root_));
+  }
+
+  // Promises that the elements are integers in [min, max], so that the following Distinct, Intersect, Union and Except keep them in a
+  //   bitset of the domain (see DomainSet), and throw if they meet an element out of it. Without it, the domain of the elements of a
+  //   random access enumerable yielding references is found by a pre-pass over them. Either way, a hash table is used if the bitset
+  //   would be sparse for the size hint of the elements, see DomainSet::IsDense.
+  auto WithDomain(std::decay_t<decltype(*std::declval<ResultIterator>())> min, std::decay_t<decltype(*std::declval<ResultIterator>())> max) && {
+    using T = std::decay_t<decltype(*std::declval<ResultIterator>())>;
+    static_assert(is_domain_element_v<T>, "The elements must be integers");
+    cinq::utility::CinqAssert(!(max < min));
+    using WithDomainType = Enumerable<ConstVersion, QueryCategory::WithDomain, std::tuple<Domain<T>>, TEnumerable>;
+    return Cinq<ConstVersion, WithDomainType>(std::make_tuple(Domain<T>{ min, max }), std::move(root_));
+  }
+
+  // The elements stably sorted by the keys selected by selector, in the order of compare (operator< by default). The selectors of OrderBy
+  //   and of the following ThenBy are called once per element when the query is evaluated, see the query iterator of OrderBy.
+  template <class Selector, class Compare = std::less<>>
+  auto OrderBy(Selector selector, Compare compare = Compare()) && {
+    return std::move(*this).OrderByImpl(SortKey<Selector, Compare>{ std::move(selector), std::move(compare) });
+  }
+
+  template <class Selector, class Compare = std::less<>>
+  auto OrderByDescending(Selector selector, Compare compare = Compare()) && {
+    return std::move(*this).OrderByImpl(SortKey<Selector, ReversedCompare<Compare>>{ std::move(selector), { std::move(compare) } });
+  }
+
+  // Sorts the elements of equivalent keys of the preceding OrderBy (or ThenBy) by the keys selected by selector, which are appended to
+  //   its keys so that they're compared by a single lexicographic comparator.
+  template <class Selector, class Compare = std::less<>>
+  auto ThenBy(Selector selector, Compare compare = Compare()) && {
+    return std::move(*this).ThenByImpl(SortKey<Selector, Compare>{ std::move(selector), std::move(compare) });
+  }
+
+  template <class Selector, class Compare = std::less<>>
+  auto ThenByDescending(Selector selector, Compare compare = Compare()) && {
+    return std::move(*this).ThenByImpl(SortKey<Selector, ReversedCompare<Compare>>{ std::move(selector), { std::move(compare) } });
+  }
+
+  // The first count elements. An OrderBy (or ThenBy) followed by Take keeps only the first count elements of the sorted order in a
+  //   bounded heap while its source is enumerated, instead of sorting all of them, see the query iterator of OrderBy.
+  auto Take(size_t count) && {
+    if constexpr (is_fusible_query_v<ConstVersion, QueryCategory::OrderBy, TEnumerable>) {
+      using Fused = fusible_query<ConstVersion, QueryCategory::OrderBy, TEnumerable>;
+      auto sort_keys = root_.ReleaseFn().Take(count);
+      using OrderByType = Enumerable<ConstVersion, QueryCategory::OrderBy, std::tuple<decltype(sort_keys)>, typename Fused::Source>;
+      return Cinq<ConstVersion, OrderByType>(std::make_tuple(std::move(sort_keys)), root_.ReleaseSource());
+    } else {
+      using TakeType = Enumerable<ConstVersion, QueryCategory::Take, std::tuple<size_t>, TEnumerable>;
+      return Cinq<ConstVersion, TakeType>(std::make_tuple(count), std::move(root_));
+    }
+  }
+
+  // Calls fn with each element. The elements are pushed through the queries (see Enumerable::ForEach).
+  template <class Fn>
+  void ForEach(Fn &&fn) {
+    root_.ForEach([&fn](auto &&e) {
+      std::invoke(fn, std::forward<decltype(e)>(e));
+      return true;
+    });
   }
 
-  // TODO : Add test case
   template <class Pred>
   bool All(Pred &&p) const {
-    bool result = true;
-    for (auto &&e : *this) {
+    return root_.template ForEach<true>([&p](auto &&e) {
       static_assert(concept::PredicateCheck<Pred &&, decltype(e)>(), "Bad predicate");
-      if (!(result = result && std::invoke(std::forward<Pred>(p), std::forward<decltype(e)>(e))))
-        break;
-    }
-     
-    return result;
+      return static_cast<bool>(std::invoke(p, std::forward<decltype(e)>(e)));
+    });
+  }
+
+  template <class TAccumulate, class Fn>
+  TAccumulate Aggregate(TAccumulate seed, Fn &&fn) {
+    ForEach([&seed, &fn](auto &&e) {
+      seed = std::invoke(fn, std::move(seed), std::forward<decltype(e)>(e));
+    });
+    return seed;
+  }
+
+  // An enumerable of exact size (see EnumerableTraits) isn't enumerated.
+  size_t Count() {
+    if constexpr (cinq::utility::EnumerableTraits<TEnumerable>::size_class == cinq::utility::SizeClass::Exact)
+      return root_.GetSizeHint().size;
+
+    size_t count = 0;
+    ForEach([&count](auto &&) { ++count; });
+    return count;
+  }
+
+  // A comparison predicate (e.g. cinq::Less) over arithmetic elements is evaluated by the vectorized kernels, see simd::CountBatch.
+  template <class Pred>
+  size_t Count(Pred &&p) {
+    return CountValues<SelectedType<IdentityFunction>>(root_, p);
+  }
+
+  // Sum, Average, Min and Max of arithmetic values are evaluated in blocks by vectorized kernels with several accumulators
+  //   (see ForEachValueBlock and simd::Reduce). float is summed in double, and Average sums integers in 64 bits.
+  // Pass cinq::pairwise_summation to sum floating point values pairwise, so that the rounding error of long sequences stays small.
+  auto Sum() {
+    return Sum(IdentityFunction{});
+  }
+
+  auto Sum(PairwiseSummationTag) {
+    return Sum(IdentityFunction{}, PairwiseSummationTag{});
+  }
+
+  template <class Fn>
+  auto Sum(Fn &&fn) {
+    return SumImpl<false>(fn);
+  }
+
+  template <class Fn>
+  auto Sum(Fn &&fn, PairwiseSummationTag) {
+    return SumImpl<true>(fn);
+  }
+
+  // Throws std::runtime_error if there's no element.
+  auto Average() {
+    return Average(IdentityFunction{});
   }
- 
+
+  auto Average(PairwiseSummationTag) {
+    return Average(IdentityFunction{}, PairwiseSummationTag{});
+  }
+
+  template <class Fn>
+  auto Average(Fn &&fn) {
+    return AverageImpl<false>(fn);
+  }
+
+  template <class Fn>
+  auto Average(Fn &&fn, PairwiseSummationTag) {
+    return AverageImpl<true>(fn);
+  }
+
+  // Throws std::runtime_error if there's no element. The result is NaN if any floating point value is NaN.
+  auto Min() {
+    return Min(IdentityFunction{});
+  }
+
+  template <class Fn>
+  auto Min(Fn &&fn) {
+    return ReduceImpl<simd::ReduceOp::Min>(fn, "Min of an empty sequence.");
+  }
+
+  // Throws std::runtime_error if there's no element. The result is NaN if any floating point value is NaN.
+  auto Max() {
+    return Max(IdentityFunction{});
+  }
+
+  template <class Fn>
+  auto Max(Fn &&fn) {
+    return ReduceImpl<simd::ReduceOp::Max>(fn, "Max of an empty sequence.");
+  }
+
+  // Throws std::runtime_error if there's no element. The enumeration stops at the first element, and the first element of an OrderBy
+  //   is selected without sorting the others, as Take does.
+  auto First() {
+    using value_type = std::decay_t<decltype(*std::declval<ResultIterator>())>;
+    std::optional<value_type> first;
+    auto sink = [&first](auto &&e) {
+      first.emplace(std::forward<decltype(e)>(e));
+      return false;
+    };
+    if constexpr (is_fusible_query_v<ConstVersion, QueryCategory::OrderBy, TEnumerable>)
+      root_.ForEachFirst(1, sink);
+    else
+      root_.ForEach(sink);
+    if (!first)
+      throw std::runtime_error("First of an empty sequence.");
+    return std::move(*first);
+  }
+
+  // The storage is reserved once if the size of the query is exactly known (see SizeHint), and the elements are constructed in place.
   auto ToVector() {
     using value_type = std::decay_t<typename std::decay_t<decltype(std::begin(*this))>::value_type>;
-    auto vtr = std::vector<value_type>(std::begin(*this), std::end(*this));
+    std::vector<value_type> vtr;
+    if (auto hint = root_.GetSizeHint(); hint.is_exact)
+      vtr.reserve(hint.size);
+    ForEach([&vtr](auto &&e) { vtr.emplace_back(std::forward<decltype(e)>(e)); });
     return vtr;
   }
 
   auto ToSet() {
     using value_type = std::decay_t<typename std::decay_t<decltype(std::begin(*this))>::value_type>;
-    auto set = std::set<value_type>(std::begin(*this), std::end(*this));
+    std::set<value_type> set;
+    ForEach([&set](auto &&e) { set.emplace(std::forward<decltype(e)>(e)); });
     return set;
   }
 
+  // The chain of Select and Where queries containing it is evaluated in batches if its source is contiguous, see is_batch_evaluable.
+  auto AsBatched() && {
+    using BatchedType = Enumerable<ConstVersion, QueryCategory::Batched, std::tuple<int>, TEnumerable>;
+    return Cinq<ConstVersion, BatchedType>(NoFunctionTag{}, std::move(root_));
+  }
+
   auto Const() && {
     return Cinq<true, TEnumerable>(std::move(root_));
   }
 
+  // Following queries are evaluated with at most thread_count threads, see ParallelCinq.
+  auto AsParallel(size_t thread_count = std::thread::hardware_concurrency()) && {
+    return ParallelCinq<ConstVersion, TEnumerable>(std::move(*this), thread_count);
+  }
+
 private:
+  template <bool, class>
+  friend class ParallelCinq;
+
+  template <bool, class>
+  friend class Cinq;
+
+  // The elements made unique, as the first source of Except must be. Unlike Distinct, it's dropped whatever the type
+  //   of the elements is.
+  auto Unique() && {
+    if constexpr (cinq::utility::EnumerableTraits<TEnumerable>::is_elements_unique)
+      return std::move(*this);
+    else
+      return std::move(*this).Distinct();
+  }
+
+  // Whether the set operations with the sources merge them, i.e. all of them are sorted in the order of the same type of comparator.
+  template <class... Sources>
+  static constexpr bool IsMergeable() {
+    using Compare = typename cinq::utility::EnumerableTraits<TEnumerable>::Compare;
+    return !std::is_void_v<Compare> && (std::is_same_v<Compare, typename cinq::utility::EnumerableTraits<
+      std::remove_reference_t<decltype(CinqImpl<ConstVersion>(std::declval<Sources>()))>>::Compare> && ...);
+  }
+
+  template <class Source>
+  using SourceCinq = std::remove_reference_t<decltype(CinqImpl<ConstVersion>(std::declval<Source>()))>;
+
+  // Whether the elements of TCinq are integers of the type of the ones of this enumerable.
+  template <class TCinq>
+  static constexpr bool IsSameElement() {
+    using T = std::decay_t<decltype(*std::declval<ResultIterator>())>;
+    return is_domain_element_v<T> && std::is_same_v<T, std::decay_t<decltype(*std::declval<typename TCinq::ResultIterator>())>>;
+  }
+
+  // Whether the set operations over TCinq use a DomainSet, i.e. its elements are integers whose domain is declared (see WithDomain), or
+  //   found by a pre-pass over them, which doesn't call any function object again (i.e. they're enumerated by a random access iterator
+  //   yielding references).
+  template <class TCinq>
+  static constexpr bool IsDomainKnown() {
+    using Iterator = typename TCinq::ResultIterator;
+    return IsSameElement<TCinq>() && (cinq::utility::EnumerableTraits<TCinq>::has_domain ||
+      (cinq::utility::is_random_access_iterator_v<Iterator> && std::is_reference_v<decltype(*std::declval<Iterator>())>));
+  }
+
+  // The set operation over integers, with the domain of this enumerable if it's declared, see DomainSetOperation.
+  template <DomainSetMode mode, class... Sources>
+  auto DomainSetOperation(Sources&&... sources) && {
+    using T = std::decay_t<decltype(*std::declval<ResultIterator>())>;
+    using Spec = DomainSetSpec<T, mode>;
+    using DomainSetOperationType = Enumerable<ConstVersion, QueryCategory::DomainSetOperation, std::tuple<Spec>, TEnumerable,
+      std::remove_reference_t<decltype(CinqImpl<ConstVersion>(std::forward<Sources>(sources)))>...>;
+
+    Spec spec;
+    if constexpr (cinq::utility::EnumerableTraits<TEnumerable>::has_domain)
+      spec.domain = root_.DeclaredDomain();
+    return Cinq<ConstVersion, DomainSetOperationType>(
+        std::make_tuple(std::move(spec)),
+        std::move(root_),
+        GetEnumerable(CinqImpl<ConstVersion>(std::forward<Sources>(sources)))...
+      );
+  }
+
+  // The merging set operation QueryTag, with the comparator of this enumerable.
+  template <class QueryTag, class... Sources>
+  auto Merge(Sources&&... sources) && {
+    using Compare = typename cinq::utility::EnumerableTraits<TEnumerable>::Compare;
+    using MergeType = Enumerable<ConstVersion, QueryTag, std::tuple<Compare>, TEnumerable,
+      std::remove_reference_t<decltype(CinqImpl<ConstVersion>(std::forward<Sources>(sources)))>...>;
+
+    auto compare = root_.SortCompare();
+    return Cinq<ConstVersion, MergeType>(
+        std::make_tuple(std::move(compare)),
+        std::move(root_),
+        GetEnumerable(CinqImpl<ConstVersion>(std::forward<Sources>(sources)))...
+      );
+  }
+
+  template <class TKey>
+  auto OrderByImpl(TKey key) && {
+    using OrderByType = Enumerable<ConstVersion, QueryCategory::OrderBy, std::tuple<SortKeys<false, TKey>>, TEnumerable>;
+    return Cinq<ConstVersion, OrderByType>(std::make_tuple(SortKeys<false, TKey>{ std::make_tuple(std::move(key)) }), std::move(root_));
+  }
+
+  // The OrderBy with the keys of this one followed by key, see fusible_query. The keys followed by Take are no longer appendable.
+  template <class TKey>
+  auto ThenByImpl(TKey key) && {
+    if constexpr (IsSortKeysAppendable()) {
+      using Fused = fusible_query<ConstVersion, QueryCategory::OrderBy, TEnumerable>;
+      auto sort_keys = root_.ReleaseFn().Then(std::move(key));
+      using OrderByType = Enumerable<ConstVersion, QueryCategory::OrderBy, std::tuple<decltype(sort_keys)>, typename Fused::Source>;
+      return Cinq<ConstVersion, OrderByType>(std::make_tuple(std::move(sort_keys)), root_.ReleaseSource());
+    } else {
+      static_assert(cinq::utility::FakeFalse<TKey>(), "ThenBy must follow OrderBy or ThenBy");
+    }
+  }
+
+  // The sources don't need to be unique, see the query iterator of Intersect.
+  template <class Source, class... Rest>
+  auto IntersectImpl(Source &&source, Rest&&... rest) && {
+    using IntersectType = Enumerable<ConstVersion, QueryCategory::Intersect, std::tuple<int>, TEnumerable,
+      std::remove_reference_t<decltype(CinqImpl<ConstVersion>(std::forward<Source>(source)))>,
+      std::remove_reference_t<decltype(CinqImpl<ConstVersion>(std::forward<Rest>(rest)))>...>;
+
+    return Cinq<ConstVersion, IntersectType>(
+        NoFunctionTag{},
+        std::move(root_),
+        GetEnumerable(CinqImpl<ConstVersion>(std::forward<Source>(source))),
+        GetEnumerable(CinqImpl<ConstVersion>(std::forward<Rest>(rest)))...
+      );
+  }
+
+  // Union with the sources of indexes in sources, i.e. without the trailing UnorderedTag.
+  template <class TSources, size_t... indexes>
+  auto UnionOf(TSources &&sources, std::index_sequence<indexes...>) && {
+    static_assert(sizeof...(indexes) > 0, "Union requires a source");
+    if constexpr (IsMergeable<std::tuple_element_t<indexes, TSources>...>()) {
+      return std::move(*this).template Merge<QueryCategory::SortedUnion>(std::get<indexes>(std::move(sources))...);
+    } else if constexpr (IsDomainKnown<Cinq>() && (IsDomainKnown<SourceCinq<std::tuple_element_t<indexes, TSources>>>() && ...)) {
+      return std::move(*this).Concat(std::get<indexes>(std::move(sources))...).template DomainSetOperation<DomainSetMode::Distinct>();
+    } else {
+      return std::move(*this).UnionImpl(std::get<indexes>(std::move(sources))...);
+    }
+  }
+
+  // The sources don't need to be unique, each element is inserted once into the set of the query iterator of Union.
+  template <class... Sources>
+  auto UnionImpl(Sources&&... sources) && {
+    using UnionType = Enumerable<ConstVersion, QueryCategory::Union, std::tuple<int>, TEnumerable,
+      std::remove_reference_t<decltype(CinqImpl<ConstVersion>(std::forward<Sources>(sources)))>...>;
+
+    return Cinq<ConstVersion, UnionType>(
+        NoFunctionTag{},
+        std::move(root_),
+        GetEnumerable(CinqImpl<ConstVersion>(std::forward<Sources>(sources)))...
+      );
+  }
+
+  template <class Fn>
+  static constexpr bool IsFusibleWhere() {
+    if constexpr (is_fusible_query_v<ConstVersion, QueryCategory::Where, TEnumerable>)
+      return is_comparison_predicate_v<Fn> == is_comparison_predicate_v<typename fusible_query<ConstVersion, QueryCategory::Where, TEnumerable>::Fn>;
+    else
+      return false;
+  }
+
+  static constexpr bool IsSortKeysAppendable() {
+    if constexpr (is_fusible_query_v<ConstVersion, QueryCategory::OrderBy, TEnumerable>)
+      return !fusible_query<ConstVersion, QueryCategory::OrderBy, TEnumerable>::Fn::is_partial;
+    else
+      return false;
+  }
+
+  // The type of the values of fn applied to the elements. TCinq defers the lookup of begin until Cinq is complete.
+  template <class Fn, class TCinq = Cinq>
+  using SelectedType = std::decay_t<decltype(std::invoke(std::declval<Fn &>(), *std::begin(std::declval<TCinq &>())))>;
+
+  template <bool pairwise, class Fn>
+  auto SumImpl(Fn &fn) {
+    using value_type = SelectedType<Fn>;
+    static_assert(std::is_arithmetic_v<value_type>, "Sum requires arithmetic values");
+    return static_cast<sum_result_t<value_type>>(SumValues<value_type, pairwise>(root_, fn).first);
+  }
+
+  template <bool pairwise, class Fn>
+  auto AverageImpl(Fn &fn) {
+    using value_type = SelectedType<Fn>;
+    static_assert(std::is_arithmetic_v<value_type>, "Average requires arithmetic values");
+    auto [sum, count] = SumValues<average_sum_t<value_type>, pairwise>(root_, fn);
+    return AverageOf<value_type>(sum, count);
+  }
+
+  template <simd::ReduceOp op, class Fn>
+  auto ReduceImpl(Fn &fn, const char *empty_message) {
+    auto result = ReduceValues<op, SelectedType<Fn>>(root_, fn);
+    if (!result)
+      throw std::runtime_error(empty_message);
+    return std::move(*result);
+  }
+
+  template <class Inner, class TupleFns>
+  auto JoinImpl(Inner &&inner, TupleFns &&fns) && {
+    auto self = std::move(*this);
+
+    using JoinType = Enumerable<ConstVersion, QueryCategory::Join,
+      std::decay_t<TupleFns>,
+      decltype(self),
+      std::remove_reference_t<
+        decltype(
+          CinqImpl<ConstVersion>(
+            std::forward<Inner>(inner)
+          )
+        )>
+    >;
+
+    return Cinq<ConstVersion, JoinType>(
+        std::forward<TupleFns>(fns),
+        GetEnumerable(std::move(self)),
+        GetEnumerable(CinqImpl<ConstVersion>(std::forward<Inner>(inner)))
+      );
+  }
+
   friend TEnumerable &&GetEnumerable(Cinq &&c) {
     return std::move(c.root_);
   }
 
+  // See Enumerable::ForEach.
+  template <class Sink>
+  friend bool SourceForEach(Cinq &c, Sink &&sink) {
+    return c.root_.ForEach(std::forward<Sink>(sink));
+  }
+
+  // See is_batch_evaluable.
+  template <class BatchSink>
+  friend bool SourceForEachBatch(Cinq &c, BatchSink &&batch_sink) {
+    return c.root_.ForEachBatch(std::forward<BatchSink>(batch_sink));
+  }
+
+  // See is_range_splittable.
+  friend auto MakeSourceRanges(Cinq &c) {
+    return c.root_.MakeRanges();
+  }
+
+  // See SizeHint.
+  friend SizeHint SourceSizeHint(Cinq &c) {
+    return c.root_.GetSizeHint();
+  }
+
+  // See Enumerable::DeclaredDomain.
+  friend auto SourceDeclaredDomain(Cinq &c) {
+    return c.root_.DeclaredDomain();
+  }
+
   mutable TEnumerable root_;
 };
 
@@ -0,0 +1,128 @@
+#pragma once
+
+#include <cstdint>
+#include <type_traits>
+#include <utility>
+
+#include "simd-filter.h"
+
+namespace cinq::detail {
+template <simd::CompareOp op, class TValue>
+class ComparisonPredicate;
+template <class TLhs, class TRhs>
+class AndPredicate;
+template <class TLhs, class TRhs>
+class OrPredicate;
+
+template <class T>
+struct is_comparison_predicate : std::false_type {};
+template <simd::CompareOp op, class TValue>
+struct is_comparison_predicate<ComparisonPredicate<op, TValue>> : std::true_type {};
+template <class TLhs, class TRhs>
+struct is_comparison_predicate<AndPredicate<TLhs, TRhs>> : std::true_type {};
+template <class TLhs, class TRhs>
+struct is_comparison_predicate<OrPredicate<TLhs, TRhs>> : std::true_type {};
+template <class T>
+inline constexpr bool is_comparison_predicate_v = is_comparison_predicate<T>::value;
+
+// Whether comparing an element of type T with a value of type TValue is done in T, so that the kernels working on T yield the same result.
+template <class T, class TValue, class = void>
+struct is_compared_as : std::false_type {};
+template <class T, class TValue>
+struct is_compared_as<T, TValue, std::enable_if_t<std::is_arithmetic_v<T> && std::is_arithmetic_v<TValue>>>
+  : std::is_same<std::common_type_t<T, TValue>, T> {};
+
+// Whether TFn is a comparison predicate which the kernels can evaluate for elements of type T (see simd::FilterBatch).
+template <class TFn, class T, class = void>
+struct is_vectorizable_predicate : std::false_type {};
+template <class TFn, class T>
+struct is_vectorizable_predicate<TFn, T, std::enable_if_t<is_comparison_predicate_v<TFn>>> : std::bool_constant<TFn::template is_vectorizable<T>> {};
+template <class TFn, class T>
+inline constexpr bool is_vectorizable_predicate_v = is_vectorizable_predicate<TFn, T>::value;
+
+// A Where predicate comparing the element with a value, returned by cinq::Equal, cinq::Less etc., and combined by && and ||.
+// It's an ordinary function object, and also provides CompareMask<isa>(elements), which tests a block of simd::block_size elements
+//   with the kernels of isa, see simd::FilterBatch.
+template <simd::CompareOp op, class TValue>
+class ComparisonPredicate {
+public:
+  explicit ComparisonPredicate(TValue value) : value_(std::move(value)) {}
+
+  template <class T>
+  bool operator()(const T &element) const {
+    return simd::Compare<op>(element, value_);
+  }
+
+  template <class T>
+  static constexpr bool is_vectorizable = !std::is_void_v<simd::kernel_type_t<T>> && is_compared_as<T, TValue>::value;
+
+  template <simd::Isa isa, class T>
+  std::uint64_t CompareMask(const T *elements) const {
+    using KernelType = simd::kernel_type_t<T>;
+    if constexpr (!std::is_void_v<KernelType> && simd::has_kernel<isa, KernelType>)
+      return simd::Kernel<isa, KernelType>::template CompareMask<op>(reinterpret_cast<const KernelType *>(elements), static_cast<KernelType>(value_));
+    else
+      return simd::ScalarCompareMask<op>(elements, value_);
+  }
+
+private:
+  TValue value_;
+};
+
+template <class TLhs, class TRhs>
+class AndPredicate {
+public:
+  AndPredicate(TLhs lhs, TRhs rhs) : lhs_(std::move(lhs)), rhs_(std::move(rhs)) {}
+
+  template <class T>
+  bool operator()(const T &element) const {
+    return lhs_(element) && rhs_(element);
+  }
+
+  template <class T>
+  static constexpr bool is_vectorizable = TLhs::template is_vectorizable<T> && TRhs::template is_vectorizable<T>;
+
+  template <simd::Isa isa, class T>
+  std::uint64_t CompareMask(const T *elements) const {
+    return lhs_.template CompareMask<isa>(elements) & rhs_.template CompareMask<isa>(elements);
+  }
+
+private:
+  TLhs lhs_;
+  TRhs rhs_;
+};
+
+template <class TLhs, class TRhs>
+class OrPredicate {
+public:
+  OrPredicate(TLhs lhs, TRhs rhs) : lhs_(std::move(lhs)), rhs_(std::move(rhs)) {}
+
+  template <class T>
+  bool operator()(const T &element) const {
+    return lhs_(element) || rhs_(element);
+  }
+
+  template <class T>
+  static constexpr bool is_vectorizable = TLhs::template is_vectorizable<T> && TRhs::template is_vectorizable<T>;
+
+  template <simd::Isa isa, class T>
+  std::uint64_t CompareMask(const T *elements) const {
+    return lhs_.template CompareMask<isa>(elements) | rhs_.template CompareMask<isa>(elements);
+  }
+
+private:
+  TLhs lhs_;
+  TRhs rhs_;
+};
+
+template <class TLhs, class TRhs, class = std::enable_if_t<is_comparison_predicate_v<TLhs> && is_comparison_predicate_v<TRhs>>>
+AndPredicate<TLhs, TRhs> operator&&(TLhs lhs, TRhs rhs) {
+  return AndPredicate<TLhs, TRhs>(std::move(lhs), std::move(rhs));
+}
+
+template <class TLhs, class TRhs, class = std::enable_if_t<is_comparison_predicate_v<TLhs> && is_comparison_predicate_v<TRhs>>>
+OrPredicate<TLhs, TRhs> operator||(TLhs lhs, TRhs rhs) {
+  return OrPredicate<TLhs, TRhs>(std::move(lhs), std::move(rhs));
+}
+
+} // namespace cinq::detail
@@ -0,0 +1,138 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "detail/utility.h"
+#include "flat-hash-table.h"
+
+namespace cinq::detail {
+// The elements which may be kept in a DomainSet, i.e. the integers (bool has nothing to gain from it).
+template <class T>
+inline constexpr bool is_domain_element_v = std::is_integral_v<T> && !std::is_same_v<T, bool>;
+
+// The closed range [min, max] of the values of an integer type, see Cinq::WithDomain.
+template <class T>
+struct Domain {
+  T min;
+  T max;
+
+  bool Contains(T value) const {
+    return !(value < min) && !(max < value);
+  }
+
+  // The position of value in the domain, value must be in it.
+  size_t Offset(T value) const {
+    using Unsigned = std::make_unsigned_t<T>;
+    return static_cast<size_t>(static_cast<Unsigned>(static_cast<Unsigned>(value) - static_cast<Unsigned>(min)));
+  }
+
+  // The number of 64 bits words of a bitset of the domain.
+  size_t WordCount() const {
+    return Offset(max) / 64 + 1;
+  }
+
+  // The smallest domain containing both.
+  friend Domain Hull(const Domain &lhs, const Domain &rhs) {
+    return { rhs.min < lhs.min ? rhs.min : lhs.min, lhs.max < rhs.max ? rhs.max : lhs.max };
+  }
+};
+
+// The set operations over integers: Distinct keeps the first occurrence of each element of its source (a Union is the Distinct of the
+//   concatenation of its sources), Intersect the ones which are in all the other sources, Except the ones which are in none of them.
+enum class DomainSetMode {
+  Distinct,
+  Intersect,
+  Except
+};
+
+// The function object of a DomainSetOperation. domain is the one of the elements of its first source if it's declared (see
+//   Cinq::WithDomain), otherwise it's found by a pre-pass over them.
+template <class T, DomainSetMode mode>
+struct DomainSetSpec {
+  std::optional<Domain<T>> domain;
+};
+
+// The set of integers used by the set operations whose elements are integers, see DomainSetOperation.
+// It's a bitset of the domain if it's known, so that inserting or finding an element is a bit test, and two sets are intersected
+//   a word at a time. Otherwise it's a FlatHashTable.
+template <class T>
+class DomainSet {
+public:
+  static_assert(is_domain_element_v<T>);
+
+  // Whether a bitset of the domain is smaller than a hash table of size elements, i.e. it has at most one word per element.
+  static bool IsDense(const Domain<T> &domain, size_t size) {
+    return domain.WordCount() <= size;
+  }
+
+  DomainSet() = default;
+
+  explicit DomainSet(const std::optional<Domain<T>> &domain) : domain_(domain) {
+    if (domain_)
+      words_.resize(domain_->WordCount());
+  }
+
+  bool IsBitset() const {
+    return domain_.has_value();
+  }
+
+  // Whether value may be inserted, i.e. it's in the domain of a bitset.
+  bool Accepts(T value) const {
+    return !domain_ || domain_->Contains(value);
+  }
+
+  // Returns whether value is inserted, i.e. it wasn't in the set. It must be in the domain of a bitset.
+  bool Insert(T value) {
+    if (!domain_)
+      return table_.insert(value).second;
+
+    cinq::utility::CinqAssert(domain_->Contains(value));
+    const size_t offset = domain_->Offset(value);
+    const std::uint64_t bit = std::uint64_t(1) << (offset % 64);
+    std::uint64_t &word = words_[offset / 64];
+    if (word & bit)
+      return false;
+    word |= bit;
+    return true;
+  }
+
+  bool Contains(T value) const {
+    if (!domain_)
+      return table_.find(value) != table_.end();
+
+    if (!domain_->Contains(value))
+      return false;
+    const size_t offset = domain_->Offset(value);
+    return (words_[offset / 64] >> (offset % 64)) & 1;
+  }
+
+  // Keeps the elements which are also in rhs. Both of them must be bitsets of the same domain.
+  void IntersectWith(const DomainSet &rhs) {
+    cinq::utility::CinqAssert(IsBitset() && rhs.IsBitset() && words_.size() == rhs.words_.size());
+    for (size_t i = 0; i < words_.size(); ++i)
+      words_[i] &= rhs.words_[i];
+  }
+
+  bool Empty() const {
+    if (!domain_)
+      return table_.empty();
+
+    for (std::uint64_t word : words_) {
+      if (word)
+        return false;
+    }
+    return true;
+  }
+
+private:
+  std::optional<Domain<T>> domain_;
+  std::vector<std::uint64_t> words_;
+  FlatHashTable<T> table_;
+};
+
+} // namespace cinq::detail
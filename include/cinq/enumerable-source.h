@@ -1,10 +1,15 @@
 #pragma once
 
+#include <algorithm>
+#include <cstddef>
 #include <functional>
 #include <iterator>
 #include <type_traits>
 
 #include "detail/utility.h"
+#include "batch.h"
+#include "size-hint.h"
+#include "splittable-ranges.h"
 
 namespace cinq::detail {
 template <bool ConstVersion, class TSource>
@@ -17,6 +22,20 @@ struct is_enumerable_source<EnumerableSource<ConstVersion, T>> : std::true_type
 template <class T>
 inline constexpr bool is_enumerable_source_v = is_enumerable_source<T>::value;
 
+// Whether the elements of TContainer are stored contiguously (i.e. std::data is available), and its iterators yield lvalues of them.
+template <class TContainer, class = void>
+struct is_contiguous_container : std::false_type {};
+template <class TContainer>
+struct is_contiguous_container<TContainer,
+  std::void_t<decltype(std::data(std::declval<TContainer &>())), decltype(std::size(std::declval<TContainer &>()))>>
+  : std::is_same<decltype(*std::begin(std::declval<TContainer &>())), decltype(*std::data(std::declval<TContainer &>()))> {};
+
+// Whether the number of elements of TContainer is given by std::size.
+template <class TContainer, class = void>
+struct is_sized_container : std::false_type {};
+template <class TContainer>
+struct is_sized_container<TContainer, std::void_t<decltype(std::size(std::declval<TContainer &>()))>> : std::true_type {};
+
 // TSource can be reference
 template <bool ConstVersion, class TSource>
 struct EnumerableSource {
@@ -30,6 +49,15 @@ public:
       decltype(std::begin(std::declval<cinq::utility::remove_smart_ptr_t<TSource> &>()))
     >;
 
+  // The container as seen by ResultIterator.
+  using ContainerType = std::conditional_t<ConstVersion,
+      const std::remove_reference_t<cinq::utility::remove_smart_ptr_t<TSource>>,
+      std::remove_reference_t<cinq::utility::remove_smart_ptr_t<TSource>>
+    >;
+
+  // See is_batch_evaluable.
+  static constexpr bool is_contiguous = is_contiguous_container<ContainerType>::value;
+
   template <class... TS>
   EnumerableSource(TS&&... source) : source_{std::forward<TS>(source)...} {}
 
@@ -77,6 +105,72 @@ public:
     return end();
   }
 
+  // Passes each element to sink, until sink returns false. Returns false if it's stopped by sink.
+  // The elements are the ones yielded by ConstResultIterator if RetConstness is true, by ResultIterator otherwise.
+  template <bool RetConstness = ConstVersion, class Sink>
+  bool ForEach(Sink &&sink) {
+    if constexpr (RetConstness && !ConstVersion) {
+      return static_cast<const EnumerableSource &>(*this).ForEach(std::forward<Sink>(sink));
+    } else {
+      for (auto ite = begin(), last = end(); ite != last; ++ite) {
+        if (!sink(*ite))
+          return false;
+      }
+      return true;
+    }
+  }
+
+  template <class Sink>
+  bool ForEach(Sink &&sink) const {
+    for (auto ite = begin(), last = end(); ite != last; ++ite) {
+      if (!sink(*ite))
+        return false;
+    }
+    return true;
+  }
+
+  // See is_batch_evaluable, only available when the source is contiguous. The batches are dense.
+  template <class BatchSink>
+  bool ForEachBatch(BatchSink &&batch_sink) {
+    static_assert(is_contiguous);
+    ContainerType &container = GetContainer();
+    auto *elements = std::data(container);
+    using BatchType = Batch<std::remove_pointer_t<decltype(elements)>>;
+
+    for (size_t first = 0, size = std::size(container); first < size; first += batch_size) {
+      if (!batch_sink(BatchType{elements + first, nullptr, std::min(batch_size, size - first)}))
+        return false;
+    }
+    return true;
+  }
+
+  // The size is exact if the container provides std::size, or its iterators are random access, and unknown otherwise.
+  SizeHint GetSizeHint() {
+    if constexpr (is_sized_container<ContainerType>::value)
+      return {static_cast<size_t>(std::size(GetContainer())), true};
+    else if constexpr (cinq::utility::is_random_access_iterator_v<ResultIterator>)
+      return {static_cast<size_t>(std::distance(begin(), end())), true};
+    else
+      return {};
+  }
+
+  // See is_range_splittable, only available when ResultIterator is a random access iterator.
+  auto MakeRanges() {
+    ResultIterator source_first = begin();
+    return SplittableRanges(static_cast<size_t>(std::distance(source_first, end())), [source_first](size_t first, size_t last, auto &sink) {
+      for (auto ite = std::next(source_first, first), range_end = std::next(source_first, last); ite != range_end; ++ite) {
+        if (!sink(*ite))
+          return false;
+      }
+      return true;
+    });
+  }
+
+  // Only available if the container is sorted, i.e. a std::set or a std::map ordered by operator< (see EnumerableTraits).
+  std::less<> SortCompare() const {
+    return {};
+  }
+
   friend decltype(auto) MoveSource(EnumerableSource &&source) {
     if constexpr (std::is_lvalue_reference_v<TSource>) {
       return std::ref(source.source_);
@@ -86,7 +180,20 @@ public:
   }
 
 private:
+  auto &GetContainer() {
+    if constexpr (cinq::utility::is_smart_ptr_v<TSource>)
+      return *source_;
+    else
+      return source_;
+  }
+
   TSource source_;
 };
 
+// Pushes each element of a source (EnumerableSource, Enumerable or Cinq) to sink, see Enumerable::ForEach.
+template <class TSource, class Sink>
+bool SourceForEach(TSource &source, Sink &&sink) {
+  return source.ForEach(std::forward<Sink>(sink));
+}
+
 } // namespace cinq::detail
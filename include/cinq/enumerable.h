@@ -1,14 +1,19 @@
 #pragma once
 
 #include <cstddef>
+#include <cstdint>
+#include <iterator>
 #include <type_traits>
 #include <tuple>
+#include <utility>
 #include <variant>
 
 #include "detail/concept.h"
+#include "batch.h"
 #include "enumerable-source.h"
 #include "query-category.h"
 #include "query-iterator.h"
+#include "size-hint.h"
 
 namespace cinq::detail {
 template <bool ConstVersion, class TEnumerable>
@@ -31,6 +36,161 @@ struct is_enumerable<Enumerable<ConstVersion, QueryTag, TTupleFns, TSources...>>
 template <class T>
 inline constexpr bool is_enumerable_v = is_enumerable<T>::value;
 
+// A range splittable enumerable can enumerate the elements coming from any range of indices of its underlying source, independently.
+// It provides MakeRanges(), which returns a SplittableRanges.
+// A source with random access iterator is range splittable, and so are Select, Where, SelectMany and the hash Join over a range splittable
+//   enumerable (the outer one for Join).
+template <class T>
+struct is_range_splittable : std::false_type {};
+template <bool ConstVersion, class T>
+struct is_range_splittable<EnumerableSource<ConstVersion, T>>
+  : std::is_base_of<std::random_access_iterator_tag,
+      typename std::iterator_traits<typename EnumerableSource<ConstVersion, T>::ResultIterator>::iterator_category> {};
+template <bool ConstVersion, class TFn, class TSource>
+struct is_range_splittable<Enumerable<ConstVersion, QueryCategory::Select, std::tuple<TFn>, TSource>> : is_range_splittable<TSource> {};
+template <bool ConstVersion, class TFn, class TSource>
+struct is_range_splittable<Enumerable<ConstVersion, QueryCategory::Where, std::tuple<TFn>, TSource>> : is_range_splittable<TSource> {};
+template <bool ConstVersion, class TFn, class TSource>
+struct is_range_splittable<Enumerable<ConstVersion, QueryCategory::SelectMany, std::tuple<TFn>, TSource>> : is_range_splittable<TSource> {};
+template <bool ConstVersion, class TTupleFns, class TSource, class TSource2>
+struct is_range_splittable<Enumerable<ConstVersion, QueryCategory::Join, TTupleFns, TSource, TSource2>>
+  : std::bool_constant<is_range_splittable<TSource>::value &&
+      QueryIterator<ConstVersion, ConstVersion, BasicEnumerable<QueryCategory::Join, TTupleFns, TSource, TSource2>>::strategy == JoinStrategy::Hash> {};
+template <bool ConstVersion, class TEnumerable>
+struct is_range_splittable<Cinq<ConstVersion, TEnumerable>> : is_range_splittable<TEnumerable> {};
+template <class T>
+inline constexpr bool is_range_splittable_v = is_range_splittable<T>::value;
+
+// A batch evaluable enumerable can pass its elements in Batches of at most batch_size elements, it provides ForEachBatch(batch_sink),
+//   which calls batch_sink with each batch until it returns false.
+// A contiguous source is batch evaluable, and so are Where, Batched and Select (whose results are small trivial prvalues, see
+//   QueryIterator::is_batch_evaluable) over a batch evaluable enumerable.
+// Where builds a selection vector over the batch of its source, and Select stores its results in a buffer, so that each query
+//   runs one tight loop per batch. Hence the function objects are called for a whole batch before the next query sees any of them.
+// A batch evaluable query is only evaluated in batches if it's preferred (see prefers_batch_evaluation), as the fused per element
+//   loop of ForEach is usually faster for plain function objects.
+template <class T>
+struct is_batch_evaluable : std::false_type {};
+template <bool ConstVersion, class T>
+struct is_batch_evaluable<EnumerableSource<ConstVersion, T>> : std::bool_constant<EnumerableSource<ConstVersion, T>::is_contiguous> {};
+template <bool ConstVersion, class TFn, class TSource>
+struct is_batch_evaluable<Enumerable<ConstVersion, QueryCategory::Select, std::tuple<TFn>, TSource>>
+  : std::bool_constant<is_batch_evaluable<TSource>::value &&
+      QueryIterator<ConstVersion, ConstVersion, BasicEnumerable<QueryCategory::Select, std::tuple<TFn>, TSource>>::is_batch_evaluable> {};
+template <bool ConstVersion, class TFn, class TSource>
+struct is_batch_evaluable<Enumerable<ConstVersion, QueryCategory::Where, std::tuple<TFn>, TSource>> : is_batch_evaluable<TSource> {};
+template <bool ConstVersion, class TFn, class TSource>
+struct is_batch_evaluable<Enumerable<ConstVersion, QueryCategory::Batched, std::tuple<TFn>, TSource>> : is_batch_evaluable<TSource> {};
+template <bool ConstVersion, class TEnumerable>
+struct is_batch_evaluable<Cinq<ConstVersion, TEnumerable>> : is_batch_evaluable<TEnumerable> {};
+template <class T>
+inline constexpr bool is_batch_evaluable_v = is_batch_evaluable<T>::value;
+
+// Whether a chain of Select and Where is better evaluated in batches, i.e. it contains a Batched (see Cinq::AsBatched),
+//   or a Where whose predicate is vectorized (see QueryIterator::has_vectorized_predicate).
+template <class T>
+struct prefers_batch_evaluation : std::false_type {};
+template <bool ConstVersion, class TFn, class TSource>
+struct prefers_batch_evaluation<Enumerable<ConstVersion, QueryCategory::Select, std::tuple<TFn>, TSource>> : prefers_batch_evaluation<TSource> {};
+template <bool ConstVersion, class TFn, class TSource>
+struct prefers_batch_evaluation<Enumerable<ConstVersion, QueryCategory::Where, std::tuple<TFn>, TSource>>
+  : std::bool_constant<prefers_batch_evaluation<TSource>::value ||
+      QueryIterator<ConstVersion, ConstVersion, BasicEnumerable<QueryCategory::Where, std::tuple<TFn>, TSource>>::has_vectorized_predicate> {};
+template <bool ConstVersion, class TFn, class TSource>
+struct prefers_batch_evaluation<Enumerable<ConstVersion, QueryCategory::Batched, std::tuple<TFn>, TSource>> : std::true_type {};
+template <bool ConstVersion, class TEnumerable>
+struct prefers_batch_evaluation<Cinq<ConstVersion, TEnumerable>> : prefers_batch_evaluation<TEnumerable> {};
+template <class T>
+inline constexpr bool prefers_batch_evaluation_v = prefers_batch_evaluation<T>::value;
+
+// Whether every batch of a batch evaluable enumerable is dense, i.e. the chain has no Where.
+template <class T>
+struct yields_dense_batches : std::false_type {};
+template <bool ConstVersion, class T>
+struct yields_dense_batches<EnumerableSource<ConstVersion, T>> : std::bool_constant<EnumerableSource<ConstVersion, T>::is_contiguous> {};
+template <bool ConstVersion, class TFn, class TSource>
+struct yields_dense_batches<Enumerable<ConstVersion, QueryCategory::Select, std::tuple<TFn>, TSource>> : yields_dense_batches<TSource> {};
+template <bool ConstVersion, class TFn, class TSource>
+struct yields_dense_batches<Enumerable<ConstVersion, QueryCategory::Batched, std::tuple<TFn>, TSource>> : yields_dense_batches<TSource> {};
+template <bool ConstVersion, class TEnumerable>
+struct yields_dense_batches<Cinq<ConstVersion, TEnumerable>> : yields_dense_batches<TEnumerable> {};
+template <class T>
+inline constexpr bool yields_dense_batches_v = yields_dense_batches<T>::value;
+
+// Whether a Select (resp. Where) following the enumerable is fused into it, i.e. it's a Select (resp. Where) of the same constness.
+// The fused query has one composed selector (resp. conjoined predicate) over the source TSource, see Cinq::Select and Cinq::Where.
+//   Likewise a ThenBy appends its key to the keys of an OrderBy, see Cinq::ThenBy.
+template <bool ConstVersion, class QueryTag, class T>
+struct fusible_query : std::false_type {};
+template <bool ConstVersion, class QueryTag, class TFn, class TSource>
+struct fusible_query<ConstVersion, QueryTag, Enumerable<ConstVersion, QueryTag, std::tuple<TFn>, TSource>>
+  : std::bool_constant<std::is_same_v<QueryTag, QueryCategory::Select> || std::is_same_v<QueryTag, QueryCategory::Where> ||
+      std::is_same_v<QueryTag, QueryCategory::OrderBy>> {
+  using Fn = TFn;
+  using Source = TSource;
+};
+template <bool ConstVersion, class QueryTag, class T>
+inline constexpr bool is_fusible_query_v = fusible_query<ConstVersion, QueryTag, T>::value;
+
+// Whether the references yielded by the iterators of an enumerable stay valid while the enumerable lives, so that the internal storage
+//   of set operations can alias the elements. Otherwise (i.e. SelectMany whose selector yields enumerables by value, which are released
+//   as soon as the iterator leaves them), the elements are copied into the internal storage.
+// The set operations which copy the elements yield the ones in the storage of their iterators, which are released with the iterators,
+//   so they yield stable references only if they alias the elements of their sources.
+template <class T>
+struct yields_stable_references : std::true_type {};
+template <bool ConstVersion, class QueryTag, class TTupleFns, class... TSources>
+struct yields_stable_references<Enumerable<ConstVersion, QueryTag, TTupleFns, TSources...>>
+  : std::conjunction<yields_stable_references<TSources>...> {};
+template <bool ConstVersion, class TFn, class TSource>
+struct yields_stable_references<Enumerable<ConstVersion, QueryCategory::SelectMany, std::tuple<TFn>, TSource>>
+  : std::bool_constant<yields_stable_references<TSource>::value &&
+      !QueryIterator<ConstVersion, ConstVersion, BasicEnumerable<QueryCategory::SelectMany, std::tuple<TFn>, TSource>>::is_produced_enumerable_owned> {};
+template <bool ConstVersion, class TEnumerable>
+struct yields_stable_references<Cinq<ConstVersion, TEnumerable>> : yields_stable_references<TEnumerable> {};
+template <bool ConstVersion, class TTupleFns, class... TSources>
+struct yields_stable_references<Enumerable<ConstVersion, QueryCategory::Distinct, TTupleFns, TSources...>>
+  : std::bool_constant<QueryIterator<ConstVersion, ConstVersion, BasicEnumerable<QueryCategory::Distinct, TTupleFns, TSources...>>::is_aliasing> {};
+template <bool ConstVersion, class TTupleFns, class... TSources>
+struct yields_stable_references<Enumerable<ConstVersion, QueryCategory::Union, TTupleFns, TSources...>>
+  : std::bool_constant<QueryIterator<ConstVersion, ConstVersion, BasicEnumerable<QueryCategory::Union, TTupleFns, TSources...>>::is_aliasing> {};
+template <bool ConstVersion, class TTupleFns, class... TSources>
+struct yields_stable_references<Enumerable<ConstVersion, QueryCategory::Intersect, TTupleFns, TSources...>>
+  : std::bool_constant<QueryIterator<ConstVersion, ConstVersion, BasicEnumerable<QueryCategory::Intersect, TTupleFns, TSources...>>::is_aliasing> {};
+template <bool ConstVersion, class TTupleFns, class TSource>
+struct yields_stable_references<Enumerable<ConstVersion, QueryCategory::OrderBy, TTupleFns, TSource>>
+  : std::bool_constant<QueryIterator<ConstVersion, ConstVersion, BasicEnumerable<QueryCategory::OrderBy, TTupleFns, TSource>>::is_aliasing> {};
+
+// Whether the function object of a query is the comparator which orders its elements, see Cinq::AssumeSorted.
+template <class QueryTag>
+inline constexpr bool holds_sort_compare_v = std::is_same_v<QueryTag, QueryCategory::AssumeSorted> ||
+  std::is_same_v<QueryTag, QueryCategory::SortedDistinct> || std::is_same_v<QueryTag, QueryCategory::SortedIntersect> ||
+  std::is_same_v<QueryTag, QueryCategory::SortedUnion> || std::is_same_v<QueryTag, QueryCategory::SortedExcept>;
+
+// The declared domain of the elements of an enumerable, see Enumerable::DeclaredDomain.
+template <class TSource>
+auto SourceDeclaredDomain(TSource &source) {
+  return source.DeclaredDomain();
+}
+
+// Whether the query iterator TIterator provides a static ForEach(Enumerable *, Sink &), which pushes the elements of the query to sink.
+template <class TIterator, class Sink, class = void>
+struct has_push_evaluation : std::false_type {};
+template <class TIterator, class Sink>
+struct has_push_evaluation<TIterator, Sink,
+  std::void_t<decltype(TIterator::ForEach(std::declval<typename TIterator::Enumerable *>(), std::declval<Sink &>()))>> : std::true_type {};
+
+// The category of the iterators of a query, std::input_iterator_tag unless its query iterator declares a stronger one (e.g. Select).
+// A bidirectional query iterator provides operator--, a random access one also provides operator+= and operator-.
+template <class TQueryIterator, class = void>
+struct query_iterator_category {
+  using type = std::input_iterator_tag;
+};
+template <class TQueryIterator>
+struct query_iterator_category<TQueryIterator, std::void_t<typename TQueryIterator::iterator_category>> {
+  using type = typename TQueryIterator::iterator_category;
+};
+
 template <class... TSources>
 class MultipleSources {
 public:
@@ -126,9 +286,7 @@ protected:
   friend class QueryIterator<false, true, BasicEnumerable>;
   friend class QueryIterator<false, false, BasicEnumerable>;
   friend class MultiVisitorSetIterator<IteratorTupleVisitor, true, QueryTag, TTupleFns, TSources...>;
-  friend class MultiVisitorSetIterator<RoundRobinIteratorTupleVisitor, true, QueryTag, TTupleFns, TSources...>;
   friend class MultiVisitorSetIterator<IteratorTupleVisitor, false, QueryTag, TTupleFns, TSources...>;
-  friend class MultiVisitorSetIterator<RoundRobinIteratorTupleVisitor, false, QueryTag, TTupleFns, TSources...>;
 
 public:
   template <class TupleFns>
@@ -155,9 +313,78 @@ public:
     static_assert(!std::is_reference_v<typename base::value_type>);
 
     using difference_type = std::ptrdiff_t;
-    using reference = std::add_lvalue_reference_t<typename base::value_type>;
+    using reference = decltype(*std::declval<const base &>());
     using pointer = std::add_pointer_t<typename base::value_type>;
-    using iterator_category = std::input_iterator_tag;
+    using iterator_category = typename query_iterator_category<base>::type;
+
+    Iterator &operator++() {
+      base::operator++();
+      return *this;
+    }
+
+    Iterator operator++(int) {
+      Iterator previous(*this);
+      base::operator++();
+      return previous;
+    }
+
+    // The following operators are only available if the iterator is bidirectional or random access, see query_iterator_category.
+    Iterator &operator--() {
+      base::operator--();
+      return *this;
+    }
+
+    Iterator operator--(int) {
+      Iterator previous(*this);
+      base::operator--();
+      return previous;
+    }
+
+    Iterator &operator+=(difference_type n) {
+      base::operator+=(n);
+      return *this;
+    }
+
+    Iterator &operator-=(difference_type n) {
+      base::operator+=(-n);
+      return *this;
+    }
+
+    decltype(auto) operator[](difference_type n) const {
+      return *(*this + n);
+    }
+
+    friend Iterator operator+(Iterator ite, difference_type n) {
+      return ite += n;
+    }
+
+    friend Iterator operator+(difference_type n, Iterator ite) {
+      return ite += n;
+    }
+
+    friend Iterator operator-(Iterator ite, difference_type n) {
+      return ite -= n;
+    }
+
+    friend difference_type operator-(const Iterator &lhs, const Iterator &rhs) {
+      return static_cast<const base &>(lhs) - static_cast<const base &>(rhs);
+    }
+
+    friend bool operator<(const Iterator &lhs, const Iterator &rhs) {
+      return lhs - rhs < 0;
+    }
+
+    friend bool operator>(const Iterator &lhs, const Iterator &rhs) {
+      return rhs < lhs;
+    }
+
+    friend bool operator<=(const Iterator &lhs, const Iterator &rhs) {
+      return !(rhs < lhs);
+    }
+
+    friend bool operator>=(const Iterator &lhs, const Iterator &rhs) {
+      return !(lhs < rhs);
+    }
   };
 };
 
@@ -187,6 +414,87 @@ public:
   ConstResultIterator cend() {
     return ConstResultIterator(this, true); // past-the-end iterator
   }
+
+  // Passes each element to sink, until sink returns false. Returns false if it's stopped by sink.
+  // The elements are of the same type as the ones yielded by Iterator<ConstVersion, RetConstness>.
+  // If the query is batch evaluable and it's preferred (see is_batch_evaluable), the elements are evaluated in batches.
+  // Otherwise if the query supports it (see has_push_evaluation), the source drives the loop and each query calls the next one directly,
+  //   otherwise the elements are pulled by the iterators.
+  template <bool RetConstness = ConstVersion, class Sink>
+  bool ForEach(Sink &&sink) {
+    using Iterator = typename base::template Iterator<ConstVersion, RetConstness>;
+    if constexpr (is_batch_evaluable_v<Enumerable> && prefers_batch_evaluation_v<Enumerable>) {
+      return ForEachBatch([&sink](const auto &batch) {
+        return batch.ForEach([&sink](auto &element, std::uint32_t) {
+          return sink(static_cast<typename Iterator::ResultType>(element));
+        });
+      });
+    } else if constexpr (has_push_evaluation<Iterator, std::remove_reference_t<Sink>>::value) {
+      return Iterator::ForEach(this, sink);
+    } else {
+      for (Iterator first(this, false), last(this, true); first != last; ++first) {
+        if (!sink(*first))
+          return false;
+      }
+      return true;
+    }
+  }
+
+  // See is_batch_evaluable.
+  template <class BatchSink>
+  bool ForEachBatch(BatchSink &&batch_sink) {
+    return ResultIterator::ForEachBatch(this, batch_sink);
+  }
+
+  // See SizeHint.
+  SizeHint GetSizeHint() {
+    return ResultIterator::GetSizeHint(this);
+  }
+
+  // See is_range_splittable.
+  auto MakeRanges() {
+    return ResultIterator::MakeRanges(this);
+  }
+
+  // Pushes only the first count elements, which the query selects without evaluating the others (e.g. OrderBy, see Cinq::First).
+  template <class Sink>
+  bool ForEachFirst(size_t count, Sink &&sink) {
+    return ResultIterator::ForEachFirst(this, count, sink);
+  }
+
+  // Moves out the function object and the source of a single source query, see fusible_query.
+  auto &&ReleaseFn() {
+    return std::move(this->FirstFn());
+  }
+
+  auto &&ReleaseSource() {
+    return std::move(this->SourceFront());
+  }
+
+  // The comparator which orders the elements, only available if they are sorted (see EnumerableTraits::Compare). It's held by
+  //   AssumeSorted and the merging queries, the others preserve the order of their source.
+  auto SortCompare() {
+    if constexpr (holds_sort_compare_v<QueryTag>)
+      return this->FirstFn();
+    else
+      return this->SourceFront().SortCompare();
+  }
+
+  // The domain of the elements, only available if it's declared (see EnumerableTraits::has_domain). It's held by WithDomain, a Concat
+  //   spans the ones of its sources, the other queries keep a subset of the elements of their first source.
+  auto DeclaredDomain() {
+    if constexpr (std::is_same_v<QueryTag, QueryCategory::WithDomain>) {
+      return this->FirstFn();
+    } else if constexpr (std::is_same_v<QueryTag, QueryCategory::Concat>) {
+      return std::apply([](auto &source, auto &... rest) {
+          auto domain = SourceDeclaredDomain(source);
+          ((domain = Hull(domain, SourceDeclaredDomain(rest))), ...);
+          return domain;
+        }, this->GetSourceTuple());
+    } else {
+      return SourceDeclaredDomain(this->SourceFront());
+    }
+  }
 };
 
 } // namespace cinq::detail
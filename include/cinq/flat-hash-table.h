@@ -0,0 +1,393 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <new>
+#include <set>
+#include <stdexcept>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+
+#include "detail/utility.h"
+#include "simd-filter.h"
+
+#if defined(__SSE2__) || defined(_M_X64) || defined(_M_IX86_FP) && _M_IX86_FP >= 2
+#define CINQ_FLAT_HASH_TABLE_SSE2
+#include <emmintrin.h>
+#endif
+
+namespace cinq::detail {
+// An open addressing hash table which stores its elements inline in one array, used as the internal storage of Intersect and Except
+//   when the elements are hashable, and of Distinct and Union when they alias the elements (see StableFlatHashSet otherwise).
+// Each slot has a control byte, which is either empty or the low 7 bits of the hash of its element. The slots are probed by groups of
+//   group_size: the control bytes of a group are compared with the 7 bits of the hash at once (with SSE2 if available), and only the
+//   matching elements are compared with the key. A group containing an empty slot ends the probing. Groups are probed quadratically.
+// Elements are never erased. An insertion may move all the elements (i.e. rehash), which invalidates the iterators, moving the table
+//   doesn't. An iterator is a pointer to an element, end() is nullptr, it can't be incremented: the elements are enumerated by ForEach.
+// TMapped is void for a set, otherwise the elements are std::pair<TKey, TMapped>. THash and TEqual are called with the keys, and
+//   with the arguments of find, insert and operator[].
+template <class TKey, class TMapped = void, class THash = std::hash<TKey>, class TEqual = std::equal_to<TKey>>
+class FlatHashTable {
+public:
+  using key_type = TKey;
+  using value_type = std::conditional_t<std::is_void_v<TMapped>, TKey, std::pair<TKey, TMapped>>;
+  using iterator = value_type *;
+  using size_type = size_t;
+
+  static constexpr size_t group_size = 16;
+
+  FlatHashTable() = default;
+
+  FlatHashTable(const FlatHashTable &rhs) : hash_(rhs.hash_), equal_(rhs.equal_) {
+    if (rhs.capacity_ == 0)
+      return ;
+
+    Allocate(rhs.capacity_);
+    std::memcpy(control_.get(), rhs.control_.get(), capacity_);
+    size_t constructed = 0;
+    try {
+      for (; constructed < capacity_; ++constructed) {
+        if (rhs.control_[constructed] != empty_control)
+          new (slots_ + constructed) value_type(rhs.slots_[constructed]);
+      }
+    } catch (...) {
+      Destroy(constructed);
+      throw;
+    }
+    size_ = rhs.size_;
+    growth_left_ = rhs.growth_left_;
+  }
+
+  FlatHashTable(FlatHashTable &&rhs) noexcept
+    : control_(std::move(rhs.control_)), slots_(std::exchange(rhs.slots_, nullptr)), capacity_(std::exchange(rhs.capacity_, 0)),
+      size_(std::exchange(rhs.size_, 0)), growth_left_(std::exchange(rhs.growth_left_, 0)), hash_(rhs.hash_), equal_(rhs.equal_) {}
+
+  FlatHashTable &operator=(const FlatHashTable &rhs) {
+    if (this != &rhs)
+      *this = FlatHashTable(rhs);
+    return *this;
+  }
+
+  FlatHashTable &operator=(FlatHashTable &&rhs) noexcept {
+    if (this != &rhs) {
+      Destroy(capacity_);
+      control_ = std::move(rhs.control_);
+      slots_ = std::exchange(rhs.slots_, nullptr);
+      capacity_ = std::exchange(rhs.capacity_, 0);
+      size_ = std::exchange(rhs.size_, 0);
+      growth_left_ = std::exchange(rhs.growth_left_, 0);
+      hash_ = rhs.hash_;
+      equal_ = rhs.equal_;
+    }
+    return *this;
+  }
+
+  ~FlatHashTable() {
+    Destroy(capacity_);
+  }
+
+  size_t size() const {
+    return size_;
+  }
+
+  bool empty() const {
+    return size_ == 0;
+  }
+
+  // The number of elements which can be held without moving them.
+  size_t capacity() const {
+    return size_ + growth_left_;
+  }
+
+  iterator end() const {
+    return nullptr;
+  }
+
+  // Rehashes once so that size elements can be inserted without moving them again.
+  void reserve(size_t size) {
+    if (size <= size_ + growth_left_)
+      return ;
+    size_t capacity = group_size;
+    while (MaxSize(capacity) < size)
+      capacity *= 2;
+    Rehash(capacity);
+  }
+
+  // Calls fn with each element, in the order of the slots.
+  template <class Fn>
+  void ForEach(Fn &&fn) const {
+    for (size_t i = 0; i < capacity_; ++i) {
+      if (control_[i] != empty_control)
+        fn(static_cast<const value_type &>(slots_[i]));
+    }
+  }
+
+  template <class K>
+  iterator find(const K &key) const {
+    return Find(Hash(key), key);
+  }
+
+  // Returns the iterator to the element equal to key, and whether it's inserted.
+  template <class K>
+  std::pair<iterator, bool> insert(K &&key) {
+    static_assert(std::is_void_v<TMapped>);
+    return TryEmplace(key, [&key](value_type *slot) { new (slot) value_type(std::forward<K>(key)); });
+  }
+
+  // The mapped value is value initialized when key is inserted.
+  template <class K, class Mapped = TMapped>
+  Mapped &operator[](K &&key) {
+    return TryEmplace(key, [&key](value_type *slot) {
+        new (slot) value_type(std::piecewise_construct, std::forward_as_tuple(std::forward<K>(key)), std::tuple<>());
+      }).first->second;
+  }
+
+private:
+  static constexpr std::int8_t empty_control = -128;
+
+  static size_t MaxSize(size_t capacity) {
+    return capacity - capacity / 8;
+  }
+
+  static const TKey &KeyOf(const value_type &value) {
+    if constexpr (std::is_void_v<TMapped>)
+      return value;
+    else
+      return value.first;
+  }
+
+  // The hash is mixed, as std::hash of integers is usually the identity, whose low bits would crowd the groups.
+  template <class K>
+  size_t Hash(const K &key) const {
+    const std::uint64_t hash = static_cast<std::uint64_t>(hash_(key)) * 0x9E3779B97F4A7C15ull;
+    return static_cast<size_t>(hash ^ (hash >> 32));
+  }
+
+  static std::int8_t ControlOf(size_t hash) {
+    return static_cast<std::int8_t>(hash & 0x7F);
+  }
+
+  // The bit i of the result is set if the control byte of the i-th slot of the group equals control.
+  static std::uint32_t Match(const std::int8_t *group, std::int8_t control) {
+#ifdef CINQ_FLAT_HASH_TABLE_SSE2
+    const __m128i bytes = _mm_loadu_si128(reinterpret_cast<const __m128i *>(group));
+    return static_cast<std::uint32_t>(_mm_movemask_epi8(_mm_cmpeq_epi8(bytes, _mm_set1_epi8(control))));
+#else
+    std::uint32_t mask = 0;
+    for (size_t i = 0; i < group_size; ++i)
+      mask |= static_cast<std::uint32_t>(group[i] == control) << i;
+    return mask;
+#endif
+  }
+
+  // Calls fn with each group in the probing order of hash, until fn returns true. There's always an empty slot, so it terminates.
+  template <class Fn>
+  void Probe(size_t hash, Fn &&fn) const {
+    const size_t group_mask = capacity_ / group_size - 1;
+    size_t group = (hash >> 7) & group_mask;
+    for (size_t step = 1; !fn(group * group_size); ++step)
+      group = (group + step) & group_mask;
+  }
+
+  template <class K>
+  iterator Find(size_t hash, const K &key) const {
+    if (capacity_ == 0)
+      return nullptr;
+
+    iterator result = nullptr;
+    Probe(hash, [this, hash, &key, &result](size_t first) {
+      for (auto match = Match(control_.get() + first, ControlOf(hash)); match; match &= match - 1) {
+        auto slot = slots_ + first + simd::CountTrailingZeros(match);
+        if (equal_(KeyOf(*slot), key)) {
+          result = slot;
+          return true;
+        }
+      }
+      return Match(control_.get() + first, empty_control) != 0;
+    });
+    return result;
+  }
+
+  size_t FindEmptySlot(size_t hash) const {
+    size_t result = 0;
+    Probe(hash, [this, &result](size_t first) {
+      auto match = Match(control_.get() + first, empty_control);
+      if (match)
+        result = first + simd::CountTrailingZeros(match);
+      return match != 0;
+    });
+    return result;
+  }
+
+  template <class K, class Construct>
+  std::pair<iterator, bool> TryEmplace(const K &key, Construct &&construct) {
+    const size_t hash = Hash(key);
+    if (auto found = Find(hash, key))
+      return {found, false};
+
+    if (growth_left_ == 0)
+      Rehash(capacity_ == 0 ? group_size : capacity_ * 2);
+
+    const size_t slot = FindEmptySlot(hash);
+    construct(slots_ + slot);
+    control_[slot] = ControlOf(hash);
+    ++size_;
+    --growth_left_;
+    return {slots_ + slot, true};
+  }
+
+  void Rehash(size_t capacity) {
+    FlatHashTable table;
+    table.hash_ = hash_;
+    table.equal_ = equal_;
+    table.Allocate(capacity);
+
+    for (size_t i = 0; i < capacity_; ++i) {
+      if (control_[i] == empty_control)
+        continue;
+      const size_t hash = Hash(KeyOf(slots_[i]));
+      const size_t slot = table.FindEmptySlot(hash);
+      new (table.slots_ + slot) value_type(std::move_if_noexcept(slots_[i]));
+      table.control_[slot] = ControlOf(hash);
+    }
+    table.size_ = size_;
+    table.growth_left_ = MaxSize(capacity) - size_;
+    *this = std::move(table);
+  }
+
+  void Allocate(size_t capacity) {
+    if (capacity > std::allocator_traits<std::allocator<value_type>>::max_size(std::allocator<value_type>()))
+      throw std::length_error("FlatHashTable is too large.");
+    control_ = std::make_unique<std::int8_t[]>(capacity);
+    std::memset(control_.get(), static_cast<unsigned char>(empty_control), capacity);
+    slots_ = std::allocator<value_type>().allocate(capacity);
+    capacity_ = capacity;
+    growth_left_ = MaxSize(capacity);
+  }
+
+  // Destroys the elements in the first count slots, and releases the storage.
+  void Destroy(size_t count) {
+    if (!slots_)
+      return ;
+    for (size_t i = 0; i < count; ++i) {
+      if (control_[i] != empty_control)
+        slots_[i].~value_type();
+    }
+    std::allocator<value_type>().deallocate(slots_, capacity_);
+    slots_ = nullptr;
+    control_.reset();
+    capacity_ = size_ = growth_left_ = 0;
+  }
+
+  std::unique_ptr<std::int8_t[]> control_;
+  value_type *slots_ = nullptr;
+  size_t capacity_ = 0;
+  size_t size_ = 0;
+  size_t growth_left_ = 0;
+
+  THash hash_;
+  TEqual equal_;
+};
+
+// A set holding its elements in a std::deque, which never moves them, indexed by a FlatHashTable of ReferenceWrapper to them. Hence
+//   the references to the elements are valid for the lifetime of the set, while it allocates once per chunk of elements rather than
+//   once per element as a node based set. Used as the internal storage of Distinct and Union when they copy the elements.
+// An iterator is a pointer to an element, end() is nullptr, the elements are enumerated by ForEach in the order of their insertion.
+template <class T>
+class StableFlatHashSet {
+public:
+  using key_type = T;
+  using value_type = T;
+  using iterator = const T *;
+  using size_type = size_t;
+
+  StableFlatHashSet() = default;
+
+  StableFlatHashSet(const StableFlatHashSet &rhs) : elements_(rhs.elements_) {
+    index_.reserve(elements_.size());
+    for (const auto &element : elements_)
+      index_.insert(element);
+  }
+
+  // Moving the std::deque hands over its chunks, the index keeps referring to the same elements.
+  StableFlatHashSet(StableFlatHashSet &&) = default;
+
+  StableFlatHashSet &operator=(const StableFlatHashSet &rhs) {
+    if (this != &rhs)
+      *this = StableFlatHashSet(rhs);
+    return *this;
+  }
+
+  StableFlatHashSet &operator=(StableFlatHashSet &&) = default;
+
+  size_t size() const {
+    return elements_.size();
+  }
+
+  bool empty() const {
+    return elements_.empty();
+  }
+
+  // The number of elements which can be held without rehashing the index.
+  size_t capacity() const {
+    return index_.capacity();
+  }
+
+  iterator end() const {
+    return nullptr;
+  }
+
+  void reserve(size_t size) {
+    index_.reserve(size);
+  }
+
+  // Calls fn with each element, in the order of their insertion.
+  template <class Fn>
+  void ForEach(Fn &&fn) const {
+    for (const auto &element : elements_)
+      fn(element);
+  }
+
+  iterator find(const T &key) const {
+    auto found = index_.find(key);
+    return found ? &static_cast<const T &>(*found) : nullptr;
+  }
+
+  // Returns the iterator to the element equal to key, and whether it's inserted.
+  template <class K>
+  std::pair<iterator, bool> insert(K &&key) {
+    if (auto found = find(key))
+      return {found, false};
+
+    elements_.emplace_back(std::forward<K>(key));
+    try {
+      index_.insert(static_cast<const T &>(elements_.back()));
+    } catch (...) {
+      elements_.pop_back();
+      throw;
+    }
+    return {&elements_.back(), true};
+  }
+
+private:
+  std::deque<T> elements_;
+  FlatHashTable<cinq::utility::ReferenceWrapper<T>> index_;
+};
+
+// The set of the elements of Distinct and Union. It aliases the elements if is_aliasing, otherwise it copies them.
+template <class T, bool is_aliasing>
+using SetOperationSet = std::conditional_t<cinq::utility::ReferenceWrapper<T>::hash_version,
+  std::conditional_t<is_aliasing, FlatHashTable<cinq::utility::ReferenceWrapper<T>>, StableFlatHashSet<T>>,
+  std::set<std::conditional_t<is_aliasing, cinq::utility::ReferenceWrapper<T>, T>>>;
+
+template <class T>
+struct is_flat_hash_table : std::false_type {};
+template <class TKey, class TMapped, class THash, class TEqual>
+struct is_flat_hash_table<FlatHashTable<TKey, TMapped, THash, TEqual>> : std::true_type {};
+
+} // namespace cinq::detail
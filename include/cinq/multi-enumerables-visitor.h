@@ -1,193 +1,168 @@
 #pragma once
 
+#include <array>
 #include <cstddef>
-#include <exception>
+#include <functional>
 #include <iterator>
 #include <tuple>
 #include <type_traits>
 #include <utility>
-#include <variant>
 
 namespace cinq::detail {
 template <class QueryTag, class TFn, class... TSources>
 class BasicEnumerable;
 
-template <size_t depth>
-struct Visitor {
-  template <class Ret, class Fn, class... ResultIterator>
-  static Ret Visit(Fn &&fn, size_t target, std::tuple<ResultIterator...> &first, std::tuple<ResultIterator...> &last)  {
-    if (depth - 1 == target)
-      return std::invoke(std::forward<Fn>(fn), std::get<depth - 1>(first), std::get<depth - 1>(last));
-    return Visitor<depth - 1>::template Visit<Ret>(std::forward<Fn>(fn), target, first, last);
-  }
-};
-
-template <>
-struct Visitor<static_cast<size_t>(0)> {
-  template <class Ret, class Fn, class... ResultIterator>
-  static Ret Visit(Fn &&, size_t, std::tuple<ResultIterator...> &, std::tuple<ResultIterator...> &) {
-    throw std::runtime_error("Round robin visitor internal failure");
-    // return std::invoke(std::forward<Fn>(fn), std::get<0>(first), std::get<0>(last));
-  }
-};
-
+// Visits the elements of the enumerables one after another, each enumerable being a segment. The iterators of all the segments are
+//   kept in a tuple, the ones of a segment are assigned when it's entered (so that it isn't evaluated before). The operations on the
+//   current segment are dispatched through a table of functions generated for each segment (see Dispatch), so an increment costs a
+//   single indirect call, and the next segment is only looked up once the end of the current one is reached.
 template <bool ArgConstness, class... TSources>
-class RoundRobinIteratorTupleVisitor {
-  template <size_t... index>
-  static auto GetFirst(std::tuple<TSources...> &enumerable, std::index_sequence<index...>) {
-    return std::make_tuple(std::begin(std::get<index>(enumerable))...);
-  }
-
-  template <size_t... index>
-  static auto GetLast(std::tuple<TSources...> &enumerable, std::index_sequence<index...>) {
-    return std::make_tuple(std::end(std::get<index>(enumerable))...);
-  }
-
+class IteratorTupleVisitor {
 public:
-  RoundRobinIteratorTupleVisitor() {}
+  IteratorTupleVisitor() {}
 
-  RoundRobinIteratorTupleVisitor(std::tuple<TSources...> &enumerable)
-    : first_(GetFirst(enumerable, std::index_sequence_for<TSources...>())),
-      last_(GetLast(enumerable, std::index_sequence_for<TSources...>())){
-    MoveToNext(enumerable);
-  }
+  IteratorTupleVisitor(std::tuple<TSources...> &enumerable)
+    : is_dereferenceable_(Enter(enumerable) || EnterNextSegment(enumerable)) {}
 
   template <class Fn>
-  decltype(auto) Visit(Fn &&fn) {
+  decltype(auto) Visit(Fn &&fn) const {
     using Ret = std::invoke_result_t<Fn &&, decltype(*std::get<0>(first_))>;
-    return Visitor<sizeof...(TSources)>::template Visit<Ret>([&fn](auto &first, auto &) -> decltype(auto) {
-        return std::invoke(std::forward<Fn>(fn), *first);
-      }, current_enumerable_, first_, last_);
+    return Dispatch<Ret>(current_, [this, &fn](auto index) -> Ret {
+        return std::invoke(std::forward<Fn>(fn), *std::get<index>(first_));
+      });
   }
 
-  bool MoveToNext() noexcept {
-    const size_t start = current_enumerable_ = (current_enumerable_ + 1) % sizeof...(TSources);
-    while (!Visitor<sizeof...(TSources)>::template Visit<bool>([this](auto &first, auto &last) -> bool {
-        return first != last && (!is_touched_[current_enumerable_] || ++first != last);
-      }, current_enumerable_, first_, last_)) {
-      current_enumerable_ = (current_enumerable_ + 1) % sizeof...(TSources);
-      if (current_enumerable_ == start)
-        return is_dereferenceable_ = false;
-    }
-
-    is_dereferenceable_ = true;
-    is_touched_[current_enumerable_] = true;
-    return true;
-  }
-
-  bool MoveToNext(std::tuple<TSources...> &) noexcept {
-    return MoveToNext();
+  bool MoveToNext(std::tuple<TSources...> &enumerable) {
+    if (Dispatch<bool>(current_, [this](auto index) { return ++std::get<index>(first_) != std::get<index>(last_); }))
+      return true;
+    return is_dereferenceable_ = EnterNextSegment(enumerable);
   }
 
   bool IsValid() const {
     return is_dereferenceable_;
   }
 
-  friend bool operator==(const RoundRobinIteratorTupleVisitor &lhs, const RoundRobinIteratorTupleVisitor &rhs) {
-    return lhs.current_enumerable_ == rhs.current_enumerable_ &&
-      lhs.is_dereferenceable_ == rhs.is_dereferenceable_ &&
-      lhs.first_ == rhs.first_;
-  }
-
-private:
-  std::tuple<typename TSources::ResultIterator...> first_;
-  std::tuple<typename TSources::ResultIterator...> last_;
-  bool is_touched_[sizeof...(TSources)] = {0};
-  size_t current_enumerable_ = 0;
-
-  bool is_dereferenceable_ = false;
-};
-
-template <size_t depth>
-struct EmplaceIteratorWrapper {
-  template <class IteratorTupleVisitor, class... TSources>
-  static bool EmplaceIteratorAt(std::tuple<TSources...> &enumerables, size_t index, IteratorTupleVisitor *p) {
-    if (index + 1 == depth) {
-      p->first_.template emplace<depth-1>(std::begin(std::get<depth-1>(enumerables)));
-      p->last_.template emplace<depth-1>(std::end(std::get<depth-1>(enumerables)));
-      return true;
+  // Moves to the previous element, which is the last one of the enumerables if the visitor is invalid (i.e. past the end). The
+  //   preceding segments are entered backward until one isn't empty.
+  // Only available when the iterators of all the enumerables are bidirectional.
+  void MoveToPrevious(std::tuple<TSources...> &enumerable) {
+    if (is_dereferenceable_ && Dispatch<bool>(current_, [this, &enumerable](auto index) {
+          if (std::get<index>(first_) == std::begin(std::get<index>(enumerable)))
+            return false;
+          --std::get<index>(first_);
+          return true;
+        }))
+      return ;
+
+    for (size_t segment = is_dereferenceable_ ? current_ : sizeof...(TSources); segment-- > 0; ) {
+      const bool is_entered = Dispatch<bool>(segment, [this, &enumerable](auto index) {
+          std::get<index>(first_) = std::end(std::get<index>(enumerable));
+          std::get<index>(last_) = std::end(std::get<index>(enumerable));
+          if (std::get<index>(first_) == std::begin(std::get<index>(enumerable)))
+            return false;
+          --std::get<index>(first_);
+          return true;
+        });
+      if (is_entered) {
+        current_ = segment;
+        is_dereferenceable_ = true;
+        return ;
+      }
     }
-    return EmplaceIteratorWrapper<depth-1>::EmplaceIteratorAt(enumerables, index, p);
   }
-};
 
-template <>
-struct EmplaceIteratorWrapper<0> {
-  template <class IteratorTupleVisitor, class... TSources>
-  static bool EmplaceIteratorAt(const std::tuple<TSources...> &, size_t, IteratorTupleVisitor *) {
-    return false;
+  // The index of the current element in the concatenation of the enumerables, or the sum of their sizes if there's none.
+  // Only available when the iterators of all the enumerables are random access, so that it's computed with their sizes.
+  std::ptrdiff_t Position(std::tuple<TSources...> &enumerable) const {
+    const auto sizes = GetSizes(enumerable, std::index_sequence_for<TSources...>());
+    const size_t current = is_dereferenceable_ ? current_ : sizes.size();
+    std::ptrdiff_t position = 0;
+    for (size_t i = 0; i < current; ++i)
+      position += sizes[i];
+    if (is_dereferenceable_) {
+      Dispatch<void>(current, [this, &enumerable, &position](auto index) {
+        position += std::get<index>(first_) - std::begin(std::get<index>(enumerable));
+      });
+    }
+    return position;
   }
-};
-
-template <bool ArgConstness, class... TSources>
-class IteratorTupleVisitor {
-  template <size_t depth>
-  friend struct EmplaceIteratorWrapper;
-  using EmplaceIteratorWrapperT = EmplaceIteratorWrapper<sizeof...(TSources)>;
-
-public:
-  IteratorTupleVisitor() {}
 
-  IteratorTupleVisitor(std::tuple<TSources...> &enumerable) {
-    bool has_value = EmplaceIteratorWrapperT::EmplaceIteratorAt(enumerable, current_enumerable_++, this);
+  // Moves to the element at position, see Position. A position past the last element makes the visitor invalid.
+  void MoveTo(std::tuple<TSources...> &enumerable, std::ptrdiff_t position) {
+    const auto sizes = GetSizes(enumerable, std::index_sequence_for<TSources...>());
+    size_t target = 0;
+    for (; target < sizes.size() && position >= sizes[target]; ++target)
+      position -= sizes[target];
 
-    auto is_end = [](auto &lhs, auto &rhs) -> bool {
-      if constexpr (std::is_same_v<decltype(lhs), decltype(rhs)>)
-        return lhs == rhs;
-      else
-        throw std::runtime_error("IteratorTupleVisitor test end failure.");
-    };
+    current_ = target;
+    if (target == sizes.size()) {
+      is_dereferenceable_ = false;
+      return ;
+    }
 
-    while (has_value && std::visit(is_end, first_, last_))
-      has_value = EmplaceIteratorWrapperT::EmplaceIteratorAt(enumerable, current_enumerable_++, this);
-    is_dereferenceable_ = has_value;
+    Dispatch<void>(target, [this, &enumerable, position](auto index) {
+      std::get<index>(first_) = std::next(std::begin(std::get<index>(enumerable)), position);
+      std::get<index>(last_) = std::end(std::get<index>(enumerable));
+    });
+    is_dereferenceable_ = true;
   }
 
-  template <class Fn>
-  decltype(auto) Visit(Fn &&fn) const {
-    return std::visit([&fn](auto &ite) -> decltype(auto) {
-        return std::invoke(std::forward<Fn>(fn), *ite);
-      },
-      first_);
+  // Invalid visitors are all past the end.
+  friend bool operator==(const IteratorTupleVisitor &lhs, const IteratorTupleVisitor &rhs) {
+    if (!lhs.is_dereferenceable_ || !rhs.is_dereferenceable_)
+      return lhs.is_dereferenceable_ == rhs.is_dereferenceable_;
+    return lhs.current_ == rhs.current_ && Dispatch<bool>(lhs.current_, [&lhs, &rhs](auto index) {
+        return std::get<index>(lhs.first_) == std::get<index>(rhs.first_);
+      });
   }
 
-  bool MoveToNext(std::tuple<TSources...> &enumerable) noexcept {
-    std::visit([](auto &ite) {++ite;}, first_);
+private:
+  // Calls fn with std::integral_constant<size_t, index>, through a table of the instantiations of fn for each segment.
+  template <class Ret, class Fn>
+  static Ret Dispatch(size_t index, Fn &&fn) {
+    return DispatchImpl<Ret>(index, fn, std::index_sequence_for<TSources...>());
+  }
 
-    auto is_end = [](auto &lhs, auto &rhs) -> bool {
-      // first and last must be of the identical type
-      // User-provided container's iterator is either isolated or checked to be identical.
-      if constexpr (std::is_same_v<decltype(lhs), decltype(rhs)>)
-        return lhs == rhs;
-      else
-        throw std::runtime_error("IteratorTupleVisitor's is_end internal error.");
+  template <class Ret, class Fn, size_t... indexes>
+  static Ret DispatchImpl(size_t index, Fn &fn, std::index_sequence<indexes...>) {
+    static constexpr Ret (*table[])(Fn &) = {
+      [](Fn &fn) -> Ret { return fn(std::integral_constant<size_t, indexes>()); }...
     };
+    return table[index](fn);
+  }
 
-    bool has_value = true;
-    while (has_value && std::visit(is_end, first_, last_))
-      has_value = EmplaceIteratorWrapperT::EmplaceIteratorAt(enumerable, current_enumerable_++, this);
-
-    return is_dereferenceable_ = has_value;
+  // Assigns the iterators of the current segment, returns whether it isn't empty.
+  bool Enter(std::tuple<TSources...> &enumerable) {
+    return Dispatch<bool>(current_, [this, &enumerable](auto index) {
+        std::get<index>(first_) = std::begin(std::get<index>(enumerable));
+        std::get<index>(last_) = std::end(std::get<index>(enumerable));
+        return std::get<index>(first_) != std::get<index>(last_);
+      });
   }
 
-  bool IsValid() const {
-    return is_dereferenceable_;
+  // Enters the segments following the current one until one isn't empty, returns whether there's one.
+  bool EnterNextSegment(std::tuple<TSources...> &enumerable) {
+    while (++current_ < sizeof...(TSources)) {
+      if (Enter(enumerable))
+        return true;
+    }
+    return false;
   }
 
-  friend bool operator==(const IteratorTupleVisitor &lhs, const IteratorTupleVisitor &rhs) {
-    return lhs.current_enumerable_ == rhs.current_enumerable_ &&
-      lhs.is_dereferenceable_ == rhs.is_dereferenceable_ &&
-      lhs.first_ == rhs.first_;
+  template <size_t... index>
+  static std::array<std::ptrdiff_t, sizeof...(TSources)> GetSizes(std::tuple<TSources...> &enumerable, std::index_sequence<index...>) {
+    return {std::distance(std::begin(std::get<index>(enumerable)), std::end(std::get<index>(enumerable)))...};
   }
 
-private:
-  std::variant<typename TSources::ResultIterator...> first_;
-  std::variant<typename TSources::ResultIterator...> last_;
-  size_t current_enumerable_ = 0;
+  std::tuple<typename TSources::ResultIterator...> first_;
+  std::tuple<typename TSources::ResultIterator...> last_;
+  size_t current_ = 0;
 
   bool is_dereferenceable_ = false;
 };
 
+// The common part of the query iterators visiting several enumerables (e.g. Concat). It has no virtual function, each derived iterator
+//   moves the visitor by itself, so that an increment is a direct call and the iterator holds no vtable pointer.
 template <template <bool, class...> class InternalVisitor, bool ArgConstness, class QueryTag, class TFn, class... TSources>
 class MultiVisitorSetIterator {
 public:
@@ -206,8 +181,6 @@ public:
   MultiVisitorSetIterator(const MultiVisitorSetIterator &) = default;
   MultiVisitorSetIterator(MultiVisitorSetIterator &&) = default;
 
-  virtual ~MultiVisitorSetIterator() = default;
-
   MultiVisitorSetIterator &operator=(const MultiVisitorSetIterator &) = default;
   MultiVisitorSetIterator &operator=(MultiVisitorSetIterator &&) = default;
 
@@ -222,12 +195,15 @@ public:
       lhs.visitor == rhs.visitor;
   }
 
+  // See SourceSentinel.
+  bool IsPastTheEnd() const {
+    return is_past_the_end_iteratorator_ || !visitor.IsValid();
+  }
+
 protected:
   MultiVisitorSetIterator(Enumerable *enumerable, bool is_past_the_end_iteratorator)
     : enumerable_(enumerable), is_past_the_end_iteratorator_(is_past_the_end_iteratorator) {}
 
-  virtual void FindNextValid() = 0;
-
   Enumerable *enumerable_ = nullptr;
 
   bool is_past_the_end_iteratorator_ = true;
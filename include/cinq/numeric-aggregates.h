@@ -0,0 +1,184 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <optional>
+#include <stdexcept>
+#include <type_traits>
+#include <utility>
+
+#include "detail/concept.h"
+#include "batch.h"
+#include "comparison-predicates.h"
+#include "enumerable.h"
+#include "simd-aggregate.h"
+
+namespace cinq::detail {
+// Passed as the last argument of Sum and Average, to sum floating point values pairwise (see PairwiseSum).
+struct PairwiseSummationTag {};
+
+// The function object of the aggregates without selector, e.g. Sum().
+struct IdentityFunction {
+  template <class T>
+  T &&operator()(T &&value) const {
+    return std::forward<T>(value);
+  }
+};
+
+// The result of Sum of values of TValue, float is summed in double and rounded back.
+template <class TValue>
+using sum_result_t = std::conditional_t<std::is_same_v<TValue, float>, float, simd::sum_type_t<TValue>>;
+
+// The values of TValue are converted to it to be summed by Average, integers are summed in 64 bits.
+template <class TValue>
+using average_sum_t = std::conditional_t<std::is_floating_point_v<TValue>, TValue,
+  std::conditional_t<std::is_signed_v<TValue>, std::int64_t, std::uint64_t>>;
+
+// The average of count values of TValue summed to sum. Throws std::runtime_error if count is 0.
+template <class TValue, class TSum>
+auto AverageOf(TSum sum, size_t count) {
+  using ResultType = std::conditional_t<std::is_floating_point_v<TValue>, TValue, double>;
+  using DivisionType = std::conditional_t<std::is_same_v<TValue, long double>, long double, double>;
+  if (count == 0)
+    throw std::runtime_error("Average of an empty sequence.");
+  return static_cast<ResultType>(static_cast<DivisionType>(sum) / static_cast<DivisionType>(count));
+}
+
+// Sums the sums of blocks (see ForEachValueBlock) in a balanced binary tree as they come, like a binary counter: partial_sums_[k] is
+//   the sum of 2^k blocks if the k-th bit of block_count_ is set. So the rounding error grows with the logarithm of the number of blocks,
+//   instead of linearly.
+template <class T>
+class PairwiseSum {
+public:
+  void Add(T sum) {
+    size_t level = 0;
+    for (; block_count_ >> level & 1; ++level)
+      sum = partial_sums_[level] + sum;
+    partial_sums_[level] = sum;
+    ++block_count_;
+  }
+
+  T Result() const {
+    T sum = T();
+    for (size_t level = 0; level < max_level; ++level) {
+      if (block_count_ >> level & 1)
+        sum = partial_sums_[level] + sum;
+    }
+    return sum;
+  }
+
+private:
+  static constexpr size_t max_level = 64;
+
+  T partial_sums_[max_level] = {};
+  std::uint64_t block_count_ = 0;
+};
+
+// Calls block_fn(values, size) with the values of the enumerable (i.e. fn applied to the elements) converted to TValue, in order,
+//   in blocks of at most batch_size values. size is never 0.
+// If the enumerable is batch evaluable, and its batches are dense or batch evaluation is preferred, it's evaluated in batches,
+//   and a dense batch of TValue is passed as it is when fn is IdentityFunction. Otherwise the values are copied into a buffer.
+template <class TValue, class TEnumerable, class Fn, class BlockFn>
+void ForEachValueBlock(TEnumerable &enumerable, Fn &fn, BlockFn &&block_fn) {
+  static_assert(std::is_arithmetic_v<TValue>);
+
+  std::array<TValue, batch_size> buffer;
+  size_t size = 0;
+  auto push = [&buffer, &size, &fn, &block_fn](auto &&e) {
+    buffer[size++] = static_cast<TValue>(std::invoke(fn, std::forward<decltype(e)>(e)));
+    if (size == batch_size) {
+      block_fn(static_cast<const TValue *>(buffer.data()), size);
+      size = 0;
+    }
+    return true;
+  };
+
+  if constexpr (is_batch_evaluable_v<TEnumerable> && (yields_dense_batches_v<TEnumerable> || prefers_batch_evaluation_v<TEnumerable>)) {
+    enumerable.ForEachBatch([&buffer, &size, &block_fn, &push](const auto &batch) {
+      using Element = std::remove_const_t<std::remove_pointer_t<decltype(batch.elements)>>;
+      if constexpr (std::is_same_v<Element, TValue> && std::is_same_v<std::decay_t<Fn>, IdentityFunction>) {
+        if (!batch.selection && batch.size != 0) {
+          if (size != 0) {
+            block_fn(static_cast<const TValue *>(buffer.data()), size);
+            size = 0;
+          }
+          block_fn(static_cast<const TValue *>(batch.elements), batch.size);
+          return true;
+        }
+      }
+      return batch.ForEach([&push](auto &element, std::uint32_t) { return push(element); });
+    });
+  } else {
+    enumerable.ForEach(push);
+  }
+
+  if (size != 0)
+    block_fn(static_cast<const TValue *>(buffer.data()), size);
+}
+
+// Returns the sum of the values of the enumerable converted to TValue, and the number of them.
+template <class TValue, bool pairwise, class TEnumerable, class Fn>
+std::pair<simd::sum_type_t<TValue>, size_t> SumValues(TEnumerable &enumerable, Fn &fn) {
+  using SumType = simd::sum_type_t<TValue>;
+  SumType sum = SumType();
+  PairwiseSum<SumType> pairwise_sum;
+  size_t count = 0;
+  ForEachValueBlock<TValue>(enumerable, fn, [&sum, &pairwise_sum, &count](const TValue *values, size_t size) {
+    count += size;
+    if constexpr (pairwise)
+      pairwise_sum.Add(simd::Reduce<simd::ReduceOp::Sum>(values, size));
+    else
+      sum += simd::Reduce<simd::ReduceOp::Sum>(values, size);
+  });
+  if constexpr (pairwise)
+    return {pairwise_sum.Result(), count};
+  else
+    return {sum, count};
+}
+
+// Returns the minimum or maximum of the values of the enumerable, or nullopt if there's no value.
+// Arithmetic values are reduced by the kernels, other values are compared with operator<.
+template <simd::ReduceOp op, class TValue, class TEnumerable, class Fn>
+std::optional<TValue> ReduceValues(TEnumerable &enumerable, Fn &fn) {
+  std::optional<TValue> result;
+  if constexpr (std::is_arithmetic_v<TValue>) {
+    ForEachValueBlock<TValue>(enumerable, fn, [&result](const TValue *values, size_t size) {
+      const TValue value = simd::Reduce<op>(values, size);
+      result = result ? simd::Combine<op>(*result, value) : value;
+    });
+  } else {
+    enumerable.ForEach([&result, &fn](auto &&e) {
+      decltype(auto) value = std::invoke(fn, std::forward<decltype(e)>(e));
+      if (result)
+        result = simd::Combine<op>(std::move(*result), value);
+      else
+        result.emplace(std::forward<decltype(value)>(value));
+      return true;
+    });
+  }
+  return result;
+}
+
+// Returns the number of elements of the enumerable satisfying p. A comparison predicate (e.g. cinq::Less) over arithmetic elements
+//   of type TValue is evaluated by the vectorized kernels, see simd::CountBatch.
+template <class TValue, class TEnumerable, class Pred>
+size_t CountValues(TEnumerable &enumerable, Pred &p) {
+  size_t count = 0;
+  if constexpr (is_vectorizable_predicate_v<std::decay_t<Pred>, TValue>) {
+    IdentityFunction identity;
+    ForEachValueBlock<TValue>(enumerable, identity, [&p, &count](const TValue *elements, size_t size) {
+      count += simd::CountBatch(p, elements, size);
+    });
+  } else {
+    enumerable.ForEach([&p, &count](auto &&e) {
+      static_assert(concept::PredicateCheck<Pred &, decltype(e)>(), "Bad predicate");
+      count += static_cast<bool>(std::invoke(p, std::forward<decltype(e)>(e)));
+      return true;
+    });
+  }
+  return count;
+}
+
+} // namespace cinq::detail
@@ -0,0 +1,376 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <functional>
+#include <mutex>
+#include <numeric>
+#include <optional>
+#include <stdexcept>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "detail/cinq-traits.h"
+#include "detail/concept.h"
+#include "enumerable.h"
+#include "numeric-aggregates.h"
+#include "thread-pool.h"
+
+namespace cinq::detail {
+// Returned by Cinq::AsParallel.
+// If the query is range splittable (see is_range_splittable), the source is split into ranges of indices, and each range is
+//   evaluated by the fused chain of queries on the thread pool, which balances the ranges by work stealing, as an element may
+//   take much more time than another (e.g. in SelectMany, or in Join with skewed keys). Otherwise, the query is evaluated sequentially.
+// The user provided function objects may be called concurrently, and must not rely on the order of calls.
+// By default, the result of ToVector is in an unspecified order. After AsOrdered, it's in the same order as the sequential result.
+// The aggregates evaluate each chunk of the source as Cinq does (e.g. by the vectorized kernels), and combine the partial results in
+//   the order of the chunks, whose boundaries are fixed, so that a floating point Sum is the same in every run. Aggregate is sequential,
+//   as its function can't combine two partial results.
+template <bool ConstVersion, class TEnumerable>
+class ParallelCinq {
+public:
+  ParallelCinq(Cinq<ConstVersion, TEnumerable> &&cinq, size_t thread_count, bool is_ordered = false)
+    : cinq_(std::move(cinq)), thread_count_(std::max<size_t>(thread_count, 1)), is_ordered_(is_ordered) {}
+
+  ParallelCinq(const ParallelCinq &) = delete;
+  ParallelCinq(ParallelCinq &&) = default;
+
+  ParallelCinq &operator=(const ParallelCinq &) = delete;
+  ParallelCinq &operator=(ParallelCinq &&) = delete;
+
+  template <class Fn>
+  auto Select(Fn fn) && {
+    return MakeParallelCinq(std::move(cinq_).Select(std::move(fn)), thread_count_, is_ordered_);
+  }
+
+  template <class Fn>
+  auto Where(Fn fn) && {
+    return MakeParallelCinq(std::move(cinq_).Where(std::move(fn)), thread_count_, is_ordered_);
+  }
+
+  template <class Fn>
+  auto SelectMany(Fn fn) && {
+    return MakeParallelCinq(std::move(cinq_).SelectMany(std::move(fn)), thread_count_, is_ordered_);
+  }
+
+  // Only the hash join is range splittable, the inner hash table is built sequentially, then probed in parallel.
+  template <class Inner, class... Args>
+  auto Join(Inner &&inner, Args... args) && {
+    return MakeParallelCinq(std::move(cinq_).Join(std::forward<Inner>(inner), std::move(args)...), thread_count_, is_ordered_);
+  }
+
+  auto AsSequential() && {
+    return std::move(cinq_);
+  }
+
+  auto AsOrdered() && {
+    is_ordered_ = true;
+    return std::move(*this);
+  }
+
+  auto AsUnordered() && {
+    is_ordered_ = false;
+    return std::move(*this);
+  }
+
+  template <class Pred>
+  bool All(Pred &&p) const {
+    if constexpr (!is_range_splittable_v<TEnumerable>) {
+      return cinq_.All(std::forward<Pred>(p));
+    } else {
+      auto ranges = cinq_.root_.MakeRanges();
+      std::atomic<bool> result = true;
+      ParallelForEachRange(ranges.Size(), [&ranges, &p, &result](size_t first, size_t last) {
+        if (!result.load(std::memory_order_relaxed))
+          return ;
+        ranges.ForEachInRange(first, last, [&p, &result](auto &&e) {
+          static_assert(concept::PredicateCheck<Pred &, decltype(e)>(), "Bad predicate");
+          if (!std::invoke(p, std::forward<decltype(e)>(e)))
+            result = false;
+          return result.load(std::memory_order_relaxed);
+        });
+      });
+      return result.load();
+    }
+  }
+
+  auto ToVector() {
+    if constexpr (!is_range_splittable_v<TEnumerable>) {
+      return cinq_.ToVector();
+    } else {
+      using value_type = std::decay_t<typename std::decay_t<decltype(std::begin(cinq_))>::value_type>;
+
+      auto ranges = cinq_.root_.MakeRanges();
+      if (is_ordered_)
+        return OrderedToVector<value_type>(ranges);
+
+      std::vector<std::vector<value_type>> partial_results;
+      std::mutex mutex;
+      ParallelForEachRange(ranges.Size(), [&ranges, &partial_results, &mutex](size_t first, size_t last) {
+        std::vector<value_type> partial_result;
+        ranges.ForEachInRange(first, last, [&partial_result](auto &&e) {
+          partial_result.emplace_back(std::forward<decltype(e)>(e));
+          return true;
+        });
+
+        std::lock_guard<std::mutex> lock(mutex);
+        partial_results.push_back(std::move(partial_result));
+      });
+
+      return Concatenate(partial_results);
+    }
+  }
+
+  template <class TAccumulate, class Fn>
+  TAccumulate Aggregate(TAccumulate seed, Fn &&fn) {
+    return cinq_.Aggregate(std::move(seed), std::forward<Fn>(fn));
+  }
+
+  size_t Count() {
+    if constexpr (!is_range_splittable_v<TEnumerable> ||
+                  cinq::utility::EnumerableTraits<TEnumerable>::size_class == cinq::utility::SizeClass::Exact) {
+      return cinq_.Count();
+    } else {
+      auto partials = ChunkPartials<size_t>(cinq_.root_.MakeRanges(), [](auto &chunk) {
+        size_t count = 0;
+        chunk.ForEach([&count](auto &&) { ++count; return true; });
+        return count;
+      });
+      return std::accumulate(partials.begin(), partials.end(), size_t(0));
+    }
+  }
+
+  template <class Pred>
+  size_t Count(Pred &&p) {
+    if constexpr (!is_range_splittable_v<TEnumerable>) {
+      return cinq_.Count(std::forward<Pred>(p));
+    } else {
+      auto partials = ChunkPartials<size_t>(cinq_.root_.MakeRanges(), [&p](auto &chunk) {
+        return CountValues<SelectedType<IdentityFunction>>(chunk, p);
+      });
+      return std::accumulate(partials.begin(), partials.end(), size_t(0));
+    }
+  }
+
+  // See Cinq::Sum.
+  auto Sum() {
+    return Sum(IdentityFunction{});
+  }
+
+  auto Sum(PairwiseSummationTag) {
+    return Sum(IdentityFunction{}, PairwiseSummationTag{});
+  }
+
+  template <class Fn>
+  auto Sum(Fn &&fn) {
+    if constexpr (!is_range_splittable_v<TEnumerable>)
+      return cinq_.Sum(fn);
+    else
+      return static_cast<sum_result_t<SelectedType<Fn>>>(ParallelSumValues<SelectedType<Fn>, false>(fn).first);
+  }
+
+  template <class Fn>
+  auto Sum(Fn &&fn, PairwiseSummationTag) {
+    if constexpr (!is_range_splittable_v<TEnumerable>)
+      return cinq_.Sum(fn, PairwiseSummationTag{});
+    else
+      return static_cast<sum_result_t<SelectedType<Fn>>>(ParallelSumValues<SelectedType<Fn>, true>(fn).first);
+  }
+
+  // Throws std::runtime_error if there's no element.
+  auto Average() {
+    return Average(IdentityFunction{});
+  }
+
+  auto Average(PairwiseSummationTag) {
+    return Average(IdentityFunction{}, PairwiseSummationTag{});
+  }
+
+  template <class Fn>
+  auto Average(Fn &&fn) {
+    if constexpr (!is_range_splittable_v<TEnumerable>) {
+      return cinq_.Average(fn);
+    } else {
+      auto [sum, count] = ParallelSumValues<average_sum_t<SelectedType<Fn>>, false>(fn);
+      return AverageOf<SelectedType<Fn>>(sum, count);
+    }
+  }
+
+  template <class Fn>
+  auto Average(Fn &&fn, PairwiseSummationTag) {
+    if constexpr (!is_range_splittable_v<TEnumerable>) {
+      return cinq_.Average(fn, PairwiseSummationTag{});
+    } else {
+      auto [sum, count] = ParallelSumValues<average_sum_t<SelectedType<Fn>>, true>(fn);
+      return AverageOf<SelectedType<Fn>>(sum, count);
+    }
+  }
+
+  // Throws std::runtime_error if there's no element. The result is NaN if any floating point value is NaN.
+  auto Min() {
+    return Min(IdentityFunction{});
+  }
+
+  template <class Fn>
+  auto Min(Fn &&fn) {
+    if constexpr (!is_range_splittable_v<TEnumerable>)
+      return cinq_.Min(fn);
+    else
+      return ParallelReduce<simd::ReduceOp::Min>(fn, "Min of an empty sequence.");
+  }
+
+  // Throws std::runtime_error if there's no element. The result is NaN if any floating point value is NaN.
+  auto Max() {
+    return Max(IdentityFunction{});
+  }
+
+  template <class Fn>
+  auto Max(Fn &&fn) {
+    if constexpr (!is_range_splittable_v<TEnumerable>)
+      return cinq_.Max(fn);
+    else
+      return ParallelReduce<simd::ReduceOp::Max>(fn, "Max of an empty sequence.");
+  }
+
+private:
+  // The elements of a chunk of SplittableRanges, enumerated as the ones of an Enumerable, see ChunkPartials.
+  template <class Ranges>
+  struct ChunkEnumerable {
+    template <class Sink>
+    bool ForEach(Sink &&sink) {
+      return ranges.ForEachInRange(first, last, sink);
+    }
+
+    const Ranges &ranges;
+    size_t first;
+    size_t last;
+  };
+
+  // The type of the values of fn applied to the elements.
+  template <class Fn>
+  using SelectedType = std::decay_t<decltype(std::invoke(std::declval<Fn &>(), *std::begin(std::declval<Cinq<ConstVersion, TEnumerable> &>())))>;
+
+  template <bool CV, class TE>
+  static ParallelCinq<CV, TE> MakeParallelCinq(Cinq<CV, TE> &&cinq, size_t thread_count, bool is_ordered) {
+    return ParallelCinq<CV, TE>(std::move(cinq), thread_count, is_ordered);
+  }
+
+  // Returns fn(chunk) of each chunk of the source (see ChunkEnumerable) in the order of the chunks. The source is split into chunks of
+  //   fixed boundaries, which are evaluated in parallel.
+  template <class Partial, class Ranges, class Fn>
+  std::vector<Partial> ChunkPartials(const Ranges &ranges, Fn &&fn) const {
+    auto size = ranges.Size();
+    auto chunk_count = std::min(size, thread_count_ * ranges_per_thread);
+    auto chunk_first = [size, chunk_count](size_t chunk) { return size * chunk / chunk_count; };
+
+    std::vector<Partial> partials(chunk_count);
+    ThreadPool::Instance().ParallelFor(chunk_count, 1, thread_count_, [&ranges, &fn, &partials, &chunk_first](size_t first, size_t last) {
+      for (auto chunk = first; chunk < last; ++chunk) {
+        ChunkEnumerable<Ranges> chunk_enumerable{ ranges, chunk_first(chunk), chunk_first(chunk + 1) };
+        partials[chunk] = fn(chunk_enumerable);
+      }
+    });
+    return partials;
+  }
+
+  // The sum and the number of the values of the chunks (see SumValues), their sums are added in order, or pairwise.
+  template <class TValue, bool pairwise, class Fn>
+  std::pair<simd::sum_type_t<TValue>, size_t> ParallelSumValues(Fn &fn) {
+    using SumType = simd::sum_type_t<TValue>;
+    auto partials = ChunkPartials<std::pair<SumType, size_t>>(cinq_.root_.MakeRanges(), [&fn](auto &chunk) {
+      return SumValues<TValue, pairwise>(chunk, fn);
+    });
+
+    SumType sum = SumType();
+    PairwiseSum<SumType> pairwise_sum;
+    size_t count = 0;
+    for (auto &partial : partials) {
+      count += partial.second;
+      if constexpr (pairwise)
+        pairwise_sum.Add(partial.first);
+      else
+        sum += partial.first;
+    }
+    if constexpr (pairwise)
+      return {pairwise_sum.Result(), count};
+    else
+      return {sum, count};
+  }
+
+  template <simd::ReduceOp op, class Fn>
+  auto ParallelReduce(Fn &fn, const char *empty_message) {
+    using ValueType = SelectedType<Fn>;
+    auto partials = ChunkPartials<std::optional<ValueType>>(cinq_.root_.MakeRanges(), [&fn](auto &chunk) {
+      return ReduceValues<op, ValueType>(chunk, fn);
+    });
+
+    std::optional<ValueType> result;
+    for (auto &partial : partials) {
+      if (partial)
+        result = result ? simd::Combine<op>(std::move(*result), *partial) : std::move(*partial);
+    }
+    if (!result)
+      throw std::runtime_error(empty_message);
+    return std::move(*result);
+  }
+
+  // The source is split into chunks of fixed boundaries, each of them is evaluated into its own buffer. Then the offset of each chunk in
+  //   the result is the exclusive prefix sum of the sizes of buffers, so the buffers are moved into place in parallel without sorting.
+  template <class ValueType, class Ranges>
+  std::vector<ValueType> OrderedToVector(const Ranges &ranges) {
+    auto chunks = ChunkPartials<std::vector<ValueType>>(ranges, [](auto &chunk) {
+      std::vector<ValueType> buffer;
+      chunk.ForEach([&buffer](auto &&e) {
+        buffer.emplace_back(std::forward<decltype(e)>(e));
+        return true;
+      });
+      return buffer;
+    });
+    auto chunk_count = chunks.size();
+
+    if constexpr (!std::is_default_constructible_v<ValueType> || !std::is_nothrow_move_assignable_v<ValueType>) {
+      return Concatenate(chunks);
+    } else {
+      std::vector<size_t> offsets(chunk_count + 1, 0);
+      for (size_t chunk = 0; chunk < chunk_count; ++chunk)
+        offsets[chunk + 1] = offsets[chunk] + chunks[chunk].size();
+
+      std::vector<ValueType> vtr(offsets.back());
+      ThreadPool::Instance().ParallelFor(chunk_count, 1, thread_count_, [&vtr, &chunks, &offsets](size_t first, size_t last) {
+        for (auto chunk = first; chunk < last; ++chunk)
+          std::move(chunks[chunk].begin(), chunks[chunk].end(), vtr.begin() + offsets[chunk]);
+      });
+      return vtr;
+    }
+  }
+
+  template <class ValueType>
+  static std::vector<ValueType> Concatenate(std::vector<std::vector<ValueType>> &partial_results) {
+    size_t size = 0;
+    for (auto &partial_result : partial_results)
+      size += partial_result.size();
+
+    std::vector<ValueType> vtr;
+    vtr.reserve(size);
+    for (auto &partial_result : partial_results)
+      vtr.insert(vtr.end(), std::make_move_iterator(partial_result.begin()), std::make_move_iterator(partial_result.end()));
+    return vtr;
+  }
+
+  // Calls fn(first, last) for the ranges which cover [0, size).
+  // The smallest range is of 1/ranges_per_thread of the share of a thread, which leaves the other threads enough ranges to steal.
+  template <class Fn>
+  void ParallelForEachRange(size_t size, Fn &&fn) const {
+    ThreadPool::Instance().ParallelFor(size, size / (thread_count_ * ranges_per_thread), thread_count_, std::forward<Fn>(fn));
+  }
+
+  static constexpr size_t ranges_per_thread = 16;
+
+  Cinq<ConstVersion, TEnumerable> cinq_;
+  size_t thread_count_;
+  bool is_ordered_;
+};
+
+} // namespace cinq::detail
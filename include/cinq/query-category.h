@@ -10,6 +10,20 @@ struct QueryCategory {
   struct Union {};
   struct Concat {};
   struct Distinct  {};
+  struct Batched {};
+  struct Except {};
+  // The queries over sources sorted in the order of a comparator, see Cinq::AssumeSorted.
+  struct AssumeSorted {};
+  struct SortedDistinct {};
+  struct SortedIntersect {};
+  struct SortedUnion {};
+  struct SortedExcept {};
+  // The set operations over integers, see Cinq::WithDomain.
+  struct WithDomain {};
+  struct DomainSetOperation {};
+  // The elements sorted by their keys, see Cinq::OrderBy.
+  struct OrderBy {};
+  struct Take {};
 };
 
 } // namespace cinq::detail
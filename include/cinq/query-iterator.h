@@ -2,11 +2,22 @@
 
 #include <iostream> // development build only
 
+#include "querys-iterator/assume-sorted.h"
+#include "querys-iterator/batched.h"
 #include "querys-iterator/concat.h"
 #include "querys-iterator/distinct.h"
+#include "querys-iterator/domain-set-operation.h"
+#include "querys-iterator/except.h"
 #include "querys-iterator/intersect.h"
 #include "querys-iterator/join.h"
+#include "querys-iterator/order-by.h"
 #include "querys-iterator/select-many.h"
 #include "querys-iterator/select.h"
+#include "querys-iterator/sorted-distinct.h"
+#include "querys-iterator/sorted-except.h"
+#include "querys-iterator/sorted-intersect.h"
+#include "querys-iterator/sorted-union.h"
+#include "querys-iterator/take.h"
 #include "querys-iterator/union.h"
 #include "querys-iterator/where.h"
+#include "querys-iterator/with-domain.h"
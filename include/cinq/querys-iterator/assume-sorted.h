@@ -0,0 +1,106 @@
+#pragma once
+
+#include <cstddef>
+#include <iterator>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+
+#include "../query-category.h"
+#include "detail/utility.h"
+#include "query-iterator-fwd.h"
+#include "../size-hint.h"
+#include "../source-sentinel.h"
+
+namespace cinq::detail {
+// Yields the elements of its source unchanged, which the caller promises to be sorted in the order of the comparator TFn. The following
+//   Distinct, Intersect and Union merge their sources instead of hashing them, see SortedDistinct, SortedIntersect and SortedUnion.
+template <bool ArgConstness, bool RetConstness, class TFn, class TSource>
+class QueryIterator<ArgConstness, RetConstness, BasicEnumerable<QueryCategory::AssumeSorted, std::tuple<TFn>, TSource>> {
+public:
+  using Enumerable = BasicEnumerable<QueryCategory::AssumeSorted, std::tuple<TFn>, TSource>;
+
+  using SourceIterator = typename Enumerable::template SourceIterator<0>;
+  using SourceIteratorYieldType = decltype(*std::declval<SourceIterator>());
+
+  using ResultType = cinq::utility::transform_to_result_type_t<RetConstness, SourceIteratorYieldType, cinq::utility::SourceType::Iterator>;
+  using value_type = std::decay_t<ResultType>;
+
+  // The iterator is as strong as the one of the source, so that the merges can gallop over a random access source.
+  using iterator_category = cinq::utility::iterator_category_t<SourceIterator>;
+  using difference_type = std::ptrdiff_t;
+
+  QueryIterator() {}
+
+  QueryIterator(Enumerable *enumerable, bool is_past_the_end_iteratorator)
+    : iterator_(is_past_the_end_iteratorator ? std::end(enumerable->SourceFront()) : std::begin(enumerable->SourceFront())) {}
+
+  QueryIterator(const QueryIterator &) = default;
+  QueryIterator(QueryIterator &&) = default;
+
+  QueryIterator &operator=(const QueryIterator &) = default;
+  QueryIterator &operator=(QueryIterator &&) = default;
+
+  ResultType operator*() const {
+    return *iterator_;
+  }
+
+  friend bool operator!=(const QueryIterator &lhs, const QueryIterator &rhs) {
+    return lhs.iterator_ != rhs.iterator_;
+  }
+
+  friend bool operator==(const QueryIterator &lhs, const QueryIterator &rhs) {
+    return lhs.iterator_ == rhs.iterator_;
+  }
+
+  QueryIterator &operator++() {
+    ++iterator_;
+    return *this;
+  }
+
+  QueryIterator operator++(int) {
+    QueryIterator previous(*this);
+    ++iterator_;
+    return previous;
+  }
+
+  // See SourceSentinel, only available if the iterator of the source tells whether it's past the end.
+  template <class T = SourceIterator, class = std::enable_if_t<has_past_the_end_check<T>::value>>
+  bool IsPastTheEnd() const {
+    return iterator_.IsPastTheEnd();
+  }
+
+  // The size is the one of the source.
+  static SizeHint GetSizeHint(Enumerable *enumerable) {
+    return SourceSizeHint(enumerable->SourceFront());
+  }
+
+  // Only available when the source iterator is bidirectional.
+  QueryIterator &operator--() {
+    --iterator_;
+    return *this;
+  }
+
+  // Only available when the source iterator is random access.
+  QueryIterator &operator+=(difference_type n) {
+    iterator_ += n;
+    return *this;
+  }
+
+  friend difference_type operator-(const QueryIterator &lhs, const QueryIterator &rhs) {
+    return lhs.iterator_ - rhs.iterator_;
+  }
+
+  // See Enumerable::ForEach.
+  template <class Sink>
+  static bool ForEach(Enumerable *enumerable, Sink &sink) {
+    return SourceForEach(enumerable->SourceFront(), [&sink](auto &&element) {
+      return sink(static_cast<ResultType>(std::forward<decltype(element)>(element)));
+    });
+  }
+
+private:
+  SourceIterator iterator_;
+};
+
+} // namespace cinq::detail
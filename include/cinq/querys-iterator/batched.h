@@ -0,0 +1,84 @@
+#pragma once
+
+#include <iterator>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+
+#include "../query-category.h"
+#include "detail/utility.h"
+#include "query-iterator-fwd.h"
+#include "../batch.h"
+#include "../size-hint.h"
+
+namespace cinq::detail {
+// Yields the elements of its source unchanged, and makes the query it belongs to evaluated in batches (see is_batch_evaluable).
+template <bool ArgConstness, bool RetConstness, class TFn, class TSource>
+class QueryIterator<ArgConstness, RetConstness, BasicEnumerable<QueryCategory::Batched, std::tuple<TFn>, TSource>> {
+public:
+  using Enumerable = BasicEnumerable<QueryCategory::Batched, std::tuple<TFn>, TSource>;
+
+  using SourceIterator = typename Enumerable::template SourceIterator<0>;
+  using SourceIteratorYieldType = decltype(*std::declval<SourceIterator>());
+
+  using ResultType = cinq::utility::transform_to_result_type_t<RetConstness, SourceIteratorYieldType, cinq::utility::SourceType::Iterator>;
+  using value_type = std::decay_t<ResultType>;
+
+  QueryIterator() {}
+
+  QueryIterator(Enumerable *enumerable, bool is_past_the_end_iteratorator)
+    : iterator_(is_past_the_end_iteratorator ? std::end(enumerable->SourceFront()) : std::begin(enumerable->SourceFront())) {}
+
+  QueryIterator(const QueryIterator &) = default;
+  QueryIterator(QueryIterator &&) = default;
+
+  QueryIterator &operator=(const QueryIterator &) = default;
+  QueryIterator &operator=(QueryIterator &&) = default;
+
+  ResultType operator*() const {
+    return *iterator_;
+  }
+
+  friend bool operator!=(const QueryIterator &lhs, const QueryIterator &rhs) {
+    return lhs.iterator_ != rhs.iterator_;
+  }
+
+  friend bool operator==(const QueryIterator &lhs, const QueryIterator &rhs) {
+    return lhs.iterator_ == rhs.iterator_;
+  }
+
+  QueryIterator &operator++() {
+    ++iterator_;
+    return *this;
+  }
+
+  QueryIterator operator++(int) {
+    QueryIterator previous(*this);
+    ++iterator_;
+    return previous;
+  }
+
+  // The size is the one of the source.
+  static SizeHint GetSizeHint(Enumerable *enumerable) {
+    return SourceSizeHint(enumerable->SourceFront());
+  }
+
+  // See Enumerable::ForEach, only used when the source isn't batch evaluable.
+  template <class Sink>
+  static bool ForEach(Enumerable *enumerable, Sink &sink) {
+    return SourceForEach(enumerable->SourceFront(), [&sink](auto &&element) {
+      return sink(static_cast<ResultType>(std::forward<decltype(element)>(element)));
+    });
+  }
+
+  // See is_batch_evaluable.
+  template <class BatchSink>
+  static bool ForEachBatch(Enumerable *enumerable, BatchSink &batch_sink) {
+    return SourceForEachBatch(enumerable->SourceFront(), batch_sink);
+  }
+
+private:
+  SourceIterator iterator_;
+};
+
+} // namespace cinq::detail
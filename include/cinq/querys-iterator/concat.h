@@ -1,5 +1,6 @@
 #pragma once
 
+#include <cstddef>
 #include <iterator>
 #include <tuple>
 #include <type_traits>
@@ -10,6 +11,7 @@
 #include "detail/concept.h"
 #include "detail/utility.h"
 #include "query-iterator-fwd.h"
+#include "../size-hint.h"
 
 namespace cinq::detail {
 template <bool ArgConstness, bool RetConstness, class TFn, class... TSources>
@@ -23,6 +25,11 @@ public:
   using ResultType = cinq::utility::transform_to_result_type_t<RetConstness, CommonType, cinq::utility::SourceType::Iterator>;
   using value_type = typename std::decay_t<ResultType>;
 
+  // The iterator is as strong as the weakest one of the sources, e.g. a Concat of std::list is bidirectional. A random access one is
+  //   moved with the sizes of the sources.
+  using iterator_category = std::common_type_t<cinq::utility::iterator_category_t<typename TSources::ResultIterator>...>;
+  using difference_type = std::ptrdiff_t;
+
   QueryIterator() {}
 
   QueryIterator(typename Base::Enumerable *enumerable, bool is_past_the_end_iteratorator)
@@ -48,8 +55,43 @@ public:
     return previous;
   }
 
+  // The size is the sum of the ones of the sources.
+  static SizeHint GetSizeHint(typename Base::Enumerable *enumerable) {
+    return std::apply([](auto &... sources) { return (SourceSizeHint(sources) + ...); }, enumerable->GetSourceTuple());
+  }
+
+  // See Enumerable::ForEach. The sources push their elements in turn, so each one runs its own loop.
+  template <class Sink>
+  static bool ForEach(typename Base::Enumerable *enumerable, Sink &sink) {
+    return std::apply([&sink](auto &... sources) {
+        return (SourceForEach(sources, [&sink](auto &&x) { return sink(static_cast<ResultType>(std::forward<decltype(x)>(x))); }) && ...);
+      }, enumerable->GetSourceTuple());
+  }
+
+  // Only available when the iterator is bidirectional.
+  QueryIterator &operator--() {
+    Base::visitor.MoveToPrevious(Base::enumerable_->GetSourceTuple());
+    Base::is_past_the_end_iteratorator_ = false;
+    return *this;
+  }
+
+  // Only available when the iterator is random access.
+  QueryIterator &operator+=(difference_type n) {
+    Base::visitor.MoveTo(Base::enumerable_->GetSourceTuple(), Position() + n);
+    Base::is_past_the_end_iteratorator_ = false;
+    return *this;
+  }
+
+  friend difference_type operator-(const QueryIterator &lhs, const QueryIterator &rhs) {
+    return lhs.Position() - rhs.Position();
+  }
+
 protected:
-  void FindNextValid() override {
+  difference_type Position() const {
+    return Base::visitor.Position(Base::enumerable_->GetSourceTuple());
+  }
+
+  void FindNextValid() {
     Base::visitor.MoveToNext(Base::enumerable_->GetSourceTuple());
   }
 };
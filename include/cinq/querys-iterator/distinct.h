@@ -1,35 +1,42 @@
 #pragma once
 
 #include <iterator>
-#include <set>
 #include <tuple>
 #include <type_traits>
-#include <unordered_set>
 #include <utility>
 
+#include "../flat-hash-table.h"
 #include "../query-category.h"
+#include "../shared-storage.h"
 #include "detail/concept.h"
 #include "detail/utility.h"
 #include "query-iterator-fwd.h"
+#include "../size-hint.h"
+#include "../source-sentinel.h"
 
 namespace cinq::detail {
 template <bool ArgConstness, bool RetConstness, class TFn, class TSource>
-class QueryIterator<ArgConstness, RetConstness, BasicEnumerable<QueryCategory::Distinct, std::tuple<TFn>, TSource>> {
+class QueryIterator<ArgConstness, RetConstness, BasicEnumerable<QueryCategory::Distinct, std::tuple<TFn>, TSource>>
+  : private SourceSentinel<typename BasicEnumerable<QueryCategory::Distinct, std::tuple<TFn>, TSource>::template SourceIterator<0>> {
 public:
   using Enumerable = BasicEnumerable<QueryCategory::Distinct, std::tuple<TFn>, TSource>;
 
   using SourceIterator = typename Enumerable::template SourceIterator<0>;
   using SourceIteratorYieldType = decltype(*std::declval<SourceIterator>());
+  using Sentinel = SourceSentinel<SourceIterator>;
 
   using FunctionObjectArgumentType = cinq::utility::transform_to_function_object_argument_t<ArgConstness, SourceIteratorYieldType>;
 
   using ResultType = cinq::utility::transform_to_result_type_t<RetConstness, SourceIteratorYieldType, cinq::utility::SourceType::InternalStorage>;
   using value_type = std::decay_t<ResultType>;
 
-  QueryIterator() : first_(), last_() {}
+  // Whether the internal storage aliases the elements of the source, otherwise it copies them. See yields_stable_references.
+  static constexpr bool is_aliasing = std::is_reference_v<SourceIteratorYieldType> && yields_stable_references<TSource>::value;
+
+  QueryIterator() : first_() {}
 
   QueryIterator(Enumerable *enumerable, bool is_past_the_end_iteratorator)
-    : enumerable_(enumerable), is_past_the_end_iteratorator_(is_past_the_end_iteratorator) {
+    : Sentinel(std::end(enumerable->SourceFront())), enumerable_(enumerable), is_past_the_end_iteratorator_(is_past_the_end_iteratorator) {
     if (!is_past_the_end_iteratorator)
       FindNextValideElement();
   }
@@ -60,14 +67,27 @@ public:
 
   QueryIterator operator++(int) {
     QueryIterator previous(*this);
-    ++first_;
-    FindNextValideElement();
+    ++*this;
     return previous;
   }
 
+  // See SourceSentinel.
+  bool IsPastTheEnd() const {
+    return first_ == SourceEnd();
+  }
+
+  // The size is bounded by the one of the source.
+  static SizeHint GetSizeHint(Enumerable *enumerable) {
+    return SourceSizeHint(enumerable->SourceFront()).UpperBound();
+  }
+
 private:
+  const Sentinel &SourceEnd() const {
+    return *this;
+  }
+
   void FindNextValideElement() {
-    while (first_ != last_ && !distinct_helper_(*first_)) // what if *first return a temporary
+    while (first_ != SourceEnd() && !distinct_helper_(*first_)) // what if *first return a temporary
       ++first_;
   }
 
@@ -77,67 +97,23 @@ private:
 
   class DistinctHelper {
   public:
-    DistinctHelper() = default;
-
-    DistinctHelper(const DistinctHelper &rhs)
-      : distinct_set_(rhs.distinct_set_), current_ (rhs.current_ == rhs.distinct_set_.end() ? distinct_set_.end() : distinct_set_.find(*rhs.current_)) {}
-    DistinctHelper(DistinctHelper &&rhs) {
-      if (rhs.current_ == rhs.distinct_set_.end()) {
-        distinct_set_ = std::move(rhs.distinct_set_);
-        current_ = distinct_set_.end();
-      } else {
-        auto node = rhs.distinct_set_.extract(rhs.current_);
-        distinct_set_ = std::move(rhs.distinct_set_);
-        current_ = distinct_set_.insert(std::move(node)).position;
-      }
-    }
-
-    DistinctHelper &operator=(const DistinctHelper &rhs) {
-      distinct_set_ = rhs.distinct_set_;
-      if (rhs.current_ == rhs.distinct_set_.end())
-        current_ = distinct_set_.end();
-      else
-        current_ = distinct_set_.find(*rhs.current_);
-      return *this;
-    }
-
-    DistinctHelper &operator=(DistinctHelper &&rhs) {
-      if (rhs.current_ == rhs.distinct_set_.end()) {
-        distinct_set_ = std::move(rhs.distinct_set_);
-        current_ = distinct_set_.end();
-      } else {
-        auto node = rhs.distinct_set_.extract(rhs.current_);
-        distinct_set_ = std::move(rhs.distinct_set_);
-        current_ = distinct_set_.insert(std::move(node)).position;
-      }
-      return *this;
-    }
-
     bool operator()(const value_type &t) const {
-      auto ret = distinct_set_.insert(t);
-      current_ = ret.first;
+      auto ret = distinct_set_.Mutable().insert(t);
+      distinct_set_.SetCurrent(ret.first);
       return ret.second;
     };
 
     const auto &Get() const {
-      return *current_;
+      return *distinct_set_;
     }
 
   private:
-    using InternalStorageType = std::conditional_t<std::is_reference_v<SourceIteratorYieldType>,
-      cinq::utility::ReferenceWrapper<value_type>, value_type>;
-
-    using SetType = std::conditional_t<cinq::utility::ReferenceWrapper<value_type>::hash_version,
-      std::unordered_set<InternalStorageType>,std::set<InternalStorageType>>;
-
-    mutable SetType distinct_set_;
-    mutable typename SetType::iterator current_ = distinct_set_.end();
+    mutable SharedStorage<SetOperationSet<value_type, is_aliasing>> distinct_set_;
   } distinct_helper_;
 
   static_assert(concept::PredicateCheck<DistinctHelper, FunctionObjectArgumentType>(), "(Internal error) Bad predicate");
 
   SourceIterator first_ = is_past_the_end_iteratorator_ ? std::end(enumerable_->SourceFront()) : std::begin(enumerable_->SourceFront());
-  SourceIterator last_ = std::end(enumerable_->SourceFront());
 };
 
 } // namespace cinq::detail
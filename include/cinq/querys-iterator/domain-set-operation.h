@@ -0,0 +1,227 @@
+#pragma once
+
+#include <iterator>
+#include <memory>
+#include <optional>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+
+#include "../domain-set.h"
+#include "../shared-storage.h"
+#include "../query-category.h"
+#include "../size-hint.h"
+#include "../source-sentinel.h"
+#include "detail/utility.h"
+#include "query-iterator-fwd.h"
+
+namespace cinq::detail {
+// The set operations over integers (see DomainSetMode), which keep them in a DomainSet: a bitset of their domain if it's declared (see
+//   Cinq::WithDomain) or found by a pre-pass over the first source, and the bitset is dense for the size of the first source (see
+//   DomainSet::IsDense), otherwise a hash table.
+// The first source is filtered in its order, and its elements are yielded as they are, so that they alias the ones of the source. The
+//   other sources are inserted into a read only set when an iterator is constructed, which its copies share: for Intersect, the
+//   elements of each one are intersected (a word at a time for the bitsets), and the first source isn't enumerated at all once no
+//   element is left. For Except, the elements of all of them are inserted.
+// The elements already yielded are kept in another set, shared by the copies of an iterator and copied on write as SharedStorage does.
+template <bool ArgConstness, bool RetConstness, class T, DomainSetMode mode, class TSource, class... TProbes>
+class QueryIterator<ArgConstness, RetConstness, BasicEnumerable<QueryCategory::DomainSetOperation, std::tuple<DomainSetSpec<T, mode>>, TSource, TProbes...>>
+  : private SourceSentinel<typename BasicEnumerable<QueryCategory::DomainSetOperation, std::tuple<DomainSetSpec<T, mode>>, TSource, TProbes...>::template SourceIterator<0>> {
+public:
+  using Enumerable = BasicEnumerable<QueryCategory::DomainSetOperation, std::tuple<DomainSetSpec<T, mode>>, TSource, TProbes...>;
+
+  using SourceIterator = typename Enumerable::template SourceIterator<0>;
+  using SourceIteratorYieldType = decltype(*std::declval<SourceIterator>());
+  using Sentinel = SourceSentinel<SourceIterator>;
+
+  // The elements are const, as the ones kept by Distinct are.
+  using ResultType = std::conditional_t<std::is_reference_v<SourceIteratorYieldType>,
+    cinq::utility::transform_to_result_type_t<RetConstness, SourceIteratorYieldType, cinq::utility::SourceType::InternalStorage>,
+    T>;
+  using value_type = T;
+
+  static_assert(std::is_same_v<std::decay_t<SourceIteratorYieldType>, T>, "(Internal error) Bad element type");
+
+  QueryIterator() {}
+
+  QueryIterator(Enumerable *enumerable, bool is_past_the_end_iteratorator)
+    : Sentinel(std::end(enumerable->SourceFront())),
+      probes_(is_past_the_end_iteratorator ? nullptr : BuildProbes(enumerable)),
+      first_(!probes_ || probes_->is_empty_result ? std::end(enumerable->SourceFront()) : std::begin(enumerable->SourceFront())) {
+    if (!is_past_the_end_iteratorator) {
+      seen_ = std::make_shared<DomainSet<T>>(probes_->domain);
+      FindNextValid();
+    }
+  }
+
+  QueryIterator(const QueryIterator &) = default;
+  QueryIterator(QueryIterator &&) = default;
+
+  QueryIterator &operator=(const QueryIterator &) = default;
+  QueryIterator &operator=(QueryIterator &&) = default;
+
+  ResultType operator*() const {
+    return *first_;
+  }
+
+  friend bool operator!=(const QueryIterator &lhs, const QueryIterator &rhs) {
+    return lhs.first_ != rhs.first_;
+  }
+
+  friend bool operator==(const QueryIterator &lhs, const QueryIterator &rhs) {
+    return lhs.first_ == rhs.first_;
+  }
+
+  QueryIterator &operator++() {
+    ++first_;
+    FindNextValid();
+    return *this;
+  }
+
+  QueryIterator operator++(int) {
+    QueryIterator previous(*this);
+    ++*this;
+    return previous;
+  }
+
+  // See SourceSentinel.
+  bool IsPastTheEnd() const {
+    return first_ == SourceEnd();
+  }
+
+  // The size is bounded by the one of the first source, and by the ones of the others for Intersect.
+  static SizeHint GetSizeHint(Enumerable *enumerable) {
+    return std::apply([](auto &source, auto &... probes) {
+        SizeHint hint = SourceSizeHint(source).UpperBound();
+        if constexpr (mode == DomainSetMode::Intersect)
+          ((hint = Min(hint, SourceSizeHint(probes))), ...);
+        return hint;
+      }, enumerable->GetSourceTuple());
+  }
+
+  // See Enumerable::ForEach.
+  template <class Sink>
+  static bool ForEach(Enumerable *enumerable, Sink &sink) {
+    auto probes = BuildProbes(enumerable);
+    if (probes->is_empty_result)
+      return true;
+
+    DomainSet<T> seen(probes->domain);
+    return SourceForEach(enumerable->SourceFront(), [&probes, &seen, &sink](auto &&element) {
+      if (!probes->IsKept(element) || !probes->Insert(seen, element))
+        return true;
+      return sink(static_cast<ResultType>(std::forward<decltype(element)>(element)));
+    });
+  }
+
+private:
+  // The domain of the sets, and the set of the other sources.
+  struct Probes {
+    std::optional<Domain<T>> domain;
+    std::optional<Domain<T>> declared;
+    DomainSet<T> set;
+    bool is_empty_result = false;
+
+    bool IsKept(T value) const {
+      if constexpr (mode == DomainSetMode::Intersect)
+        return set.Contains(value);
+      else if constexpr (mode == DomainSetMode::Except)
+        return !set.Contains(value);
+      else
+        return true;
+    }
+
+    // A declared domain is checked here if the elements are hashed, as the bitset does.
+    bool Insert(DomainSet<T> &seen, T value) const {
+      if (declared && !domain)
+        cinq::utility::CinqAssert(declared->Contains(value));
+      return seen.Insert(value);
+    }
+  };
+
+  // The declared domain, otherwise the range of the first source, if a bitset of it is dense, see DomainSet::IsDense. The size hint of
+  //   the first source is used for a declared domain, which is hashed if the size is unknown.
+  static std::optional<Domain<T>> FindDomain(Enumerable *enumerable) {
+    const auto &declared = enumerable->FirstFn().domain;
+    if (declared) {
+      const SizeHint hint = SourceSizeHint(enumerable->SourceFront());
+      if (hint.IsKnown() && DomainSet<T>::IsDense(*declared, hint.size))
+        return declared;
+      return std::nullopt;
+    }
+
+    std::optional<Domain<T>> range;
+    size_t size = 0;
+    SourceForEach(enumerable->SourceFront(), [&range, &size](T value) {
+      range = range ? Hull(*range, Domain<T>{ value, value }) : Domain<T>{ value, value };
+      ++size;
+      return true;
+    });
+    if (range && DomainSet<T>::IsDense(*range, size))
+      return range;
+    return std::nullopt;
+  }
+
+  static std::shared_ptr<const Probes> BuildProbes(Enumerable *enumerable) {
+    auto probes = std::make_shared<Probes>(Probes{ FindDomain(enumerable), enumerable->FirstFn().domain, DomainSet<T>(), false });
+    probes->set = DomainSet<T>(probes->domain);
+
+    std::apply([&probes](auto &, auto &... sources) {
+        if constexpr (mode == DomainSetMode::Intersect) {
+          bool is_first = true;
+          auto intersect = [&probes, &is_first](auto &source) {
+            if (probes->is_empty_result)
+              return;
+
+            // The elements of the first probed source outside the domain can't be in the first source, the following ones are
+            //   intersected with the candidates left.
+            DomainSet<T> set(probes->domain);
+            const DomainSet<T> &candidates = probes->set;
+            SourceForEach(source, [&set, &candidates, is_first](T value) {
+              if (set.IsBitset() ? set.Accepts(value) : is_first || candidates.Contains(value))
+                set.Insert(value);
+              return true;
+            });
+            if (set.IsBitset() && !is_first)
+              set.IntersectWith(probes->set);
+            probes->set = std::move(set);
+            probes->is_empty_result = probes->set.Empty();
+            is_first = false;
+          };
+          (intersect(sources), ...);
+        } else if constexpr (mode == DomainSetMode::Except) {
+          auto insert = [&probes](T value) {
+            if (probes->set.Accepts(value))
+              probes->set.Insert(value);
+            return true;
+          };
+          (SourceForEach(sources, insert), ...);
+        }
+      }, enumerable->GetSourceTuple());
+    return probes;
+  }
+
+  const Sentinel &SourceEnd() const {
+    return *this;
+  }
+
+  // The set is only copied once an element is found to be inserted.
+  void FindNextValid() {
+    for (; first_ != SourceEnd(); ++first_) {
+      T value = *first_;
+      if (probes_->IsKept(value) && !seen_->Contains(value)) {
+        if (!IsUniqueOwner(seen_))
+          seen_ = std::make_shared<DomainSet<T>>(*seen_);
+        probes_->Insert(*seen_, value);
+        break;
+      }
+    }
+  }
+
+  std::shared_ptr<const Probes> probes_;
+  SourceIterator first_;
+
+  std::shared_ptr<DomainSet<T>> seen_;
+};
+
+} // namespace cinq::detail
@@ -0,0 +1,133 @@
+#pragma once
+
+#include <iterator>
+#include <memory>
+#include <set>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+
+#include "../flat-hash-table.h"
+#include "../query-category.h"
+#include "../size-hint.h"
+#include "../source-sentinel.h"
+#include "detail/utility.h"
+#include "query-iterator-fwd.h"
+
+namespace cinq::detail {
+// Yields the elements of the first source (made distinct by Cinq::Except) which aren't in any of the excluded sources.
+// The excluded elements are inserted into a set when an iterator is constructed, which is then only read, so that the copies of an
+//   iterator share it.
+template <bool ArgConstness, bool RetConstness, class TFn, class TSource, class... TExcluded>
+class QueryIterator<ArgConstness, RetConstness, BasicEnumerable<QueryCategory::Except, std::tuple<TFn>, TSource, TExcluded...>>
+  : private SourceSentinel<typename BasicEnumerable<QueryCategory::Except, std::tuple<TFn>, TSource, TExcluded...>::template SourceIterator<0>> {
+public:
+  using Enumerable = BasicEnumerable<QueryCategory::Except, std::tuple<TFn>, TSource, TExcluded...>;
+
+  using SourceIterator = typename Enumerable::template SourceIterator<0>;
+  using SourceIteratorYieldType = decltype(*std::declval<SourceIterator>());
+  using Sentinel = SourceSentinel<SourceIterator>;
+
+  using ResultType = cinq::utility::transform_to_result_type_t<RetConstness, SourceIteratorYieldType, cinq::utility::SourceType::Iterator>;
+  using value_type = std::decay_t<ResultType>;
+
+  // Whether the set aliases the excluded elements, otherwise it copies them. See yields_stable_references.
+  static constexpr bool is_aliasing = (cinq::utility::is_all_reference_to_same_v<SourceIteratorYieldType,
+    decltype(*std::declval<typename TExcluded::ResultIterator>())> && ...) && (yields_stable_references<TExcluded>::value && ...);
+
+  QueryIterator() {}
+
+  QueryIterator(Enumerable *enumerable, bool is_past_the_end_iteratorator)
+    : Sentinel(std::end(enumerable->SourceFront())),
+      first_(is_past_the_end_iteratorator ? std::end(enumerable->SourceFront()) : std::begin(enumerable->SourceFront())) {
+    if (!is_past_the_end_iteratorator) {
+      excluded_ = BuildExcluded(enumerable);
+      FindNextValid();
+    }
+  }
+
+  QueryIterator(const QueryIterator &) = default;
+  QueryIterator(QueryIterator &&) = default;
+
+  QueryIterator &operator=(const QueryIterator &) = default;
+  QueryIterator &operator=(QueryIterator &&) = default;
+
+  ResultType operator*() const {
+    return *first_;
+  }
+
+  friend bool operator!=(const QueryIterator &lhs, const QueryIterator &rhs) {
+    return lhs.first_ != rhs.first_;
+  }
+
+  friend bool operator==(const QueryIterator &lhs, const QueryIterator &rhs) {
+    return lhs.first_ == rhs.first_;
+  }
+
+  QueryIterator &operator++() {
+    ++first_;
+    FindNextValid();
+    return *this;
+  }
+
+  QueryIterator operator++(int) {
+    QueryIterator previous(*this);
+    ++*this;
+    return previous;
+  }
+
+  // See SourceSentinel.
+  bool IsPastTheEnd() const {
+    return first_ == SourceEnd();
+  }
+
+  // The size is bounded by the one of the first source.
+  static SizeHint GetSizeHint(Enumerable *enumerable) {
+    return SourceSizeHint(enumerable->SourceFront()).UpperBound();
+  }
+
+  // See Enumerable::ForEach.
+  template <class Sink>
+  static bool ForEach(Enumerable *enumerable, Sink &sink) {
+    auto excluded = BuildExcluded(enumerable);
+    return SourceForEach(enumerable->SourceFront(), [&excluded, &sink](auto &&element) {
+      if (excluded->find(element) != excluded->end())
+        return true;
+      return sink(static_cast<ResultType>(std::forward<decltype(element)>(element)));
+    });
+  }
+
+private:
+  using InternalStorageType = std::conditional_t<is_aliasing, cinq::utility::ReferenceWrapper<value_type>, value_type>;
+  using SetType = std::conditional_t<cinq::utility::ReferenceWrapper<value_type>::hash_version,
+    FlatHashTable<InternalStorageType>, std::set<InternalStorageType>>;
+
+  static std::shared_ptr<const SetType> BuildExcluded(Enumerable *enumerable) {
+    auto excluded = std::make_shared<SetType>();
+    std::apply([&excluded](auto &, auto &... sources) {
+        auto insert = [&excluded](auto &&element) {
+          if constexpr (is_aliasing)
+            excluded->insert(element);
+          else
+            excluded->insert(static_cast<value_type>(std::forward<decltype(element)>(element)));
+          return true;
+        };
+        (SourceForEach(sources, insert), ...);
+      }, enumerable->GetSourceTuple());
+    return excluded;
+  }
+
+  const Sentinel &SourceEnd() const {
+    return *this;
+  }
+
+  void FindNextValid() {
+    while (first_ != SourceEnd() && excluded_->find(*first_) != excluded_->end())
+      ++first_;
+  }
+
+  SourceIterator first_;
+  std::shared_ptr<const SetType> excluded_;
+};
+
+} // namespace cinq::detail
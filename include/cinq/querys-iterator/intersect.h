@@ -1,94 +1,82 @@
 #pragma once
 
+#include <algorithm>
+#include <array>
+#include <cstddef>
 #include <iterator>
 #include <map>
+#include <memory>
+#include <numeric>
 #include <tuple>
 #include <type_traits>
-#include <unordered_map>
 #include <utility>
+#include <vector>
 
-#include "../multi-enumerables-visitor.h"
+#include "../flat-hash-table.h"
 #include "../query-category.h"
-#include "detail/concept.h"
 #include "detail/utility.h"
 #include "query-iterator-fwd.h"
+#include "../size-hint.h"
 
 namespace cinq::detail {
+// The elements of the first source which are in all the other ones, in the order of the first source, evaluated when an iterator is
+//   constructed. The elements of the smallest source (as far as the size hints tell) are inserted into a map counting the sources they
+//   were found in, then each other source, from the smallest to the largest, increments the count of the candidates found in all the
+//   previous ones. The first source is probed last, and yields its elements as they're found in all the other ones, unless it's the
+//   smallest one, in which case the candidates are yielded in the order they were inserted. Hence each source is enumerated once. The
+//   evaluation stops as soon as no candidate is left, e.g. a source known to be empty isn't enumerated at all, nor are the following ones.
+// The elements are kept in the map, which the copies of an iterator share, as it's read only once evaluated.
 template <bool ArgConstness, bool RetConstness, class TFn, class... TSources>
-class QueryIterator<ArgConstness, RetConstness, BasicEnumerable<QueryCategory::Intersect, std::tuple<TFn>, TSources...>>
-  : public MultiVisitorSetIterator<RoundRobinIteratorTupleVisitor, ArgConstness, QueryCategory::Intersect, std::tuple<TFn>, TSources...> {
+class QueryIterator<ArgConstness, RetConstness, BasicEnumerable<QueryCategory::Intersect, std::tuple<TFn>, TSources...>> {
 public:
-  using Base = MultiVisitorSetIterator<RoundRobinIteratorTupleVisitor, ArgConstness, QueryCategory::Intersect, std::tuple<TFn>, TSources...>;
+  using Enumerable = BasicEnumerable<QueryCategory::Intersect, std::tuple<TFn>, TSources...>;
 
-  using CommonType = typename Base::AdjustedCommonType;
+  static_assert(sizeof...(TSources) > 1);
+
+  using CommonType = typename Enumerable::AdjustedCommonType;
   using ResultType = cinq::utility::transform_to_result_type_t<RetConstness, CommonType, cinq::utility::SourceType::InternalStorage>;
   using value_type = typename std::decay_t<ResultType>;
 
-  QueryIterator() {}
+  // Whether the internal storage aliases the elements of the sources, otherwise it copies them. See yields_stable_references.
+  static constexpr bool is_aliasing = Enumerable::is_all_reference_to_same && (yields_stable_references<TSources>::value && ...);
 
-  QueryIterator(typename Base::Enumerable *enumerable, bool is_past_the_end_iteratorator)
-    : Base(enumerable, is_past_the_end_iteratorator) {
-    if (!is_past_the_end_iteratorator && Base::visitor.IsValid()) {
-      // push the first element
-      Base::visitor.Visit([this](auto &&x) {
-        if constexpr (std::is_convertible_v<decltype(x), value_type>) {
-          if constexpr (Base::is_all_reference_to_same)
-            ++values_[x];
-          else
-            ++values_[std::forward<decltype(x)>(x)];
-        } else {
-          ++values_[static_cast<const value_type &>(std::forward<decltype(x)>(x))];
-        }
-      });
+  QueryIterator() {}
 
-      QueryIterator::FindNextValid();
+  QueryIterator(Enumerable *enumerable, bool is_past_the_end_iteratorator) {
+    if (!is_past_the_end_iteratorator) {
+      auto result = std::make_shared<Result>();
+      Evaluate(enumerable, [&result](const InternalStorageType &element) {
+        result->elements.push_back(&element);
+        return true;
+      }, result->values);
+      if (!result->elements.empty())
+        result_ = std::move(result);
     }
   }
 
-  QueryIterator(const QueryIterator &rhs)
-    : Base(rhs), values_(rhs.values_), current_(rhs.current_ == rhs.values_.end() ? values_.end() : values_.find(rhs.current_->first)) {}
-
-  QueryIterator(QueryIterator &&rhs) : Base(std::move(rhs)) {
-    if (rhs.current_ == rhs.values_.end()) {
-      values_ = std::move(rhs.values_);
-      current_ = values_.end();
-    } else {
-      auto node = rhs.values_.extract(rhs.current_);
-      values_ = std::move(rhs.values_);
-      current_ = values_.insert(std::move(node)).position;
-    }
-  }
+  QueryIterator(const QueryIterator &) = default;
+  QueryIterator(QueryIterator &&) = default;
 
-  QueryIterator &operator=(const QueryIterator &rhs) {
-    Base::operator=(rhs);
-    values_ = rhs.values_;
-    if (rhs.current_ == rhs.values_.end())
-      current_ = values_.end();
-    else
-      current_ = values_.find(rhs.current_->first);
+  QueryIterator &operator=(const QueryIterator &) = default;
+  QueryIterator &operator=(QueryIterator &&) = default;
 
-    return *this;
+  ResultType operator*() const {
+    return *result_->elements[index_];
   }
 
-  QueryIterator &operator=(QueryIterator &&rhs) {
-    Base::operator=(std::move(rhs));
-    if (rhs.current_ == rhs.values_.end()) {
-      values_ = std::move(rhs.values_);
-      current_ = values_.end();
-    } else {
-      auto node = rhs.values_.extract(rhs.current_);
-      values_ = std::move(rhs.values_);
-      current_ = values_.insert(std::move(node)).position;
-    }
-    return *this;
+  friend bool operator!=(const QueryIterator &lhs, const QueryIterator &rhs) {
+    return !(lhs == rhs);
   }
 
-  ResultType operator*() const {
-    return current_->first;
+  // The iterators evaluated separately (e.g. replaying the query) compare equal at the same position, as the evaluation is repeatable.
+  friend bool operator==(const QueryIterator &lhs, const QueryIterator &rhs) {
+    if (lhs.IsPastTheEnd() || rhs.IsPastTheEnd())
+      return lhs.IsPastTheEnd() && rhs.IsPastTheEnd();
+    return lhs.index_ == rhs.index_;
   }
 
   QueryIterator &operator++() {
-    FindNextValid();
+    ++index_;
     return *this;
   }
 
@@ -98,42 +86,136 @@ public:
     return previous;
   }
 
-protected:
-  void FindNextValid() override {
-    cinq::utility::CinqAssert(!Base::is_past_the_end_iteratorator_);
-
-    bool succeed = false;
-    for (;;) {
-      if (!Base::visitor.MoveToNext(Base::enumerable_->GetSourceTuple()))
-        break;
-
-      Base::visitor.Visit([this, &succeed](auto &&x) {
-        if constexpr (std::is_convertible_v<decltype(x), value_type>) {
-          if constexpr (Base::is_all_reference_to_same)
-            succeed = ++values_[x] == sizeof...(TSources);
-          else
-            succeed = ++values_[std::forward<decltype(x)>(x)] == sizeof...(TSources);
-        } else {
-          succeed = ++values_[static_cast<const value_type &>(std::forward<decltype(x)>(x))] == sizeof...(TSources);
-        }
+  // See SourceSentinel.
+  bool IsPastTheEnd() const {
+    return !result_ || index_ == result_->elements.size();
+  }
 
-        if (succeed)
-          current_ = values_.find(x);
-      });
+  // The size is bounded by the smallest one of the sources.
+  static SizeHint GetSizeHint(Enumerable *enumerable) {
+    return std::apply([](auto &source, auto &... rest) {
+        SizeHint hint = SourceSizeHint(source).UpperBound();
+        ((hint = Min(hint, SourceSizeHint(rest))), ...);
+        return hint;
+      }, enumerable->GetSourceTuple());
+  }
 
-      if (succeed)
-        break;
-    }
+  // See Enumerable::ForEach.
+  template <class Sink>
+  static bool ForEach(Enumerable *enumerable, Sink &sink) {
+    MapType values;
+    return Evaluate(enumerable, [&sink](const InternalStorageType &element) {
+        return sink(static_cast<ResultType>(element));
+      }, values);
   }
 
-  using InternalStorageType = std::conditional_t<Base::is_all_reference_to_same,
-    cinq::utility::ReferenceWrapper<value_type>, value_type>;
+private:
+  using InternalStorageType = std::conditional_t<is_aliasing, cinq::utility::ReferenceWrapper<value_type>, value_type>;
+
+  // The position of a candidate among the ones of the smallest source, and the number of other sources it was found in.
+  struct Candidate {
+    size_t position = 0;
+    size_t found_count = 0;
+  };
 
+  // The flat table moves the copied elements when it grows, which it doesn't once the candidates are inserted.
   using MapType = std::conditional_t<cinq::utility::ReferenceWrapper<value_type>::hash_version,
-    std::unordered_map<InternalStorageType, size_t>, std::map<InternalStorageType, size_t>>;
+    FlatHashTable<InternalStorageType, Candidate>, std::map<InternalStorageType, Candidate>>;
+
+  struct Result {
+    MapType values;
+    std::vector<const InternalStorageType *> elements;
+  };
+
+  // Calls fn with the source of the index.
+  template <class Fn, size_t... indexes>
+  static void VisitSource(Enumerable *enumerable, size_t index, Fn &&fn, std::index_sequence<indexes...>) {
+    ((index == indexes ? fn(enumerable->template GetSource<indexes>()) : void()), ...);
+  }
+
+  // Calls sink with each element of the intersection (kept in values) until it returns false, returns whether it never did.
+  template <class Sink>
+  static bool Evaluate(Enumerable *enumerable, Sink &&sink, MapType &values) {
+    constexpr size_t source_count = sizeof...(TSources);
+    std::array<SizeHint, source_count> hints = std::apply([](auto &... sources) {
+        return std::array<SizeHint, source_count>{ SourceSizeHint(sources)... };
+      }, enumerable->GetSourceTuple());
+
+    std::array<size_t, source_count> order;
+    std::iota(order.begin(), order.end(), size_t(0));
+    std::stable_sort(order.begin(), order.end(), [&hints](size_t lhs, size_t rhs) { return hints[lhs].size < hints[rhs].size; });
+    if (hints[order[0]].size == 0)
+      return true;
+    if (order[0] != 0) {
+      auto first = std::find(order.begin(), order.end(), size_t(0));
+      std::rotate(first, first + 1, order.end());
+    }
+
+    // The candidates are the elements of the smallest source.
+    VisitSource(enumerable, order[0], [&values, &hints, &order](auto &source) {
+        if constexpr (is_flat_hash_table<MapType>::value) {
+          if (hints[order[0]].IsKnown())
+            values.reserve(hints[order[0]].size);
+        }
+        SourceForEach(source, [&values](auto &&x) {
+          const value_type &value = static_cast<const value_type &>(x);
+          const size_t position = values.size();
+          auto &candidate = values[value];
+          if (values.size() != position)
+            candidate.position = position;
+          return true;
+        });
+      }, std::index_sequence_for<TSources...>());
+
+    // The candidates found in the source of the round are found in all the sources so far. The first source yields them in the last one.
+    for (size_t round = 1; round < source_count; ++round) {
+      if (order[round] == 0) {
+        bool is_completed = true;
+        VisitSource(enumerable, 0, [&values, &sink, &is_completed](auto &source) {
+            is_completed = SourceForEach(source, [&values, &sink](auto &&x) {
+              const value_type &value = static_cast<const value_type &>(x);
+              auto position = values.find(value);
+              if (position == values.end() || position->second.found_count != source_count - 2)
+                return true;
+              ++position->second.found_count;
+              return sink(static_cast<const InternalStorageType &>(position->first));
+            });
+          }, std::index_sequence_for<TSources...>());
+        return is_completed;
+      }
+
+      size_t found = 0;
+      VisitSource(enumerable, order[round], [&values, &found, round](auto &source) {
+          SourceForEach(source, [&values, &found, round](auto &&x) {
+            const value_type &value = static_cast<const value_type &>(x);
+            auto position = values.find(value);
+            if (position != values.end() && position->second.found_count == round - 1) {
+              position->second.found_count = round;
+              ++found;
+            }
+            return true;
+          });
+        }, std::index_sequence_for<TSources...>());
+      if (found == 0)
+        return true;
+    }
+
+    // The first source is the smallest one, its candidates found in all the other sources are yielded in its order.
+    std::vector<const typename MapType::value_type *> candidates(values.size());
+    if constexpr (is_flat_hash_table<MapType>::value)
+      values.ForEach([&candidates](const auto &entry) { candidates[entry.second.position] = &entry; });
+    else
+      for (const auto &entry : values)
+        candidates[entry.second.position] = &entry;
+    for (auto candidate : candidates) {
+      if (candidate->second.found_count == source_count - 1 && !sink(static_cast<const InternalStorageType &>(candidate->first)))
+        return false;
+    }
+    return true;
+  }
 
-  MapType values_;
-  typename MapType::iterator current_ = values_.end();
+  std::shared_ptr<const Result> result_;
+  size_t index_ = 0;
 };
 
 } // namespace cinq::detail
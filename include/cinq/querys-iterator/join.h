@@ -1,20 +1,63 @@
 #pragma once
 
+#include <algorithm>
 #include <iterator>
+#include <memory>
+#include <optional>
 #include <tuple>
 #include <type_traits>
+#include <unordered_map>
 #include <utility>
+#include <vector>
 
 #include "../query-category.h"
 #include "detail/concept.h"
 #include "detail/utility.h"
 #include "query-iterator-fwd.h"
+#include "../size-hint.h"
+#include "../splittable-ranges.h"
 
 namespace cinq::detail {
-template <bool ArgConstness, bool RetConstness, class TInnerKeySelector, class TOuterKeySelector, class TResultSelector, class TSource, class TSource2>
-class QueryIterator<ArgConstness, RetConstness, BasicEnumerable<QueryCategory::Join, std::tuple<TInnerKeySelector, TOuterKeySelector, TResultSelector>, TSource, TSource2>> {
+// Passed to Join to promise that both sides are already ordered by key (in ascending order of operator<).
+struct OrderedByKeyTag {};
+
+enum class JoinStrategy {
+  NestedLoop, // compare every pair of keys, used when the key is neither hashable nor less than comparable
+  Hash, // build a hash table on the inner keys once, then probe it with each outer key
+  SortedProbe, // sort the inner keys once, then binary search them with each outer key, used when the key is less than comparable but not hashable
+  Merge // merge both sides as they are, used when both sides are ordered by key
+};
+
+template <class TOuterKey, class TInnerKey, class = void>
+struct join_key_type { using type = void; };
+template <class TOuterKey, class TInnerKey>
+struct join_key_type<TOuterKey, TInnerKey, std::void_t<std::common_type_t<TOuterKey, TInnerKey>>> {
+  using type = std::decay_t<std::common_type_t<TOuterKey, TInnerKey>>;
+};
+template <class TOuterKey, class TInnerKey>
+using join_key_type_t = typename join_key_type<TOuterKey, TInnerKey>::type;
+
+template <class TKey, bool is_ordered_by_key>
+constexpr JoinStrategy SelectJoinStrategy() {
+  if constexpr (std::is_void_v<TKey>) {
+    static_assert(!is_ordered_by_key, "Outer key and inner key have no common type");
+    return JoinStrategy::NestedLoop;
+  } else if constexpr (is_ordered_by_key) {
+    static_assert(cinq::utility::is_less_than_comparable_v<TKey>, "Key must be less than comparable to merge the ordered sides");
+    return JoinStrategy::Merge;
+  } else if constexpr (cinq::utility::is_hashable_v<TKey> && cinq::utility::is_equal_comparable_v<TKey>) {
+    return JoinStrategy::Hash;
+  } else if constexpr (cinq::utility::is_less_than_comparable_v<TKey>) {
+    return JoinStrategy::SortedProbe;
+  } else {
+    return JoinStrategy::NestedLoop;
+  }
+}
+
+template <bool ArgConstness, bool RetConstness, class TInnerKeySelector, class TOuterKeySelector, class TResultSelector, class... TOptions, class TSource, class TSource2>
+class QueryIterator<ArgConstness, RetConstness, BasicEnumerable<QueryCategory::Join, std::tuple<TInnerKeySelector, TOuterKeySelector, TResultSelector, TOptions...>, TSource, TSource2>> {
 public:
-  using Enumerable = BasicEnumerable<QueryCategory::Join, std::tuple<TInnerKeySelector, TOuterKeySelector, TResultSelector>, TSource, TSource2>;
+  using Enumerable = BasicEnumerable<QueryCategory::Join, std::tuple<TInnerKeySelector, TOuterKeySelector, TResultSelector, TOptions...>, TSource, TSource2>;
 
   using SourceIterator = typename Enumerable::template SourceIterator<0>;
   using SourceIterator2 = typename Enumerable::template SourceIterator<1>;
@@ -34,10 +77,29 @@ public:
 
   static_assert(concept::SelectorCheck<TResultSelector, FunctionObjectArgumentTupleElementType, FunctionObjectArgumentTupleElementType2>(), "Bad selector");
 
+  using OuterKeyType = std::decay_t<std::invoke_result_t<TInnerKeySelector &, FunctionObjectArgumentTupleElementType>>;
+  using InnerKeyType = std::decay_t<std::invoke_result_t<TOuterKeySelector &, FunctionObjectArgumentTupleElementType2>>;
+  using KeyType = join_key_type_t<OuterKeyType, InnerKeyType>;
+
+  static constexpr bool is_ordered_by_key = (std::is_same_v<TOptions, OrderedByKeyTag> || ...);
+  static constexpr JoinStrategy strategy = SelectJoinStrategy<KeyType, is_ordered_by_key>();
+
   QueryIterator() : first_(), last_(), first2_(), last2_() {}
 
   QueryIterator(Enumerable *enumerable, bool is_past_the_end_iteratorator)
     : enumerable_(enumerable), is_past_the_end_iteratorator_(is_past_the_end_iteratorator) {
+    if constexpr (strategy == JoinStrategy::Hash) {
+      if (is_past_the_end_iteratorator_ || first_ == last_ || first2_ == last2_)
+        return ;
+      inner_table_ = BuildInnerHashTable(enumerable_, first2_, last2_);
+    } else if constexpr (strategy == JoinStrategy::SortedProbe) {
+      if (is_past_the_end_iteratorator_ || first_ == last_ || first2_ == last2_)
+        return ;
+      sorted_inner_ = BuildSortedInner(enumerable_, first2_, last2_);
+    } else if constexpr (strategy == JoinStrategy::Merge) {
+      group_first_ = group_last_ = first2_;
+    }
+
     if (first2_ != last2_)
       FindNextValid();
   }
@@ -69,8 +131,26 @@ public:
 
   QueryIterator &operator++() {
     cinq::utility::CinqAssert(!is_past_the_end_iteratorator_);
-    if (first2_ != last2_)
-      ++first2_;
+    if constexpr (strategy == JoinStrategy::Hash) {
+      if (++bucket_index_ < bucket_->size()) {
+        first2_ = (*bucket_)[bucket_index_];
+        return *this;
+      }
+      ++first_;
+    } else if constexpr (strategy == JoinStrategy::SortedProbe) {
+      if (++inner_index_ < group_last_index_) {
+        first2_ = (*sorted_inner_)[inner_index_].second;
+        return *this;
+      }
+      ++first_;
+    } else if constexpr (strategy == JoinStrategy::Merge) {
+      if (++first2_ != group_last_)
+        return *this;
+      ++first_;
+    } else {
+      if (first2_ != last2_)
+        ++first2_;
+    }
     FindNextValid();
     return *this;
   }
@@ -82,21 +162,195 @@ public:
     return previous;
   }
 
+  // The size is bounded by the product of the ones of the sources.
+  static SizeHint GetSizeHint(Enumerable *enumerable) {
+    return (SourceSizeHint(enumerable->template GetSource<0>()) * SourceSizeHint(enumerable->template GetSource<1>())).UpperBound();
+  }
+
+  // See Enumerable::ForEach. The hash join pushes the outer source, and probes the inner hash table, the others are evaluated by iterators.
+  template <class Sink>
+  static bool ForEach(Enumerable *enumerable, Sink &sink) {
+    if constexpr (strategy == JoinStrategy::Hash) {
+      auto inner_table = BuildInnerHashTable(enumerable,
+        std::begin(enumerable->template GetSource<1>()), std::end(enumerable->template GetSource<1>()));
+      if (inner_table->empty())
+        return true;
+
+      return SourceForEach(enumerable->template GetSource<0>(), [enumerable, &inner_table, &sink](auto &&outer) {
+        return Push(enumerable, *inner_table, std::forward<decltype(outer)>(outer), sink);
+      });
+    } else {
+      for (QueryIterator first(enumerable, false), last(enumerable, true); first != last; ++first) {
+        if (!sink(*first))
+          return false;
+      }
+      return true;
+    }
+  }
+
+  // See is_range_splittable, only available for the hash join. The ranges are of the outer source, and share one inner hash table.
+  static auto MakeRanges(Enumerable *enumerable) {
+    static_assert(strategy == JoinStrategy::Hash);
+    auto outer_ranges = MakeSourceRanges(enumerable->template GetSource<0>());
+    auto size = outer_ranges.Size();
+    auto inner_table = BuildInnerHashTable(enumerable,
+      std::begin(enumerable->template GetSource<1>()), std::end(enumerable->template GetSource<1>()));
+
+    return SplittableRanges(size, [enumerable, outer_ranges = std::move(outer_ranges), inner_table = std::move(inner_table)](
+        size_t first, size_t last, auto &sink) {
+      return outer_ranges.ForEachInRange(first, last, [enumerable, &inner_table, &sink](auto &&outer) {
+        return Push(enumerable, *inner_table, std::forward<decltype(outer)>(outer), sink);
+      });
+    });
+  }
+
 private:
-  void FindNextValid() {
+  using InnerHashTable = std::unordered_map<std::conditional_t<strategy == JoinStrategy::Hash, KeyType, int>, std::vector<SourceIterator2>>;
+
+  // Passes the result of an outer element and each of its matching inner elements to sink, until sink returns false.
+  // An outer element which is not an lvalue is copied for the outer key selector, as it's also passed to the result selector.
+  template <class TElement, class Sink>
+  static bool Push(Enumerable *enumerable, const InnerHashTable &inner_table, TElement &&outer, Sink &sink) {
+    auto bucket = inner_table.end();
+    if constexpr (std::is_lvalue_reference_v<SourceIteratorYieldType>)
+      bucket = inner_table.find(enumerable->template GetFn<0>()(static_cast<FunctionObjectArgumentTupleElementType>(outer)));
+    else
+      bucket = inner_table.find(enumerable->template GetFn<0>()(static_cast<FunctionObjectArgumentTupleElementType>(std::decay_t<SourceIteratorYieldType>(outer))));
+    if (bucket == inner_table.end())
+      return true;
+
+    for (const auto &inner : bucket->second) {
+      if (!sink(static_cast<ResultType>(enumerable->template GetFn<2>()(
+          static_cast<FunctionObjectArgumentTupleElementType>(outer),
+          static_cast<FunctionObjectArgumentTupleElementType2>(*inner)))))
+        return false;
+    }
+    return true;
+  }
+
+  // The inner keys are computed exactly once per enumeration. Each bucket keeps the inner elements in their original order,
+  //   so the result is yielded in the same order as the nested loop does.
+  static std::shared_ptr<const InnerHashTable> BuildInnerHashTable(Enumerable *enumerable, SourceIterator2 first2, SourceIterator2 last2) {
+    auto table = std::make_shared<InnerHashTable>();
+    for (auto ite = first2; ite != last2; ++ite)
+      (*table)[enumerable->template GetFn<1>()(static_cast<FunctionObjectArgumentTupleElementType2>(*ite))].push_back(ite);
+    return table;
+  }
+
+  using SortedInner = std::vector<std::pair<std::conditional_t<strategy == JoinStrategy::SortedProbe, KeyType, int>, SourceIterator2>>;
+
+  template <class TKey>
+  static bool IsEquivalent(const TKey &lhs, const TKey &rhs) {
+    return !(lhs < rhs) && !(rhs < lhs);
+  }
+
+  // The inner keys are computed exactly once per enumeration. The sort is stable, so the inner elements with equivalent keys keep
+  //   their original order, and the result is yielded in the same order as the nested loop does.
+  static std::shared_ptr<const SortedInner> BuildSortedInner(Enumerable *enumerable, SourceIterator2 first2, SourceIterator2 last2) {
+    auto inner = std::make_shared<SortedInner>();
+    for (auto ite = first2; ite != last2; ++ite)
+      inner->emplace_back(enumerable->template GetFn<1>()(static_cast<FunctionObjectArgumentTupleElementType2>(*ite)), ite);
+    std::stable_sort(inner->begin(), inner->end(), [](const auto &lhs, const auto &rhs) { return lhs.first < rhs.first; });
+    return inner;
+  }
+
+  // Finds the group of inner elements for the outer elements, from the current one, until one of them has a group.
+  void ProbeSortedInner() {
+    const auto &inner = *sorted_inner_;
+    for (; first_ != last_; ++first_) {
+      const KeyType key = enumerable_->template GetFn<0>()(static_cast<FunctionObjectArgumentTupleElementType>(*first_));
+      auto group_first = std::lower_bound(inner.begin(), inner.end(), key, [](const auto &element, const KeyType &key) {
+          return element.first < key;
+        });
+      auto group_last = std::upper_bound(group_first, inner.end(), key, [](const KeyType &key, const auto &element) {
+          return key < element.first;
+        });
+      if (group_first != group_last) {
+        inner_index_ = static_cast<size_t>(group_first - inner.begin());
+        group_last_index_ = static_cast<size_t>(group_last - inner.begin());
+        first2_ = group_first->second;
+        return ;
+      }
+    }
+    first2_ = last2_;
+  }
+
+  // Merges the sources ordered by key, reusing the group of inner elements for the equivalent outer keys. Each outer key is computed
+  //   once. An inner key is computed while its group is scanned, and again for each outer element compared with it to find its group
+  //   (e.g. the outer elements without a match which precede it).
+  void MergeOrderedSources() {
+    auto outer_key_selector = [this](const SourceIterator &ite) -> KeyType {
+      return enumerable_->template GetFn<0>()(static_cast<FunctionObjectArgumentTupleElementType>(*ite));
+    };
+    auto inner_key_selector = [this](const SourceIterator2 &ite) -> KeyType {
+      return enumerable_->template GetFn<1>()(static_cast<FunctionObjectArgumentTupleElementType2>(*ite));
+    };
+
+    while (first_ != last_) {
+      const KeyType key = outer_key_selector(first_);
+      if (group_first_ != group_last_ && IsEquivalent(*group_key_, key))
+        break;
+
+      std::optional<KeyType> inner_key;
+      for (group_first_ = group_last_; group_first_ != last2_; ++group_first_) {
+        inner_key.emplace(inner_key_selector(group_first_));
+        if (!(*inner_key < key))
+          break;
+      }
+      if (group_first_ == last2_) {
+        first_ = last_;
+        break;
+      }
+
+      group_last_ = group_first_;
+      if (key < *inner_key) {
+        ++first_;
+        continue;
+      }
+
+      group_key_ = std::move(inner_key);
+      while (group_last_ != last2_ && !(key < inner_key_selector(group_last_)))
+        ++group_last_;
+      break;
+    }
+
     if (first_ == last_)
-      return ;
+      first2_ = last2_;
+    else
+      first2_ = group_first_;
+  }
 
-    for (;;) {
-      for (;first2_ != last2_; ++first2_) {
-        if (enumerable_->template GetFn<0>()(static_cast<FunctionObjectArgumentTupleElementType>(*first_)) ==
-            enumerable_->template GetFn<1>()(static_cast<FunctionObjectArgumentTupleElementType2>(*first2_)))
+  void FindNextValid() {
+    if constexpr (strategy == JoinStrategy::Hash) {
+      for (; first_ != last_; ++first_) {
+        auto ite = inner_table_->find(enumerable_->template GetFn<0>()(static_cast<FunctionObjectArgumentTupleElementType>(*first_)));
+        if (ite != inner_table_->end()) {
+          bucket_ = &ite->second;
+          bucket_index_ = 0;
+          first2_ = bucket_->front();
           return ;
+        }
       }
+      first2_ = last2_;
+    } else if constexpr (strategy == JoinStrategy::SortedProbe) {
+      ProbeSortedInner();
+    } else if constexpr (strategy == JoinStrategy::Merge) {
+      MergeOrderedSources();
+    } else {
+      if (first_ == last_)
+        return ;
 
-      if (++first_ == last_)
-        break;
-      first2_ = SourceIterator2(std::begin(enumerable_->template GetSource<1>()));
+      for (;;) {
+        for (;first2_ != last2_; ++first2_) {
+          if (enumerable_->template GetFn<0>()(static_cast<FunctionObjectArgumentTupleElementType>(*first_)) ==
+              enumerable_->template GetFn<1>()(static_cast<FunctionObjectArgumentTupleElementType2>(*first2_)))
+            return ;
+        }
+
+        if (++first_ == last_)
+          break;
+        first2_ = SourceIterator2(std::begin(enumerable_->template GetSource<1>()));
+      }
     }
   }
 
@@ -109,6 +363,20 @@ private:
 
   SourceIterator2 first2_ = is_past_the_end_iteratorator_ ? std::end(enumerable_->template GetSource<1>()) : std::begin(enumerable_->template GetSource<1>());
   SourceIterator2 last2_ = std::end(enumerable_->template GetSource<1>());
+
+  // shared between the copies of an iterator, as it's never modified after being built
+  std::shared_ptr<const InnerHashTable> inner_table_;
+  const std::vector<SourceIterator2> *bucket_ = nullptr;
+  size_t bucket_index_ = 0;
+
+  std::shared_ptr<const SortedInner> sorted_inner_;
+  size_t inner_index_ = 0;
+  size_t group_last_index_ = 0;
+
+  // the group of inner elements whose keys are equivalent to group_key_
+  SourceIterator2 group_first_;
+  SourceIterator2 group_last_;
+  std::optional<std::conditional_t<strategy == JoinStrategy::Merge, KeyType, int>> group_key_;
 };
 
 } // namespace cinq::detail
@@ -0,0 +1,343 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <memory>
+#include <numeric>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "../query-category.h"
+#include "../radix-sort.h"
+#include "detail/concept.h"
+#include "detail/utility.h"
+#include "query-iterator-fwd.h"
+#include "../size-hint.h"
+
+namespace cinq::detail {
+// The key of OrderBy or ThenBy, the elements are ordered by compare of the keys selected by selector.
+template <class TSelector, class TCompare>
+struct SortKey {
+  using Selector = TSelector;
+  using Compare = TCompare;
+
+  TSelector selector;
+  TCompare compare;
+};
+
+// The comparator of OrderByDescending and ThenByDescending.
+template <class TCompare>
+struct ReversedCompare {
+  template <class T, class U>
+  bool operator()(const T &lhs, const U &rhs) const {
+    return compare(rhs, lhs);
+  }
+
+  TCompare compare;
+};
+
+template <class TCompare, class TKey>
+struct radix_order<ReversedCompare<TCompare>, TKey> : radix_order<TCompare, TKey> {
+  static constexpr bool is_descending = !radix_order<TCompare, TKey>::is_descending;
+};
+
+// The keys of an OrderBy followed by ThenBy, from the most significant one. A ThenBy appends its key (see Cinq::ThenBy), and a Take
+//   makes the keys partial, i.e. only the first count elements of the sorted order are kept (see Cinq::Take).
+template <bool partial, class... TKeys>
+struct SortKeys {
+  static constexpr bool is_partial = partial;
+
+  template <class TKey>
+  SortKeys<false, TKeys..., TKey> Then(TKey key) && {
+    static_assert(!is_partial);
+    return { std::tuple_cat(std::move(keys), std::make_tuple(std::move(key))) };
+  }
+
+  SortKeys<true, TKeys...> Take(size_t n) && {
+    return { std::move(keys), std::min(count, n) };
+  }
+
+  std::tuple<TKeys...> keys;
+  size_t count = SizeHint::unknown_size;
+};
+
+// The elements of the source stably sorted by their keys, evaluated when an iterator is constructed. Each selector is called once per
+//   element, its keys are stored in a column, and a permutation of the indexes of the elements is sorted by comparing the columns in
+//   turn, so that neither the keys are selected again nor the elements are moved by the sort. The permutation is radix sorted instead if
+//   the first key allows it, see Sort.
+// If only the first count elements are kept (see SortKeys::Take) and the source may be larger, they're selected in a bounded heap while
+//   the source is enumerated instead, see SelectFirst.
+// The elements are aliased if the source yields stable references (see yields_stable_references), otherwise they're copied. They're
+//   kept with the permutation, which the copies of an iterator share, as it's read only once evaluated.
+template <bool ArgConstness, bool RetConstness, bool partial, class... TKeys, class TSource>
+class QueryIterator<ArgConstness, RetConstness, BasicEnumerable<QueryCategory::OrderBy, std::tuple<SortKeys<partial, TKeys...>>, TSource>> {
+public:
+  using Enumerable = BasicEnumerable<QueryCategory::OrderBy, std::tuple<SortKeys<partial, TKeys...>>, TSource>;
+
+  using SourceIterator = typename Enumerable::template SourceIterator<0>;
+
+  using SourceIteratorYieldType = decltype(*std::declval<SourceIterator>());
+  using FunctionObjectArgumentType = cinq::utility::transform_to_function_object_argument_t<ArgConstness, SourceIteratorYieldType>;
+
+  using ResultType = cinq::utility::transform_to_result_type_t<RetConstness, SourceIteratorYieldType, cinq::utility::SourceType::InternalStorage>;
+  using value_type = std::decay_t<ResultType>;
+
+  // Whether the elements of the source are aliased, otherwise they're copied.
+  static constexpr bool is_aliasing = std::is_lvalue_reference_v<SourceIteratorYieldType> && yields_stable_references<TSource>::value;
+
+  // The argument of the selectors: the element of the source if it's aliased, otherwise its copy.
+  using SelectorArgumentType = std::conditional_t<is_aliasing, FunctionObjectArgumentType, const value_type &>;
+
+  static_assert((concept::SelectorCheck<typename TKeys::Selector, SelectorArgumentType>() && ...), "Bad key selector");
+
+  QueryIterator() {}
+
+  QueryIterator(Enumerable *enumerable, bool is_past_the_end_iteratorator) {
+    if (!is_past_the_end_iteratorator) {
+      auto result = std::make_shared<Result>(Evaluate(enumerable, enumerable->FirstFn().count));
+      if (!result->order.empty())
+        result_ = std::move(result);
+    }
+  }
+
+  QueryIterator(const QueryIterator &) = default;
+  QueryIterator(QueryIterator &&) = default;
+
+  QueryIterator &operator=(const QueryIterator &) = default;
+  QueryIterator &operator=(QueryIterator &&) = default;
+
+  ResultType operator*() const {
+    return result_->Element(index_);
+  }
+
+  friend bool operator!=(const QueryIterator &lhs, const QueryIterator &rhs) {
+    return !(lhs == rhs);
+  }
+
+  // The iterators evaluated separately compare equal at the same position, as the sort is stable.
+  friend bool operator==(const QueryIterator &lhs, const QueryIterator &rhs) {
+    if (lhs.IsPastTheEnd() || rhs.IsPastTheEnd())
+      return lhs.IsPastTheEnd() && rhs.IsPastTheEnd();
+    return lhs.index_ == rhs.index_;
+  }
+
+  QueryIterator &operator++() {
+    ++index_;
+    return *this;
+  }
+
+  QueryIterator operator++(int) {
+    QueryIterator previous(*this);
+    ++*this;
+    return previous;
+  }
+
+  // See SourceSentinel.
+  bool IsPastTheEnd() const {
+    return !result_ || index_ == result_->order.size();
+  }
+
+  // The size is the one of the source, bounded by the count of the kept elements.
+  static SizeHint GetSizeHint(Enumerable *enumerable) {
+    SizeHint hint = SourceSizeHint(enumerable->SourceFront());
+    return {std::min(hint.size, enumerable->FirstFn().count), hint.is_exact};
+  }
+
+  // See Enumerable::ForEach. The elements are pushed once sorted.
+  template <class Sink>
+  static bool ForEach(Enumerable *enumerable, Sink &sink) {
+    return ForEachFirst(enumerable, enumerable->FirstFn().count, sink);
+  }
+
+  // Pushes the first count elements of the sorted order, which are selected as if a Take followed, see Cinq::First.
+  template <class Sink>
+  static bool ForEachFirst(Enumerable *enumerable, size_t count, Sink &sink) {
+    Result result = Evaluate(enumerable, std::min(count, enumerable->FirstFn().count));
+    for (size_t i = 0; i < result.order.size(); ++i) {
+      if (!sink(result.Element(i)))
+        return false;
+    }
+    return true;
+  }
+
+private:
+  using InternalStorageType = std::conditional_t<is_aliasing, const value_type *, value_type>;
+
+  // The columns of the keys, the one of index i holding the key of the element of index i of each column.
+  using KeyColumns = std::tuple<std::vector<std::decay_t<std::invoke_result_t<typename TKeys::Selector, SelectorArgumentType>>>...>;
+
+  struct Result {
+    // The element of the position in the sorted order.
+    const value_type &Element(size_t position) const {
+      if constexpr (is_aliasing)
+        return *elements[order[position]];
+      else
+        return elements[order[position]];
+    }
+
+    std::vector<InternalStorageType> elements;
+    std::vector<size_t> order;
+  };
+
+  // Stores value at the slot of a column, which is appended if the slot is past its end.
+  template <class TColumn, class T>
+  static void Store(TColumn &column, size_t slot, T &&value) {
+    if (slot == column.size())
+      column.push_back(std::forward<T>(value));
+    else
+      column[slot] = std::forward<T>(value);
+  }
+
+  // Stores the element at the slot of the elements.
+  template <class T>
+  static void StoreElement(Result &result, size_t slot, T &&element) {
+    if constexpr (is_aliasing)
+      Store(result.elements, slot, &element);
+    else
+      Store(result.elements, slot, std::forward<T>(element));
+  }
+
+  // Stores the keys of an element at the slot of the columns.
+  template <class T, size_t... indexes>
+  static void SelectKeys(SortKeys<partial, TKeys...> &sort_keys, T &&element, KeyColumns &columns, size_t slot,
+      std::index_sequence<indexes...>) {
+    (Store(std::get<indexes>(columns), slot, std::get<indexes>(sort_keys.keys).selector(static_cast<SelectorArgumentType>(element))), ...);
+  }
+
+  // The lexicographic comparison of the keys of the elements of indexes lhs and rhs, from the key of index.
+  template <size_t index = 0>
+  static bool IsBefore(SortKeys<partial, TKeys...> &sort_keys, const KeyColumns &columns, size_t lhs, size_t rhs) {
+    auto &compare = std::get<index>(sort_keys.keys).compare;
+    const auto &column = std::get<index>(columns);
+    if constexpr (index + 1 == sizeof...(TKeys)) {
+      return compare(column[lhs], column[rhs]);
+    } else {
+      if (compare(column[lhs], column[rhs]))
+        return true;
+      if (compare(column[rhs], column[lhs]))
+        return false;
+      return IsBefore<index + 1>(sort_keys, columns, lhs, rhs);
+    }
+  }
+
+  // The first count elements of the sorted order.
+  static Result Evaluate(Enumerable *enumerable, size_t count) {
+    SizeHint hint = SourceSizeHint(enumerable->SourceFront());
+    if (count == 0)
+      return {};
+    if (count < hint.size)
+      return SelectFirst(enumerable, count);
+
+    SortKeys<partial, TKeys...> &sort_keys = enumerable->FirstFn();
+    Result result;
+    KeyColumns columns;
+    if (hint.is_exact) {
+      result.elements.reserve(hint.size);
+      std::apply([&hint](auto &... column) { (column.reserve(hint.size), ...); }, columns);
+    }
+
+    SourceForEach(enumerable->SourceFront(), [&sort_keys, &result, &columns](auto &&element) {
+      size_t slot = result.elements.size();
+      SelectKeys(sort_keys, element, columns, slot, std::index_sequence_for<TKeys...>());
+      StoreElement(result, slot, std::forward<decltype(element)>(element));
+      return true;
+    });
+
+    result.order = Sort(sort_keys, columns);
+    return result;
+  }
+
+  // The indexes of the elements, stably sorted by their keys. If the first key is an integer, a floating point value or a string, ordered
+  //   by operator< or operator> (see radix_order), the indexes are radix sorted by its bits (see RadixKey). The runs of equal bits are
+  //   then sorted by comparing the keys, if the bits are only a prefix of the first key or if other keys follow.
+  static std::vector<size_t> Sort(SortKeys<partial, TKeys...> &sort_keys, const KeyColumns &columns) {
+    using FirstKey = std::tuple_element_t<0, std::tuple<TKeys...>>;
+    using KeyType = typename std::tuple_element_t<0, KeyColumns>::value_type;
+    using Order = radix_order<typename FirstKey::Compare, KeyType>;
+
+    const auto &column = std::get<0>(columns);
+    std::vector<size_t> order(column.size());
+    auto is_before = [&sort_keys, &columns](size_t lhs, size_t rhs) {
+      return IsBefore(sort_keys, columns, lhs, rhs);
+    };
+
+    if constexpr (Order::is_sortable) {
+      using Radix = RadixKey<KeyType>;
+      std::vector<RadixEntry<typename Radix::Bits>> entries(column.size());
+      for (size_t i = 0; i < column.size(); ++i) {
+        auto bits = Radix::ToBits(column[i]);
+        entries[i] = { Order::is_descending ? static_cast<decltype(bits)>(~bits) : bits, i };
+      }
+      RadixSort(entries);
+      for (size_t i = 0; i < entries.size(); ++i)
+        order[i] = entries[i].index;
+
+      if constexpr (Radix::is_prefix || sizeof...(TKeys) > 1) {
+        for (size_t first = 0, last; first < entries.size(); first = last) {
+          for (last = first + 1; last < entries.size() && entries[last].bits == entries[first].bits; ++last) {}
+          if (last - first > 1)
+            std::stable_sort(order.begin() + first, order.begin() + last, is_before);
+        }
+      }
+    } else {
+      std::iota(order.begin(), order.end(), size_t(0));
+      std::stable_sort(order.begin(), order.end(), is_before);
+    }
+    return order;
+  }
+
+  // The first count elements of the sorted order, selected in O(N log count) time and O(count) space. The slots of the elements kept so
+  //   far are in a max heap, whose top is the last one in the sorted order. The keys of each element are selected into a spare slot, and
+  //   it replaces the top if it's before it, the slot of the top becoming the spare one, otherwise it's dropped without being stored.
+  // The elements of equivalent keys are ordered by their sequence in the source, so that the selection is stable, i.e. an element is
+  //   never before the top if their keys are equivalent.
+  static Result SelectFirst(Enumerable *enumerable, size_t count) {
+    SortKeys<partial, TKeys...> &sort_keys = enumerable->FirstFn();
+    Result result;
+    KeyColumns columns;
+    std::vector<size_t> sequences;
+    std::vector<size_t> heap;
+    size_t spare = count;
+    size_t sequence = 0;
+
+    auto is_before = [&sort_keys, &columns, &sequences](size_t lhs, size_t rhs) {
+      if (IsBefore(sort_keys, columns, lhs, rhs))
+        return true;
+      return !IsBefore(sort_keys, columns, rhs, lhs) && sequences[lhs] < sequences[rhs];
+    };
+
+    SourceForEach(enumerable->SourceFront(), [&](auto &&element) {
+      if (heap.size() < count) {
+        size_t slot = heap.size();
+        SelectKeys(sort_keys, element, columns, slot, std::index_sequence_for<TKeys...>());
+        StoreElement(result, slot, std::forward<decltype(element)>(element));
+        Store(sequences, slot, sequence++);
+        heap.push_back(slot);
+        std::push_heap(heap.begin(), heap.end(), is_before);
+        return true;
+      }
+
+      SelectKeys(sort_keys, element, columns, spare, std::index_sequence_for<TKeys...>());
+      Store(sequences, spare, sequence++);
+      if (!is_before(spare, heap.front()))
+        return true;
+
+      StoreElement(result, spare, std::forward<decltype(element)>(element));
+      std::pop_heap(heap.begin(), heap.end(), is_before);
+      std::swap(heap.back(), spare);
+      std::push_heap(heap.begin(), heap.end(), is_before);
+      return true;
+    });
+
+    std::sort_heap(heap.begin(), heap.end(), is_before);
+    result.order = std::move(heap);
+    return result;
+  }
+
+  std::shared_ptr<const Result> result_;
+  size_t index_ = 0;
+};
+
+} // namespace cinq::detail
@@ -8,4 +8,8 @@ class QueryIterator;
 template <class QueryTag, class TFn, class... TSources>
 class BasicEnumerable;
 
+// See enumerable.h.
+template <class TEnumerable>
+struct yields_stable_references;
+
 } // namespace cinq::detail
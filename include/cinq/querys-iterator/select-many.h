@@ -5,21 +5,26 @@
 #include <tuple>
 #include <type_traits>
 #include <utility>
-#include <vector>
 
 #include "../query-category.h"
 #include "detail/concept.h"
 #include "detail/utility.h"
 #include "query-iterator-fwd.h"
+#include "../enumerable-source.h"
+#include "../size-hint.h"
+#include "../source-sentinel.h"
+#include "../splittable-ranges.h"
 
 namespace cinq::detail {
 template <bool ArgConstness, bool RetConstness, class TFn, class TSource>
-class QueryIterator<ArgConstness, RetConstness, BasicEnumerable<QueryCategory::SelectMany, std::tuple<TFn>, TSource>> {
+class QueryIterator<ArgConstness, RetConstness, BasicEnumerable<QueryCategory::SelectMany, std::tuple<TFn>, TSource>>
+  : private SourceSentinel<typename BasicEnumerable<QueryCategory::SelectMany, std::tuple<TFn>, TSource>::template SourceIterator<0>> {
 public:
   using Enumerable = BasicEnumerable<QueryCategory::SelectMany, std::tuple<TFn>, TSource>;
 
   using SourceIterator = typename Enumerable::template SourceIterator<0>;
   using SourceYieldType = decltype(*std::declval<SourceIterator>());
+  using Sentinel = SourceSentinel<SourceIterator>;
 
   using FunctionObjectArgumentType = cinq::utility::transform_to_function_object_argument_t<ArgConstness, SourceYieldType>;
 
@@ -33,166 +38,143 @@ public:
   static_assert(concept::SelectorCheck<TFn, FunctionObjectArgumentType>() &&
     concept::SelectManySelectorCheck<true, TFn, FunctionObjectArgumentType>(), "Bad selector");
 
-  class BaseIterator {
-  public:
-    using value_type = std::decay_t<ResultType>;
+  // A produced enumerable which isn't a reference is owned by the iterator, and shared by its copies.
+  // Only the current one is kept, hence the references to its elements are valid until the iterator moves to the next one.
+  static constexpr bool is_produced_enumerable_owned = !std::is_reference_v<ProducedEnumerable>;
+  using ProducedEnumerableHolder = std::conditional_t<is_produced_enumerable_owned,
+    std::shared_ptr<ProducedEnumerable>, std::remove_reference_t<ProducedEnumerable> *>;
 
-    virtual ~BaseIterator() {}
-
-    virtual bool IsPastTheEnd() const = 0;
-
-    virtual ResultType operator*() const = 0;
-
-    virtual BaseIterator &operator++() = 0;
-
-    virtual bool operator!=(const BaseIterator &rhs) const = 0;
-    virtual bool operator==(const BaseIterator &rhs) final {
-      return !this->operator!=(rhs);
-    }
-
-    virtual std::unique_ptr<BaseIterator> Clone() const = 0;
-  };
-
-  class BeginIterator : public BaseIterator {
-  public:
-    struct ProducedEnumerableHolder {
-      // need to check for copy elision
-      ProducedEnumerableHolder(ProducedEnumerable produced_enumerable)
-        : produced_enumerable_(produced_enumerable) {}
-
-      auto begin() {
-        return std::begin(produced_enumerable_);
-      }
-
-      auto end() {
-        return std::end(produced_enumerable_);
-      }
-
-      ProducedEnumerable produced_enumerable_;
-    };
-
-    BeginIterator(Enumerable *enumerable)
-      : enumerable_(enumerable) {
-      InitalizeNewProducedEnumerable(first_);
-    }
-
-    BeginIterator(const BeginIterator &) = default;
-    BeginIterator(BeginIterator &&) = default;
-
-    BeginIterator &operator=(const BeginIterator &) = default;
-    BeginIterator &operator=(BeginIterator &&) = default;
-
-    BeginIterator &operator++() override {
-      ++produced_first_;
-
-      while (produced_first_ == std::end(*produced_enumerable_vtr_.back())) {
-        ++first_;
-        if (first_ == last_)
-          return *this;
-        InitalizeNewProducedEnumerable(first_);
-      }
-
-      return *this;
-    }
-
-    ResultType operator*() const override {
-      return *produced_first_;
-    }
+  QueryIterator() {}
 
-    bool operator!=(const BaseIterator &rhs) const override {
-      const BeginIterator &lhs = *this;
-      return !(lhs.IsPastTheEnd() && rhs.IsPastTheEnd()) &&
-        (!rhs.IsPastTheEnd() || lhs.first_ != lhs.last_ && lhs.produced_first_ != lhs.produced_last_);
-    }
+  QueryIterator(Enumerable *enumerable, bool is_past_the_end_iterator)
+    : Sentinel(std::end(enumerable->SourceFront())), enumerable_(enumerable),
+      first_(is_past_the_end_iterator ? std::end(enumerable_->SourceFront()) : std::begin(enumerable_->SourceFront())) {
+    if (!is_past_the_end_iterator)
+      FindNextValid();
+  }
 
-    std::unique_ptr<BaseIterator> Clone() const override {
-      return std::make_unique<BeginIterator>(*this);
-    }
+  QueryIterator(const QueryIterator &) = default;
+  QueryIterator(QueryIterator &&) = default;
 
-    bool IsPastTheEnd() const override { return false; }
+  QueryIterator &operator=(const QueryIterator &) = default;
+  QueryIterator &operator=(QueryIterator &&) = default;
 
-  private:
-    void InitalizeNewProducedEnumerable(SourceIterator &iter) {
-      if (iter == std::end(enumerable_->SourceFront()))
-        return ;
+  ResultType operator*() const {
+    return *produced_first_;
+  }
 
-      produced_enumerable_vtr_.push_back(std::make_shared<ProducedEnumerableHolder>(enumerable_->FirstFn()(static_cast<FunctionObjectArgumentType>(*iter))));
-      produced_first_ = std::begin(*produced_enumerable_vtr_.back());
-      produced_last_ = std::end(*produced_enumerable_vtr_.back());
+  QueryIterator &operator++() {
+    ++produced_index_;
+    if (++produced_first_ == produced_last_) {
+      ++first_;
+      FindNextValid();
     }
+    return *this;
+  }
 
-    Enumerable *enumerable_;
-
-    SourceIterator first_ = std::begin(enumerable_->SourceFront());
-    SourceIterator last_ = std::end(enumerable_->SourceFront());
-
-    std::vector<std::shared_ptr<ProducedEnumerableHolder>> produced_enumerable_vtr_;
-    ProducedIterator produced_first_;
-    ProducedIterator produced_last_;
-  };
-
-  class EndIterator : public BaseIterator {
-  public:
-    EndIterator(Enumerable *) {}
-
-    bool IsPastTheEnd() const override { return true; }
+  QueryIterator operator++(int) {
+    QueryIterator previous(*this);
+    ++*this;
+    return previous;
+  }
 
-    ResultType operator*() const override { throw std::runtime_error("Can not dereference past-the-end iterator."); }
+  // The past-the-end iterators are equal, the others are equal if they are at the same position, i.e. the same element of the source and
+  //   the same index in the enumerable produced for it, even if it's produced separately (e.g. by iterators begun separately).
+  friend bool operator==(const QueryIterator &lhs, const QueryIterator &rhs) {
+    if (lhs.IsPastTheEnd() || rhs.IsPastTheEnd())
+      return lhs.IsPastTheEnd() == rhs.IsPastTheEnd();
+    return lhs.first_ == rhs.first_ && lhs.produced_index_ == rhs.produced_index_;
+  }
 
-    EndIterator &operator++() override { return *this; }
+  friend bool operator!=(const QueryIterator &lhs, const QueryIterator &rhs) {
+    return !(lhs == rhs);
+  }
 
-    bool operator!=(const BaseIterator &rhs) const override {
-      const EndIterator &lhs = *this;
-      return !(lhs.IsPastTheEnd() && rhs.IsPastTheEnd()) &&
-        (!rhs.IsPastTheEnd() || rhs.operator!=(*this));
+  // The size is exact if the source is a container (i.e. an EnumerableSource) and the selector yields references to containers providing
+  //   std::size (e.g. the inner vectors of a vector<vector<T>>), the selector is then called once more with each element of the source.
+  //   It's unknown otherwise, as enumerating a query would evaluate it once more.
+  static SizeHint GetSizeHint(Enumerable *enumerable) {
+    if constexpr (is_enumerable_source_v<TSource> && !is_produced_enumerable_owned &&
+        is_sized_container<std::remove_reference_t<ProducedEnumerable>>::value) {
+      size_t size = 0;
+      SourceForEach(enumerable->SourceFront(), [enumerable, &size](auto &&element) {
+        size += static_cast<size_t>(std::size(enumerable->FirstFn()(static_cast<FunctionObjectArgumentType>(element))));
+        return true;
+      });
+      return {size, true};
+    } else {
+      return {};
     }
+  }
 
-    std::unique_ptr<BaseIterator> Clone() const override {
-      return std::make_unique<EndIterator>(nullptr);
+  // Passes the elements produced for an element of the source to sink, until sink returns false.
+  // The produced enumerable lives until all its elements are passed.
+  template <class TElement, class Sink>
+  static bool Push(Enumerable *enumerable, TElement &&element, Sink &sink) {
+    auto &&produced_enumerable = enumerable->FirstFn()(static_cast<FunctionObjectArgumentType>(element));
+    for (auto &&produced_element : produced_enumerable) {
+      if (!sink(static_cast<ResultType>(std::forward<decltype(produced_element)>(produced_element))))
+        return false;
     }
-  };
-
-  QueryIterator() {}
-
-  QueryIterator(Enumerable *enumerable, bool is_past_the_end_iterator) {
-    if (is_past_the_end_iterator)
-      iterator_ = std::make_unique<EndIterator>(enumerable);
-    else
-      iterator_ = std::make_unique<BeginIterator>(enumerable);
+    return true;
   }
 
-  QueryIterator(const QueryIterator &rhs) : iterator_(rhs.iterator_->Clone()) {}
-  QueryIterator(QueryIterator &&) = default;
+  // See Enumerable::ForEach.
+  template <class Sink>
+  static bool ForEach(Enumerable *enumerable, Sink &sink) {
+    return SourceForEach(enumerable->SourceFront(), [enumerable, &sink](auto &&element) {
+      return Push(enumerable, std::forward<decltype(element)>(element), sink);
+    });
+  }
 
-  QueryIterator &operator=(const QueryIterator &rhs) {
-    iterator_ = rhs.iterator_->Clone();
+  // See is_range_splittable.
+  static auto MakeRanges(Enumerable *enumerable) {
+    auto source_ranges = MakeSourceRanges(enumerable->SourceFront());
+    auto size = source_ranges.Size();
+    return SplittableRanges(size, [enumerable, source_ranges = std::move(source_ranges)](size_t first, size_t last, auto &sink) {
+      return source_ranges.ForEachInRange(first, last, [enumerable, &sink](auto &&element) {
+        return Push(enumerable, std::forward<decltype(element)>(element), sink);
+      });
+    });
   }
-  QueryIterator &operator=(QueryIterator &&) = default;
 
-  ResultType operator*() const {
-    return iterator_->operator*();
+  // See SourceSentinel.
+  bool IsPastTheEnd() const {
+    return first_ == SourceEnd();
   }
 
-  QueryIterator &operator++() {
-    ++*iterator_;
+private:
+  const Sentinel &SourceEnd() const {
     return *this;
   }
-  QueryIterator operator++(int) {
-    QueryIterator prev(*this);
-    ++*iterator_;
-    return prev;
-  }
 
-  friend bool operator!=(const QueryIterator &lhs, const QueryIterator &rhs) {
-    return *lhs.iterator_ != *rhs.iterator_;
-  }
+  // Produces the enumerables from first_ until one isn't empty, the previous one is released.
+  void FindNextValid() {
+    for (; first_ != SourceEnd(); ++first_) {
+      if constexpr (is_produced_enumerable_owned) {
+        produced_enumerable_ = std::make_shared<ProducedEnumerable>(enumerable_->FirstFn()(static_cast<FunctionObjectArgumentType>(*first_)));
+      } else {
+        auto &&produced_enumerable = enumerable_->FirstFn()(static_cast<FunctionObjectArgumentType>(*first_));
+        produced_enumerable_ = std::addressof(produced_enumerable);
+      }
 
-  friend bool operator==(const QueryIterator &lhs, const QueryIterator &rhs) {
-    return *lhs.iterator_ == *rhs.iterator_;
+      produced_first_ = std::begin(*produced_enumerable_);
+      produced_last_ = std::end(*produced_enumerable_);
+      produced_index_ = 0;
+      if (produced_first_ != produced_last_)
+        return ;
+    }
+    produced_enumerable_ = nullptr;
   }
 
-private:
-  std::unique_ptr<BaseIterator> iterator_;
+  Enumerable *enumerable_ = nullptr;
+
+  SourceIterator first_;
+
+  ProducedEnumerableHolder produced_enumerable_ = nullptr;
+  ProducedIterator produced_first_;
+  ProducedIterator produced_last_;
+  size_t produced_index_ = 0;
 };
 
 } // namespace cinq::detail
@@ -1,5 +1,7 @@
 #pragma once
 
+#include <cstddef>
+#include <cstdint>
 #include <iterator>
 #include <tuple>
 #include <type_traits>
@@ -9,6 +11,10 @@
 #include "detail/concept.h"
 #include "detail/utility.h"
 #include "query-iterator-fwd.h"
+#include "../batch.h"
+#include "../size-hint.h"
+#include "../source-sentinel.h"
+#include "../splittable-ranges.h"
 
 namespace cinq::detail {
 template <bool ArgConstness, bool RetConstness, class TFn, class TSource>
@@ -27,6 +33,14 @@ public:
 
   static_assert(concept::SelectorCheck<TFn, FunctionObjectArgumentType>(), "Bad selector");
 
+  // The iterator is as strong as the one of the source, e.g. a Select over a std::vector is random access.
+  using iterator_category = cinq::utility::iterator_category_t<SourceIterator>;
+  using difference_type = std::ptrdiff_t;
+
+  // In batched evaluation the results are stored in a buffer of batch_size elements, which is only done for small trivial prvalues.
+  static constexpr bool is_batch_evaluable = !std::is_reference_v<FunctionObjectYieldType> &&
+    std::is_trivially_copyable_v<value_type> && std::is_trivially_default_constructible_v<value_type> && sizeof(value_type) <= 16;
+
   QueryIterator() {}
 
   QueryIterator(Enumerable *enumerable, bool is_past_the_end_iteratorator)
@@ -62,6 +76,72 @@ public:
     return previous;
   }
 
+  // See SourceSentinel, only available if the iterator of the source tells whether it's past the end.
+  template <class T = SourceIterator, class = std::enable_if_t<has_past_the_end_check<T>::value>>
+  bool IsPastTheEnd() const {
+    return iterator_.IsPastTheEnd();
+  }
+
+  // The size is the one of the source.
+  static SizeHint GetSizeHint(Enumerable *enumerable) {
+    return SourceSizeHint(enumerable->SourceFront());
+  }
+
+  // Only available when the source iterator is bidirectional.
+  QueryIterator &operator--() {
+    --iterator_;
+    return *this;
+  }
+
+  // Only available when the source iterator is random access.
+  QueryIterator &operator+=(difference_type n) {
+    iterator_ += n;
+    return *this;
+  }
+
+  friend difference_type operator-(const QueryIterator &lhs, const QueryIterator &rhs) {
+    return lhs.iterator_ - rhs.iterator_;
+  }
+
+  // Passes the result of an element of the source to sink, and returns what sink returns.
+  template <class TElement, class Sink>
+  static bool Push(Enumerable *enumerable, TElement &&element, Sink &sink) {
+    return sink(static_cast<ResultType>(enumerable->FirstFn()(static_cast<FunctionObjectArgumentType>(element))));
+  }
+
+  // See Enumerable::ForEach.
+  template <class Sink>
+  static bool ForEach(Enumerable *enumerable, Sink &sink) {
+    return SourceForEach(enumerable->SourceFront(), [enumerable, &sink](auto &&element) {
+      return Push(enumerable, std::forward<decltype(element)>(element), sink);
+    });
+  }
+
+  // See is_batch_evaluable. The batches are dense.
+  template <class BatchSink>
+  static bool ForEachBatch(Enumerable *enumerable, BatchSink &batch_sink) {
+    value_type buffer[batch_size];
+    return SourceForEachBatch(enumerable->SourceFront(), [enumerable, &batch_sink, &buffer](const auto &batch) {
+      size_t size = 0;
+      batch.ForEach([enumerable, &buffer, &size](auto &element, std::uint32_t) {
+        buffer[size++] = enumerable->FirstFn()(static_cast<FunctionObjectArgumentType>(element));
+        return true;
+      });
+      return batch_sink(Batch<value_type>{buffer, nullptr, size});
+    });
+  }
+
+  // See is_range_splittable.
+  static auto MakeRanges(Enumerable *enumerable) {
+    auto source_ranges = MakeSourceRanges(enumerable->SourceFront());
+    auto size = source_ranges.Size();
+    return SplittableRanges(size, [enumerable, source_ranges = std::move(source_ranges)](size_t first, size_t last, auto &sink) {
+      return source_ranges.ForEachInRange(first, last, [enumerable, &sink](auto &&element) {
+        return Push(enumerable, std::forward<decltype(element)>(element), sink);
+      });
+    });
+  }
+
 private:
   Enumerable *enumerable_ = nullptr;
 
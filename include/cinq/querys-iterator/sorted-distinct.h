@@ -0,0 +1,113 @@
+#pragma once
+
+#include <iterator>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+
+#include "../query-category.h"
+#include "../size-hint.h"
+#include "../sorted-merge.h"
+#include "../source-sentinel.h"
+#include "detail/utility.h"
+#include "query-iterator-fwd.h"
+
+namespace cinq::detail {
+// Distinct over a source sorted in the order of TFn (see Cinq::AssumeSorted), the equal elements are adjacent: an element is yielded if
+//   the previous one is ordered before it. It keeps no internal storage.
+template <bool ArgConstness, bool RetConstness, class TFn, class TSource>
+class QueryIterator<ArgConstness, RetConstness, BasicEnumerable<QueryCategory::SortedDistinct, std::tuple<TFn>, TSource>>
+  : private SourceSentinel<typename BasicEnumerable<QueryCategory::SortedDistinct, std::tuple<TFn>, TSource>::template SourceIterator<0>> {
+public:
+  using Enumerable = BasicEnumerable<QueryCategory::SortedDistinct, std::tuple<TFn>, TSource>;
+
+  using SourceIterator = typename Enumerable::template SourceIterator<0>;
+  using SourceIteratorYieldType = decltype(*std::declval<SourceIterator>());
+  using Sentinel = SourceSentinel<SourceIterator>;
+
+  // Whether the yielded element refers to the one of the source, otherwise it's a copy. See MergedElement.
+  static constexpr bool is_aliasing = std::is_reference_v<SourceIteratorYieldType> && yields_stable_references<TSource>::value;
+
+  using value_type = std::decay_t<SourceIteratorYieldType>;
+  using ResultType = std::conditional_t<is_aliasing,
+      cinq::utility::transform_to_result_type_t<RetConstness, SourceIteratorYieldType, cinq::utility::SourceType::InternalStorage>,
+      value_type
+    >;
+
+  QueryIterator() {}
+
+  QueryIterator(Enumerable *enumerable, bool is_past_the_end_iteratorator)
+    : Sentinel(std::end(enumerable->SourceFront())),
+      enumerable_(enumerable),
+      first_(is_past_the_end_iteratorator ? std::end(enumerable->SourceFront()) : std::begin(enumerable->SourceFront())) {
+    if (first_ != SourceEnd())
+      current_.Assign(*first_);
+  }
+
+  QueryIterator(const QueryIterator &) = default;
+  QueryIterator(QueryIterator &&) = default;
+
+  QueryIterator &operator=(const QueryIterator &) = default;
+  QueryIterator &operator=(QueryIterator &&) = default;
+
+  ResultType operator*() const {
+    return *current_;
+  }
+
+  friend bool operator!=(const QueryIterator &lhs, const QueryIterator &rhs) {
+    return lhs.first_ != rhs.first_;
+  }
+
+  friend bool operator==(const QueryIterator &lhs, const QueryIterator &rhs) {
+    return lhs.first_ == rhs.first_;
+  }
+
+  QueryIterator &operator++() {
+    do {
+      ++first_;
+    } while (first_ != SourceEnd() && !enumerable_->FirstFn()(*current_, *first_));
+    if (first_ != SourceEnd())
+      current_.Assign(*first_);
+    return *this;
+  }
+
+  QueryIterator operator++(int) {
+    QueryIterator previous(*this);
+    ++*this;
+    return previous;
+  }
+
+  // See SourceSentinel.
+  bool IsPastTheEnd() const {
+    return first_ == SourceEnd();
+  }
+
+  // The size is bounded by the one of the source.
+  static SizeHint GetSizeHint(Enumerable *enumerable) {
+    return SourceSizeHint(enumerable->SourceFront()).UpperBound();
+  }
+
+  // See Enumerable::ForEach.
+  template <class Sink>
+  static bool ForEach(Enumerable *enumerable, Sink &sink) {
+    MergedElement<value_type, is_aliasing> previous;
+    return SourceForEach(enumerable->SourceFront(), [enumerable, &previous, &sink](auto &&element) {
+      if (previous.HasValue() && !enumerable->FirstFn()(*previous, element))
+        return true;
+      previous.Assign(std::forward<decltype(element)>(element));
+      return sink(static_cast<ResultType>(*previous));
+    });
+  }
+
+private:
+  const Sentinel &SourceEnd() const {
+    return *this;
+  }
+
+  Enumerable *enumerable_ = nullptr;
+
+  SourceIterator first_;
+  MergedElement<value_type, is_aliasing> current_;
+};
+
+} // namespace cinq::detail
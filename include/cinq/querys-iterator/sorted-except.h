@@ -0,0 +1,127 @@
+#pragma once
+
+#include <iterator>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+
+#include "../query-category.h"
+#include "../size-hint.h"
+#include "../sorted-merge.h"
+#include "detail/utility.h"
+#include "query-iterator-fwd.h"
+
+namespace cinq::detail {
+// Except over sources sorted in the order of TFn (see Cinq::AssumeSorted), without internal storage.
+// Each distinct element of the first source is yielded unless an excluded source has an equivalent one: the excluded sources gallop
+//   to the first element which isn't ordered before it (see GallopPast).
+template <bool ArgConstness, bool RetConstness, class TFn, class TSource, class... TExcluded>
+class QueryIterator<ArgConstness, RetConstness, BasicEnumerable<QueryCategory::SortedExcept, std::tuple<TFn>, TSource, TExcluded...>> {
+public:
+  using Enumerable = BasicEnumerable<QueryCategory::SortedExcept, std::tuple<TFn>, TSource, TExcluded...>;
+  using IteratorTuple = typename Enumerable::IteratorTuple;
+
+  using SourceIterator = typename Enumerable::template SourceIterator<0>;
+  using SourceIteratorYieldType = decltype(*std::declval<SourceIterator>());
+
+  // Whether the yielded element refers to the one of the first source, otherwise it's a copy. See MergedElement.
+  static constexpr bool is_aliasing = std::is_reference_v<SourceIteratorYieldType> && yields_stable_references<TSource>::value;
+
+  using value_type = std::decay_t<SourceIteratorYieldType>;
+  using ResultType = std::conditional_t<is_aliasing,
+      cinq::utility::transform_to_result_type_t<RetConstness, SourceIteratorYieldType, cinq::utility::SourceType::InternalStorage>,
+      value_type
+    >;
+
+  QueryIterator() {}
+
+  QueryIterator(Enumerable *enumerable, bool is_past_the_end_iteratorator)
+    : enumerable_(enumerable),
+      firsts_(is_past_the_end_iteratorator ? Ends(enumerable) : Begins(enumerable)),
+      lasts_(Ends(enumerable)) {
+    FindNextValid();
+  }
+
+  QueryIterator(const QueryIterator &) = default;
+  QueryIterator(QueryIterator &&) = default;
+
+  QueryIterator &operator=(const QueryIterator &) = default;
+  QueryIterator &operator=(QueryIterator &&) = default;
+
+  ResultType operator*() const {
+    return *current_;
+  }
+
+  // The excluded sources are at the positions determined by the one of the first source.
+  friend bool operator!=(const QueryIterator &lhs, const QueryIterator &rhs) {
+    return std::get<0>(lhs.firsts_) != std::get<0>(rhs.firsts_);
+  }
+
+  friend bool operator==(const QueryIterator &lhs, const QueryIterator &rhs) {
+    return std::get<0>(lhs.firsts_) == std::get<0>(rhs.firsts_);
+  }
+
+  QueryIterator &operator++() {
+    SkipCurrent();
+    FindNextValid();
+    return *this;
+  }
+
+  QueryIterator operator++(int) {
+    QueryIterator previous(*this);
+    ++*this;
+    return previous;
+  }
+
+  // See SourceSentinel.
+  bool IsPastTheEnd() const {
+    return std::get<0>(firsts_) == std::get<0>(lasts_);
+  }
+
+  // The size is bounded by the one of the first source.
+  static SizeHint GetSizeHint(Enumerable *enumerable) {
+    return SourceSizeHint(enumerable->SourceFront()).UpperBound();
+  }
+
+private:
+  static IteratorTuple Begins(Enumerable *enumerable) {
+    return std::apply([](auto &... sources) { return IteratorTuple(std::begin(sources)...); }, enumerable->GetSourceTuple());
+  }
+
+  static IteratorTuple Ends(Enumerable *enumerable) {
+    return std::apply([](auto &... sources) { return IteratorTuple(std::end(sources)...); }, enumerable->GetSourceTuple());
+  }
+
+  // Steps the first source past the elements equivalent to the current one.
+  void SkipCurrent() {
+    auto &compare = enumerable_->FirstFn();
+    GallopPast(std::get<0>(firsts_), std::get<0>(lasts_), [this, &compare](const auto &element) { return !compare(*current_, element); });
+  }
+
+  void FindNextValid() {
+    while (!IsPastTheEnd()) {
+      current_.Assign(*std::get<0>(firsts_));
+      if (!IsExcluded(std::make_index_sequence<sizeof...(TExcluded)>()))
+        return;
+      SkipCurrent();
+    }
+  }
+
+  template <size_t... index>
+  bool IsExcluded(std::index_sequence<index...>) {
+    auto &compare = enumerable_->FirstFn();
+    auto contains = [this, &compare](auto &first, const auto &last) {
+      GallopPast(first, last, [this, &compare](const auto &element) { return compare(element, *current_); });
+      return first != last && !compare(*current_, *first);
+    };
+    return (contains(std::get<index + 1>(firsts_), std::get<index + 1>(lasts_)) || ...);
+  }
+
+  Enumerable *enumerable_ = nullptr;
+
+  IteratorTuple firsts_;
+  IteratorTuple lasts_;
+  MergedElement<value_type, is_aliasing> current_;
+};
+
+} // namespace cinq::detail
@@ -0,0 +1,143 @@
+#pragma once
+
+#include <iterator>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+
+#include "../query-category.h"
+#include "../size-hint.h"
+#include "../sorted-merge.h"
+#include "detail/utility.h"
+#include "query-iterator-fwd.h"
+
+namespace cinq::detail {
+// Intersect over sources sorted in the order of TFn (see Cinq::AssumeSorted), without internal storage.
+// The candidate is the greatest element seen so far: each source gallops to the first element which isn't ordered before it (see
+//   GallopPast), and the candidate is raised to it if it's ordered after. The candidate is yielded once every source is at an equivalent
+//   element, and the first source steps past it. The duplicates of the sources are skipped.
+template <bool ArgConstness, bool RetConstness, class TFn, class... TSources>
+class QueryIterator<ArgConstness, RetConstness, BasicEnumerable<QueryCategory::SortedIntersect, std::tuple<TFn>, TSources...>> {
+public:
+  using Enumerable = BasicEnumerable<QueryCategory::SortedIntersect, std::tuple<TFn>, TSources...>;
+  using IteratorTuple = typename Enumerable::IteratorTuple;
+
+  using CommonType = typename Enumerable::AdjustedCommonType;
+
+  // Whether the yielded element refers to the ones of the sources, otherwise it's a copy. See MergedElement.
+  static constexpr bool is_aliasing = Enumerable::is_all_reference_to_same && (yields_stable_references<TSources>::value && ...);
+
+  using value_type = std::decay_t<CommonType>;
+  using ResultType = std::conditional_t<is_aliasing,
+      cinq::utility::transform_to_result_type_t<RetConstness, CommonType, cinq::utility::SourceType::InternalStorage>,
+      value_type
+    >;
+
+  QueryIterator() {}
+
+  QueryIterator(Enumerable *enumerable, bool is_past_the_end_iteratorator)
+    : enumerable_(enumerable),
+      firsts_(is_past_the_end_iteratorator ? Ends(enumerable) : Begins(enumerable)),
+      lasts_(Ends(enumerable)) {
+    if (IsPastTheEnd()) {
+      firsts_ = lasts_;
+    } else {
+      candidate_.Assign(*std::get<0>(firsts_));
+      FindNextValid();
+    }
+  }
+
+  QueryIterator(const QueryIterator &) = default;
+  QueryIterator(QueryIterator &&) = default;
+
+  QueryIterator &operator=(const QueryIterator &) = default;
+  QueryIterator &operator=(QueryIterator &&) = default;
+
+  ResultType operator*() const {
+    return *candidate_;
+  }
+
+  friend bool operator!=(const QueryIterator &lhs, const QueryIterator &rhs) {
+    return lhs.firsts_ != rhs.firsts_;
+  }
+
+  friend bool operator==(const QueryIterator &lhs, const QueryIterator &rhs) {
+    return lhs.firsts_ == rhs.firsts_;
+  }
+
+  QueryIterator &operator++() {
+    auto &first = std::get<0>(firsts_);
+    GallopPast(first, std::get<0>(lasts_), [this](const auto &element) { return !enumerable_->FirstFn()(*candidate_, element); });
+    if (first == std::get<0>(lasts_)) {
+      firsts_ = lasts_;
+    } else {
+      candidate_.Assign(*first);
+      FindNextValid();
+    }
+    return *this;
+  }
+
+  QueryIterator operator++(int) {
+    QueryIterator previous(*this);
+    ++*this;
+    return previous;
+  }
+
+  // See SourceSentinel. Every source is past the end once the intersection is.
+  bool IsPastTheEnd() const {
+    return std::get<0>(firsts_) == std::get<0>(lasts_);
+  }
+
+  // The size is bounded by the smallest one of the sources.
+  static SizeHint GetSizeHint(Enumerable *enumerable) {
+    return std::apply([](auto &source, auto &... rest) {
+        SizeHint hint = SourceSizeHint(source).UpperBound();
+        ((hint = Min(hint, SourceSizeHint(rest))), ...);
+        return hint;
+      }, enumerable->GetSourceTuple());
+  }
+
+private:
+  static IteratorTuple Begins(Enumerable *enumerable) {
+    return std::apply([](auto &... sources) { return IteratorTuple(std::begin(sources)...); }, enumerable->GetSourceTuple());
+  }
+
+  static IteratorTuple Ends(Enumerable *enumerable) {
+    return std::apply([](auto &... sources) { return IteratorTuple(std::end(sources)...); }, enumerable->GetSourceTuple());
+  }
+
+  // Raises the candidate until every source is at an equivalent element, or one of them is past the end.
+  void FindNextValid() {
+    FindNextValid(std::index_sequence_for<TSources...>());
+  }
+
+  template <size_t... index>
+  void FindNextValid(std::index_sequence<index...>) {
+    auto &compare = enumerable_->FirstFn();
+    for (bool is_raised = true; is_raised; ) {
+      is_raised = false;
+      auto leapfrog = [this, &compare, &is_raised](auto &first, const auto &last) {
+        GallopPast(first, last, [this, &compare](const auto &element) { return compare(element, *candidate_); });
+        if (first == last)
+          return false;
+        if (compare(*candidate_, *first)) {
+          candidate_.Assign(*first);
+          is_raised = true;
+        }
+        return true;
+      };
+      if (!(leapfrog(std::get<index>(firsts_), std::get<index>(lasts_)) && ...)) {
+        firsts_ = lasts_;
+        return;
+      }
+    }
+  }
+
+  Enumerable *enumerable_ = nullptr;
+
+  IteratorTuple firsts_;
+  IteratorTuple lasts_;
+  MergedElement<value_type, is_aliasing> candidate_;
+};
+
+} // namespace cinq::detail
@@ -0,0 +1,120 @@
+#pragma once
+
+#include <iterator>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+
+#include "../query-category.h"
+#include "../size-hint.h"
+#include "../sorted-merge.h"
+#include "detail/utility.h"
+#include "query-iterator-fwd.h"
+
+namespace cinq::detail {
+// Union over sources sorted in the order of TFn (see Cinq::AssumeSorted), by a k-way merge without internal storage.
+// The smallest element of the heads of the sources is yielded, then every source gallops past the elements equivalent to it (see
+//   GallopPast), so the duplicates of the sources are skipped too. The elements are yielded in sorted order.
+template <bool ArgConstness, bool RetConstness, class TFn, class... TSources>
+class QueryIterator<ArgConstness, RetConstness, BasicEnumerable<QueryCategory::SortedUnion, std::tuple<TFn>, TSources...>> {
+public:
+  using Enumerable = BasicEnumerable<QueryCategory::SortedUnion, std::tuple<TFn>, TSources...>;
+  using IteratorTuple = typename Enumerable::IteratorTuple;
+
+  using CommonType = typename Enumerable::AdjustedCommonType;
+
+  // Whether the yielded element refers to the ones of the sources, otherwise it's a copy. See MergedElement.
+  static constexpr bool is_aliasing = Enumerable::is_all_reference_to_same && (yields_stable_references<TSources>::value && ...);
+
+  using value_type = std::decay_t<CommonType>;
+  using ResultType = std::conditional_t<is_aliasing,
+      cinq::utility::transform_to_result_type_t<RetConstness, CommonType, cinq::utility::SourceType::InternalStorage>,
+      value_type
+    >;
+
+  QueryIterator() {}
+
+  QueryIterator(Enumerable *enumerable, bool is_past_the_end_iteratorator)
+    : enumerable_(enumerable),
+      firsts_(is_past_the_end_iteratorator ? Ends(enumerable) : Begins(enumerable)),
+      lasts_(Ends(enumerable)) {
+    FindSmallest(std::index_sequence_for<TSources...>());
+  }
+
+  QueryIterator(const QueryIterator &) = default;
+  QueryIterator(QueryIterator &&) = default;
+
+  QueryIterator &operator=(const QueryIterator &) = default;
+  QueryIterator &operator=(QueryIterator &&) = default;
+
+  ResultType operator*() const {
+    return *current_;
+  }
+
+  friend bool operator!=(const QueryIterator &lhs, const QueryIterator &rhs) {
+    return lhs.firsts_ != rhs.firsts_;
+  }
+
+  friend bool operator==(const QueryIterator &lhs, const QueryIterator &rhs) {
+    return lhs.firsts_ == rhs.firsts_;
+  }
+
+  QueryIterator &operator++() {
+    SkipCurrent(std::index_sequence_for<TSources...>());
+    FindSmallest(std::index_sequence_for<TSources...>());
+    return *this;
+  }
+
+  QueryIterator operator++(int) {
+    QueryIterator previous(*this);
+    ++*this;
+    return previous;
+  }
+
+  // See SourceSentinel.
+  bool IsPastTheEnd() const {
+    return !current_.HasValue();
+  }
+
+  // The size is bounded by the sum of the ones of the sources.
+  static SizeHint GetSizeHint(Enumerable *enumerable) {
+    return std::apply([](auto &... sources) { return (SourceSizeHint(sources) + ...); }, enumerable->GetSourceTuple()).UpperBound();
+  }
+
+private:
+  static IteratorTuple Begins(Enumerable *enumerable) {
+    return std::apply([](auto &... sources) { return IteratorTuple(std::begin(sources)...); }, enumerable->GetSourceTuple());
+  }
+
+  static IteratorTuple Ends(Enumerable *enumerable) {
+    return std::apply([](auto &... sources) { return IteratorTuple(std::end(sources)...); }, enumerable->GetSourceTuple());
+  }
+
+  template <size_t... index>
+  void FindSmallest(std::index_sequence<index...>) {
+    auto &compare = enumerable_->FirstFn();
+    current_.Reset();
+    auto find = [this, &compare](auto &first, const auto &last) {
+      if (first != last && (!current_.HasValue() || compare(*first, *current_)))
+        current_.Assign(*first);
+    };
+    (find(std::get<index>(firsts_), std::get<index>(lasts_)), ...);
+  }
+
+  template <size_t... index>
+  void SkipCurrent(std::index_sequence<index...>) {
+    auto &compare = enumerable_->FirstFn();
+    auto skip = [this, &compare](auto &first, const auto &last) {
+      GallopPast(first, last, [this, &compare](const auto &element) { return !compare(*current_, element); });
+    };
+    (skip(std::get<index>(firsts_), std::get<index>(lasts_)), ...);
+  }
+
+  Enumerable *enumerable_ = nullptr;
+
+  IteratorTuple firsts_;
+  IteratorTuple lasts_;
+  MergedElement<value_type, is_aliasing> current_;
+};
+
+} // namespace cinq::detail
@@ -0,0 +1,109 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <iterator>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+
+#include "../query-category.h"
+#include "detail/utility.h"
+#include "query-iterator-fwd.h"
+#include "../size-hint.h"
+#include "../source-sentinel.h"
+
+namespace cinq::detail {
+// The first count elements of the source. The source isn't incremented past the last one, so that the elements following it aren't
+//   evaluated. An OrderBy followed by Take keeps the elements itself, see Cinq::Take.
+template <bool ArgConstness, bool RetConstness, class TSource>
+class QueryIterator<ArgConstness, RetConstness, BasicEnumerable<QueryCategory::Take, std::tuple<size_t>, TSource>>
+  : private SourceSentinel<typename BasicEnumerable<QueryCategory::Take, std::tuple<size_t>, TSource>::template SourceIterator<0>> {
+public:
+  using Enumerable = BasicEnumerable<QueryCategory::Take, std::tuple<size_t>, TSource>;
+
+  using SourceIterator = typename Enumerable::template SourceIterator<0>;
+  using SourceIteratorYieldType = decltype(*std::declval<SourceIterator>());
+  using Sentinel = SourceSentinel<SourceIterator>;
+
+  using ResultType = cinq::utility::transform_to_result_type_t<RetConstness, SourceIteratorYieldType, cinq::utility::SourceType::Iterator>;
+  using value_type = std::decay_t<ResultType>;
+
+  QueryIterator() : first_() {}
+
+  QueryIterator(Enumerable *enumerable, bool is_past_the_end_iteratorator)
+    : Sentinel(std::end(enumerable->SourceFront())),
+      first_(is_past_the_end_iteratorator ? std::end(enumerable->SourceFront()) : std::begin(enumerable->SourceFront())),
+      remaining_(is_past_the_end_iteratorator ? 0 : enumerable->FirstFn()) {}
+
+  QueryIterator(const QueryIterator &) = default;
+  QueryIterator(QueryIterator &&) = default;
+
+  QueryIterator &operator=(const QueryIterator &) = default;
+  QueryIterator &operator=(QueryIterator &&) = default;
+
+  ResultType operator*() const {
+    return *first_;
+  }
+
+  friend bool operator!=(const QueryIterator &lhs, const QueryIterator &rhs) {
+    return !(lhs == rhs);
+  }
+
+  friend bool operator==(const QueryIterator &lhs, const QueryIterator &rhs) {
+    if (lhs.IsPastTheEnd() || rhs.IsPastTheEnd())
+      return lhs.IsPastTheEnd() && rhs.IsPastTheEnd();
+    return lhs.first_ == rhs.first_;
+  }
+
+  QueryIterator &operator++() {
+    if (--remaining_ != 0)
+      ++first_;
+    return *this;
+  }
+
+  QueryIterator operator++(int) {
+    QueryIterator previous(*this);
+    ++*this;
+    return previous;
+  }
+
+  // See SourceSentinel.
+  bool IsPastTheEnd() const {
+    return remaining_ == 0 || first_ == SourceEnd();
+  }
+
+  // The size is the one of the source, bounded by count.
+  static SizeHint GetSizeHint(Enumerable *enumerable) {
+    SizeHint hint = SourceSizeHint(enumerable->SourceFront());
+    return {std::min(hint.size, enumerable->FirstFn()), hint.is_exact};
+  }
+
+  // See Enumerable::ForEach. The source stops once count elements are pushed.
+  template <class Sink>
+  static bool ForEach(Enumerable *enumerable, Sink &sink) {
+    size_t remaining = enumerable->FirstFn();
+    if (remaining == 0)
+      return true;
+
+    bool is_completed = true;
+    SourceForEach(enumerable->SourceFront(), [&remaining, &sink, &is_completed](auto &&element) {
+      if (!sink(static_cast<ResultType>(std::forward<decltype(element)>(element)))) {
+        is_completed = false;
+        return false;
+      }
+      return --remaining != 0;
+    });
+    return is_completed;
+  }
+
+private:
+  const Sentinel &SourceEnd() const {
+    return *this;
+  }
+
+  SourceIterator first_;
+  size_t remaining_ = 0;
+};
+
+} // namespace cinq::detail
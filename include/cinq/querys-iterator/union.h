@@ -1,88 +1,90 @@
 #pragma once
 
 #include <iterator>
-#include <set>
 #include <tuple>
 #include <type_traits>
-#include <unordered_set>
 #include <utility>
 
+#include "../flat-hash-table.h"
 #include "../multi-enumerables-visitor.h"
 #include "../query-category.h"
+#include "../shared-storage.h"
 #include "detail/concept.h"
 #include "detail/utility.h"
 #include "query-iterator-fwd.h"
+#include "../size-hint.h"
 
 namespace cinq::detail {
+// Passed as the last argument of Union, to allow yielding the elements in an unspecified order. See cinq::unordered.
+struct UnorderedTag {};
+
+// The set of the union query iterators, into which each element of the sources is inserted once. It aliases the elements if
+//   is_aliasing, otherwise it copies them.
+template <class TValue, bool is_aliasing, bool is_all_reference_to_same>
+struct UnionStorage {
+  using value_type = TValue;
+  using InternalStorageType = std::conditional_t<is_aliasing, cinq::utility::ReferenceWrapper<value_type>, value_type>;
+  using SetType = SetOperationSet<value_type, is_aliasing>;
+
+  template <class T>
+  static auto Insert(SetType &values, T &&x) {
+    if constexpr (std::is_convertible_v<T &&, value_type>) {
+      if constexpr (is_all_reference_to_same)
+        return values.insert(x);
+      else
+        return values.insert(std::forward<T>(x));
+    } else {
+      return values.insert(static_cast<const value_type &>(std::forward<T>(x)));
+    }
+  }
+
+  // Calls sink with each element inserted into values, the sources being enumerated one after another, until it returns false.
+  //   Returns whether it never did.
+  template <class TSources, class Sink>
+  static bool ForEach(TSources &sources, SetType &values, Sink &&sink) {
+    return std::apply([&values, &sink](auto &... sources) {
+        return (SourceForEach(sources, [&values, &sink](auto &&x) {
+            auto [position, succeed] = Insert(values, std::forward<decltype(x)>(x));
+            return !succeed || sink(*position);
+          }) && ...);
+      }, sources);
+  }
+};
+
+// The distinct elements of the sources, in the order of their first occurrence in the concatenation of the sources. Each source is
+//   enumerated in turn, and its elements are inserted into a single set.
 template <bool ArgConstness, bool RetConstness, class TFn, class... TSources>
 class QueryIterator<ArgConstness, RetConstness, BasicEnumerable<QueryCategory::Union, std::tuple<TFn>, TSources...>>
-  : public MultiVisitorSetIterator<RoundRobinIteratorTupleVisitor, ArgConstness, QueryCategory::Union, std::tuple<TFn>, TSources...> {
+  : public MultiVisitorSetIterator<IteratorTupleVisitor, ArgConstness, QueryCategory::Union, std::tuple<TFn>, TSources...> {
 public:
-  using Base = MultiVisitorSetIterator<RoundRobinIteratorTupleVisitor, ArgConstness, QueryCategory::Union, std::tuple<TFn>, TSources...>;
+  using Base = MultiVisitorSetIterator<IteratorTupleVisitor, ArgConstness, QueryCategory::Union, std::tuple<TFn>, TSources...>;
+  using Enumerable = typename Base::Enumerable;
 
   using CommonType = typename Base::AdjustedCommonType;
   using ResultType = cinq::utility::transform_to_result_type_t<RetConstness, CommonType, cinq::utility::SourceType::InternalStorage>;
   using value_type = typename std::decay_t<ResultType>;
 
+  // Whether the internal storage aliases the elements of the sources, otherwise it copies them. See yields_stable_references.
+  static constexpr bool is_aliasing = Enumerable::is_all_reference_to_same && (yields_stable_references<TSources>::value && ...);
+
+  using Storage = UnionStorage<value_type, is_aliasing, Enumerable::is_all_reference_to_same>;
+
   QueryIterator() {}
 
-  QueryIterator(typename Base::Enumerable *enumerable, bool is_past_the_end_iteratorator)
+  QueryIterator(Enumerable *enumerable, bool is_past_the_end_iteratorator)
     : Base(enumerable, is_past_the_end_iteratorator) {
-    if (!is_past_the_end_iteratorator && Base::visitor.IsValid()) {
-      // push the first element
-      Base::visitor.Visit([this](auto &&x) {
-        bool succeed = false;
-        if constexpr (std::is_convertible_v<decltype(x), value_type>) {
-          if constexpr (Base::is_all_reference_to_same)
-            std::tie(current_, succeed) = values_.insert(x);
-          else
-            std::tie(current_, succeed) = values_.insert(std::forward<decltype(x)>(x));
-        } else {
-          std::tie(current_, succeed) = values_.insert(static_cast<const value_type &>(std::forward<decltype(x)>(x)));
-        }
-      });
-    }
+    if (!is_past_the_end_iteratorator && Base::visitor.IsValid())
+      Insert();
   }
 
-  QueryIterator(const QueryIterator &rhs)
-    : Base(rhs), values_(rhs.values_), current_(rhs.current_ == rhs.values_.end() ? values_.end() : values_.find(*rhs.current_)) {}
-
-  QueryIterator(QueryIterator &&rhs) : Base(std::move(rhs)) {
-    if (rhs.current_ == rhs.values_.end()) {
-      values_ = std::move(rhs.values_);
-      current_ = values_.end();
-    } else {
-      auto node = rhs.values_.extract(rhs.current_);
-      values_ = std::move(rhs.values_);
-      current_ = values_.insert(std::move(node)).position;
-    }
-  }
+  QueryIterator(const QueryIterator &) = default;
+  QueryIterator(QueryIterator &&) = default;
 
-  QueryIterator &operator=(const QueryIterator &rhs) {
-    Base::operator=(rhs);
-    values_ = rhs.values_;
-    if (rhs.current_ == rhs.values_.end())
-      current_ = values_.end();
-    else
-      current_ = values_.find(*rhs.current_);
-    return *this;
-  }
-
-  QueryIterator &operator=(QueryIterator &&rhs) {
-    Base::operator=(std::move(rhs));
-    if (rhs.current_ == rhs.values_.end()) {
-      values_ = std::move(rhs.values_);
-      current_ = values_.end();
-    } else {
-      auto node = rhs.values_.extract(rhs.current_);
-      values_ = std::move(rhs.values_);
-      current_ = values_.insert(std::move(node)).position;
-    }
-    return *this;
-  }
+  QueryIterator &operator=(const QueryIterator &) = default;
+  QueryIterator &operator=(QueryIterator &&) = default;
 
   ResultType operator*() const {
-    return *current_;
+    return *values_;
   }
 
   QueryIterator &operator++() {
@@ -96,39 +98,37 @@ public:
     return previous;
   }
 
-protected:
-  void FindNextValid() override {
-    cinq::utility::CinqAssert(!Base::is_past_the_end_iteratorator_);
+  // The size is bounded by the sum of the ones of the sources.
+  static SizeHint GetSizeHint(Enumerable *enumerable) {
+    return std::apply([](auto &... sources) { return (SourceSizeHint(sources) + ...); }, enumerable->GetSourceTuple()).UpperBound();
+  }
 
-    bool succeed = false;
-    for (;;) {
-      if (!Base::visitor.MoveToNext(Base::enumerable_->GetSourceTuple()))
-        break;
-
-      Base::visitor.Visit([this, &succeed](auto &&x) {
-        if constexpr (std::is_convertible_v<decltype(x), value_type>) {
-          if constexpr (Base::is_all_reference_to_same)
-            std::tie(current_, succeed) = values_.insert(x);
-          else
-            std::tie(current_, succeed) = values_.insert(std::forward<decltype(x)>(x));
-        } else {
-          std::tie(current_, succeed) = values_.insert(static_cast<const value_type &>(std::forward<decltype(x)>(x)));
-        }
+  // See Enumerable::ForEach.
+  template <class Sink>
+  static bool ForEach(Enumerable *enumerable, Sink &sink) {
+    typename Storage::SetType values;
+    return Storage::ForEach(enumerable->GetSourceTuple(), values, [&sink](const typename Storage::InternalStorageType &element) {
+        return sink(static_cast<ResultType>(element));
       });
-
-      if (succeed)
-        break;
-    }
   }
 
-  using InternalStorageType = std::conditional_t<Base::is_all_reference_to_same,
-    cinq::utility::ReferenceWrapper<value_type>, value_type>;
+protected:
+  void FindNextValid() {
+    cinq::utility::CinqAssert(!Base::is_past_the_end_iteratorator_);
+
+    while (Base::visitor.MoveToNext(Base::enumerable_->GetSourceTuple()) && !Insert()) {}
+  }
 
-  using SetType = std::conditional_t< cinq::utility::ReferenceWrapper<value_type>::hash_version,
-    std::unordered_set<InternalStorageType>, std::set<InternalStorageType>>;
+  // Inserts the current element of the visitor, returns whether it wasn't found.
+  bool Insert() {
+    return Base::visitor.Visit([this](auto &&x) {
+        auto [position, succeed] = Storage::Insert(values_.Mutable(), std::forward<decltype(x)>(x));
+        values_.SetCurrent(position);
+        return succeed;
+      });
+  }
 
-  SetType values_;
-  typename SetType::iterator current_ = values_.end();
+  SharedStorage<typename Storage::SetType> values_;
 };
 
 } // namespace cinq::detail
@@ -1,5 +1,7 @@
 #pragma once
 
+#include <cstddef>
+#include <cstdint>
 #include <iterator>
 #include <tuple>
 #include <type_traits>
@@ -9,15 +11,22 @@
 #include "detail/concept.h"
 #include "detail/utility.h"
 #include "query-iterator-fwd.h"
+#include "../batch.h"
+#include "../comparison-predicates.h"
+#include "../size-hint.h"
+#include "../source-sentinel.h"
+#include "../splittable-ranges.h"
 
 namespace cinq::detail {
 template <bool ArgConstness, bool RetConstness, class TFn, class TSource>
-class QueryIterator<ArgConstness, RetConstness, BasicEnumerable<QueryCategory::Where, std::tuple<TFn>, TSource>> {
+class QueryIterator<ArgConstness, RetConstness, BasicEnumerable<QueryCategory::Where, std::tuple<TFn>, TSource>>
+  : private SourceSentinel<typename BasicEnumerable<QueryCategory::Where, std::tuple<TFn>, TSource>::template SourceIterator<0>> {
 public:
   using Enumerable = BasicEnumerable<QueryCategory::Where, std::tuple<TFn>, TSource>;
 
   using SourceIterator = typename Enumerable::template SourceIterator<0>;
   using SourceIteratorYieldType = decltype(*std::declval<SourceIterator>());
+  using Sentinel = SourceSentinel<SourceIterator>;
 
   using FunctionObjectArgumentType = cinq::utility::transform_to_function_object_argument_t<ArgConstness, SourceIteratorYieldType>;
 
@@ -26,10 +35,13 @@ public:
 
   static_assert(concept::PredicateCheck<TFn, FunctionObjectArgumentType>(), "Bad predicate");
 
-  QueryIterator() : first_(), last_() {}
+  // Whether dense batches are filtered by the vectorized kernels (see simd::FilterBatch), which makes batched evaluation preferred.
+  static constexpr bool has_vectorized_predicate = is_vectorizable_predicate_v<TFn, std::decay_t<SourceIteratorYieldType>>;
+
+  QueryIterator() : first_() {}
 
   QueryIterator(Enumerable *enumerable, bool is_past_the_end_iteratorator)
-    : enumerable_(enumerable), is_past_the_end_iteratorator_(is_past_the_end_iteratorator) {
+    : Sentinel(std::end(enumerable->SourceFront())), enumerable_(enumerable), is_past_the_end_iteratorator_(is_past_the_end_iteratorator) {
     FindNextValideElement();
   }
 
@@ -64,9 +76,73 @@ public:
     return previous;
   }
 
+  // See SourceSentinel.
+  bool IsPastTheEnd() const {
+    return first_ == SourceEnd();
+  }
+
+  // The size is bounded by the one of the source.
+  static SizeHint GetSizeHint(Enumerable *enumerable) {
+    return SourceSizeHint(enumerable->SourceFront()).UpperBound();
+  }
+
+  // Passes an element of the source to sink if it satisfies the predicate, and returns what sink returns (or true if it doesn't).
+  //   The predicate mustn't consume the element, which is still passed to sink afterward.
+  template <class TElement, class Sink>
+  static bool Push(Enumerable *enumerable, TElement &&element, Sink &sink) {
+    if (!cinq::utility::InvokeWithoutConsuming<FunctionObjectArgumentType>(enumerable->FirstFn(), element))
+      return true;
+    return sink(static_cast<ResultType>(std::forward<TElement>(element)));
+  }
+
+  // See Enumerable::ForEach.
+  template <class Sink>
+  static bool ForEach(Enumerable *enumerable, Sink &sink) {
+    return SourceForEach(enumerable->SourceFront(), [enumerable, &sink](auto &&element) {
+      return Push(enumerable, std::forward<decltype(element)>(element), sink);
+    });
+  }
+
+  // See is_batch_evaluable. The batches share the elements of the batches of the source, with a new selection vector.
+  template <class BatchSink>
+  static bool ForEachBatch(Enumerable *enumerable, BatchSink &batch_sink) {
+    std::uint32_t selection[batch_size];
+    return SourceForEachBatch(enumerable->SourceFront(), [enumerable, &batch_sink, &selection](const auto &batch) {
+      size_t size = 0;
+      if constexpr (has_vectorized_predicate) {
+        if (!batch.selection)
+          size = simd::FilterBatch(enumerable->FirstFn(), batch.elements, batch.size, selection);
+        else
+          size = BuildSelectionVector(batch, selection, enumerable->FirstFn());
+      } else {
+        size = BuildSelectionVector(batch, selection, [enumerable](auto &element) {
+          return cinq::utility::InvokeWithoutConsuming<FunctionObjectArgumentType>(enumerable->FirstFn(), element);
+        });
+      }
+      if (size == 0)
+        return true;
+      return batch_sink(std::decay_t<decltype(batch)>{batch.elements, selection, size});
+    });
+  }
+
+  // See is_range_splittable.
+  static auto MakeRanges(Enumerable *enumerable) {
+    auto source_ranges = MakeSourceRanges(enumerable->SourceFront());
+    auto size = source_ranges.Size();
+    return SplittableRanges(size, [enumerable, source_ranges = std::move(source_ranges)](size_t first, size_t last, auto &sink) {
+      return source_ranges.ForEachInRange(first, last, [enumerable, &sink](auto &&element) {
+        return Push(enumerable, std::forward<decltype(element)>(element), sink);
+      });
+    });
+  }
+
 private:
+  const Sentinel &SourceEnd() const {
+    return *this;
+  }
+
   void FindNextValideElement() {
-    while (first_ != last_ && !enumerable_->FirstFn()(static_cast<FunctionObjectArgumentType>(*first_)))
+    while (first_ != SourceEnd() && !enumerable_->FirstFn()(static_cast<FunctionObjectArgumentType>(*first_)))
       ++first_;
   }
 
@@ -75,7 +151,6 @@ private:
   bool is_past_the_end_iteratorator_ = false;
 
   SourceIterator first_ = is_past_the_end_iteratorator_ ? std::end(enumerable_->SourceFront()) : std::begin(enumerable_->SourceFront());
-  SourceIterator last_ = std::end(enumerable_->SourceFront());
 };
 
 } // namespace cinq::detail
@@ -0,0 +1,138 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace cinq::detail {
+// The unsigned integer whose order is the one of the keys of type T by operator<, so that they can be radix sorted, see RadixSort.
+// Integers flip their sign bit, and floating point values flip their sign bit if they're positive or all their bits if they're negative
+//   (-0.0 is mapped as 0.0, which it's equivalent to). The strings are mapped to their first 8 characters in big-endian order, which is
+//   only a prefix of the key: the keys of equal bits must still be compared.
+template <class T, class = void>
+struct RadixKey {
+  static constexpr bool is_sortable = false;
+};
+
+template <class T>
+struct RadixKey<T, std::enable_if_t<std::is_integral_v<T> && !std::is_same_v<T, bool>>> {
+  static constexpr bool is_sortable = true;
+  static constexpr bool is_prefix = false;
+  using Bits = std::conditional_t<sizeof(T) <= sizeof(std::uint32_t), std::uint32_t, std::uint64_t>;
+
+  static Bits ToBits(T value) {
+    auto bits = static_cast<Bits>(static_cast<std::make_unsigned_t<T>>(value));
+    if constexpr (std::is_signed_v<T>)
+      bits ^= Bits(1) << (sizeof(T) * 8 - 1);
+    return bits;
+  }
+};
+
+template <class T>
+struct RadixKey<T, std::enable_if_t<std::is_same_v<T, float> || std::is_same_v<T, double>>> {
+  static constexpr bool is_sortable = true;
+  static constexpr bool is_prefix = false;
+  using Bits = std::conditional_t<std::is_same_v<T, float>, std::uint32_t, std::uint64_t>;
+
+  static Bits ToBits(T value) {
+    static_assert(sizeof(T) == sizeof(Bits));
+    if (value == 0)
+      value = 0;
+    Bits bits;
+    std::memcpy(&bits, &value, sizeof(bits));
+    constexpr Bits sign = Bits(1) << (sizeof(Bits) * 8 - 1);
+    return bits & sign ? ~bits : bits | sign;
+  }
+};
+
+// The characters are compared as unsigned char, as std::char_traits<char> does.
+template <class T>
+struct RadixKey<T, std::enable_if_t<std::is_same_v<T, std::string> || std::is_same_v<T, std::string_view>>> {
+  static constexpr bool is_sortable = true;
+  static constexpr bool is_prefix = true;
+  using Bits = std::uint64_t;
+
+  static Bits ToBits(std::string_view value) {
+    Bits bits = 0;
+    for (size_t i = 0; i < sizeof(Bits); ++i) {
+      bits <<= 8;
+      if (i < value.size())
+        bits |= static_cast<unsigned char>(value[i]);
+    }
+    return bits;
+  }
+};
+
+// Whether the keys of type TKey ordered by TCompare may be radix sorted, i.e. TCompare is operator< or operator> of them (see RadixKey),
+//   and in which direction.
+template <class TCompare, class TKey>
+struct radix_order {
+  static constexpr bool is_sortable = false;
+  static constexpr bool is_descending = false;
+};
+
+template <class TKey>
+struct radix_order<std::less<>, TKey> {
+  static constexpr bool is_sortable = RadixKey<TKey>::is_sortable;
+  static constexpr bool is_descending = false;
+};
+
+template <class TKey>
+struct radix_order<std::less<TKey>, TKey> : radix_order<std::less<>, TKey> {};
+
+template <class TKey>
+struct radix_order<std::greater<>, TKey> {
+  static constexpr bool is_sortable = RadixKey<TKey>::is_sortable;
+  static constexpr bool is_descending = true;
+};
+
+template <class TKey>
+struct radix_order<std::greater<TKey>, TKey> : radix_order<std::greater<>, TKey> {};
+
+// The bits of a key, and the index of its element.
+template <class Bits>
+struct RadixEntry {
+  Bits bits;
+  size_t index;
+};
+
+// Stably sorts the entries by their bits, with an LSD radix sort of a byte per pass. The histograms of all the bytes are counted in a
+//   single read of the entries, and the passes of the bytes which are the same in all of them are skipped. The passes scatter the
+//   entries back and forth between them and a single scratch buffer.
+template <class Bits>
+void RadixSort(std::vector<RadixEntry<Bits>> &entries) {
+  constexpr size_t digit_count = sizeof(Bits);
+  if (entries.size() < 2)
+    return;
+
+  std::array<std::array<size_t, 256>, digit_count> histograms{};
+  for (const auto &entry : entries) {
+    for (size_t digit = 0; digit < digit_count; ++digit)
+      ++histograms[digit][(entry.bits >> (digit * 8)) & 0xff];
+  }
+
+  std::vector<RadixEntry<Bits>> scratch;
+  for (size_t digit = 0; digit < digit_count; ++digit) {
+    auto &histogram = histograms[digit];
+    if (histogram[(entries.front().bits >> (digit * 8)) & 0xff] == entries.size())
+      continue;
+
+    size_t offset = 0;
+    for (auto &count : histogram)
+      offset += std::exchange(count, offset);
+
+    scratch.resize(entries.size());
+    for (const auto &entry : entries)
+      scratch[histogram[(entry.bits >> (digit * 8)) & 0xff]++] = entry;
+    entries.swap(scratch);
+  }
+}
+
+} // namespace cinq::detail
@@ -0,0 +1,69 @@
+#pragma once
+
+#include <atomic>
+#include <memory>
+#include <type_traits>
+
+namespace cinq::detail {
+// Whether ptr is the only owner of its object, which may then be modified. The fence orders the modification after the last accesses
+//   of the owners which released the object, possibly on other threads.
+template <class T>
+bool IsUniqueOwner(const std::shared_ptr<T> &ptr) {
+  if (ptr.use_count() != 1)
+    return false;
+  std::atomic_thread_fence(std::memory_order_acquire);
+  return true;
+}
+
+// The internal storage of a set operation iterator, and the position of its current element in it.
+// The copies of an iterator share the storage, so that copying an iterator is O(1). A copy modifying the storage while it's shared
+//   copies it first (copy on write), so each copy keeps the content matching its position, and a copy which is never incremented
+//   (e.g. the result of a post-increment) never pays for it. A shared container is never modified, hence the copies of an iterator may
+//   be incremented concurrently.
+// The current element is kept by its address, which a rehash of the container (e.g. the index of a StableFlatHashSet) doesn't
+//   invalidate, unlike an iterator.
+template <class TContainer>
+class SharedStorage {
+public:
+  using iterator = typename TContainer::iterator;
+  using value_type = typename TContainer::value_type;
+
+  auto &operator*() const {
+    return *current_;
+  }
+
+  const value_type *operator->() const {
+    return current_;
+  }
+
+  // Returns the container to be modified, which is copied if it's shared.
+  TContainer &Mutable() {
+    if (!container_) {
+      container_ = std::make_shared<TContainer>();
+    } else if (!IsUniqueOwner(container_)) {
+      auto container = std::make_shared<TContainer>(*container_);
+      if (current_)
+        current_ = &*container->find(KeyOf(*current_));
+      container_ = std::move(container);
+    }
+    return *container_;
+  }
+
+  void SetCurrent(iterator position) {
+    current_ = &*position;
+  }
+
+private:
+  template <class T>
+  static const auto &KeyOf(const T &value) {
+    if constexpr (std::is_same_v<typename TContainer::key_type, typename TContainer::value_type>)
+      return value;
+    else
+      return value.first;
+  }
+
+  std::shared_ptr<TContainer> container_;
+  const value_type *current_ = nullptr;
+};
+
+} // namespace cinq::detail
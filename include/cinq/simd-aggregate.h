@@ -0,0 +1,413 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <type_traits>
+
+#include "simd-filter.h"
+
+namespace cinq::detail::simd {
+// Vectorized reductions used by Sum, Min, Max and Average (see Reduce). Each kernel keeps 4 vector accumulators, so that
+//   consecutive additions don't wait for each other, and combines their lanes at the end.
+// Like the comparison kernels, the instruction set is chosen at runtime.
+enum class ReduceOp { Sum, Min, Max };
+
+// float is summed in double, other types are summed in their promoted type.
+template <class T>
+using sum_type_t = std::conditional_t<std::is_same_v<T, float>, double, decltype(T() + T())>;
+
+template <ReduceOp op, class T>
+using reduce_type_t = std::conditional_t<op == ReduceOp::Sum, sum_type_t<T>, T>;
+
+template <class T>
+bool IsNaN(const T &value) {
+  if constexpr (std::is_floating_point_v<T>)
+    return value != value;
+  else
+    return false;
+}
+
+// Min and Max yield NaN if any element is NaN.
+template <ReduceOp op, class R, class T>
+R Combine(R lhs, const T &rhs) {
+  if constexpr (op == ReduceOp::Sum) {
+    return lhs + rhs;
+  } else {
+    if (IsNaN(rhs))
+      return rhs;
+    if constexpr (op == ReduceOp::Min)
+      return rhs < lhs ? R(rhs) : lhs;
+    else
+      return lhs < rhs ? R(rhs) : lhs;
+  }
+}
+
+// Combines the lanes of the accumulators and the elements left after the last full iteration of a kernel.
+template <ReduceOp op, class R, class T>
+R FinishReduce(const R *lanes, size_t lane_count, const T *tail, size_t tail_size, bool has_nan) {
+  R result = lanes[0];
+  for (size_t i = 1; i < lane_count; ++i)
+    result = Combine<op>(result, lanes[i]);
+  for (size_t i = 0; i < tail_size; ++i)
+    result = Combine<op>(result, tail[i]);
+  if constexpr (op != ReduceOp::Sum && std::is_floating_point_v<R>) {
+    if (has_nan)
+      return std::numeric_limits<R>::quiet_NaN();
+  }
+  return result;
+}
+
+// The scalar kernel, used for the types an instruction set doesn't support (see has_reduce_kernel). size must not be 0 for Min and Max.
+template <ReduceOp op, class T>
+reduce_type_t<op, T> ScalarReduce(const T *elements, size_t size) {
+  using R = reduce_type_t<op, T>;
+  const R init = op == ReduceOp::Sum || size == 0 ? R() : R(elements[0]);
+  R acc[4] = {init, init, init, init};
+  size_t i = 0;
+  for (; i + 4 <= size; i += 4) {
+    for (size_t k = 0; k < 4; ++k)
+      acc[k] = Combine<op>(acc[k], elements[i + k]);
+  }
+  return FinishReduce<op>(acc, 4, elements + i, size - i, false);
+}
+
+// SSE2 has neither 64 bits integer comparison nor 32 bits integer min and max, the latter are derived from comparisons.
+#ifdef CINQ_SIMD_X86
+template <Isa isa, class T, ReduceOp op>
+inline constexpr bool has_reduce_kernel = isa == Isa::Avx512 || isa == Isa::Avx2 ||
+  isa == Isa::Sse2 && (op == ReduceOp::Sum || !std::is_same_v<T, std::int64_t>);
+#else
+template <Isa isa, class T, ReduceOp op>
+inline constexpr bool has_reduce_kernel = false;
+#endif
+
+#ifdef CINQ_SIMD_X86
+template <ReduceOp op>
+CINQ_SIMD_TARGET("sse2") reduce_type_t<op, double> ReduceSse2(const double *elements, size_t size) {
+  const __m128d init = op == ReduceOp::Sum ? _mm_setzero_pd() : _mm_set1_pd(elements[0]);
+  __m128d acc[4] = {init, init, init, init};
+  __m128d unordered = _mm_setzero_pd();
+  size_t i = 0;
+  for (; i + 8 <= size; i += 8) {
+    for (size_t k = 0; k < 4; ++k) {
+      const __m128d x = _mm_loadu_pd(elements + i + 2 * k);
+      if constexpr (op == ReduceOp::Sum)
+        acc[k] = _mm_add_pd(acc[k], x);
+      else
+        acc[k] = op == ReduceOp::Min ? _mm_min_pd(acc[k], x) : _mm_max_pd(acc[k], x);
+      if constexpr (op != ReduceOp::Sum)
+        unordered = _mm_or_pd(unordered, _mm_cmpunord_pd(x, x));
+    }
+  }
+  alignas(16) double lanes[8];
+  for (size_t k = 0; k < 4; ++k)
+    _mm_store_pd(lanes + 2 * k, acc[k]);
+  return FinishReduce<op>(lanes, 8, elements + i, size - i, _mm_movemask_pd(unordered) != 0);
+}
+
+template <ReduceOp op>
+CINQ_SIMD_TARGET("sse2") reduce_type_t<op, float> ReduceSse2(const float *elements, size_t size) {
+  size_t i = 0;
+  if constexpr (op == ReduceOp::Sum) {
+    __m128d acc[4] = {_mm_setzero_pd(), _mm_setzero_pd(), _mm_setzero_pd(), _mm_setzero_pd()};
+    for (; i + 8 <= size; i += 8) {
+      for (size_t k = 0; k < 2; ++k) {
+        const __m128 x = _mm_loadu_ps(elements + i + 4 * k);
+        acc[2 * k] = _mm_add_pd(acc[2 * k], _mm_cvtps_pd(x));
+        acc[2 * k + 1] = _mm_add_pd(acc[2 * k + 1], _mm_cvtps_pd(_mm_movehl_ps(x, x)));
+      }
+    }
+    alignas(16) double lanes[8];
+    for (size_t k = 0; k < 4; ++k)
+      _mm_store_pd(lanes + 2 * k, acc[k]);
+    return FinishReduce<op>(lanes, 8, elements + i, size - i, false);
+  } else {
+    const __m128 init = _mm_set1_ps(elements[0]);
+    __m128 acc[4] = {init, init, init, init};
+    __m128 unordered = _mm_setzero_ps();
+    for (; i + 16 <= size; i += 16) {
+      for (size_t k = 0; k < 4; ++k) {
+        const __m128 x = _mm_loadu_ps(elements + i + 4 * k);
+        acc[k] = op == ReduceOp::Min ? _mm_min_ps(acc[k], x) : _mm_max_ps(acc[k], x);
+        unordered = _mm_or_ps(unordered, _mm_cmpunord_ps(x, x));
+      }
+    }
+    alignas(16) float lanes[16];
+    for (size_t k = 0; k < 4; ++k)
+      _mm_store_ps(lanes + 4 * k, acc[k]);
+    return FinishReduce<op>(lanes, 16, elements + i, size - i, _mm_movemask_ps(unordered) != 0);
+  }
+}
+
+template <ReduceOp op>
+CINQ_SIMD_TARGET("sse2") reduce_type_t<op, std::int32_t> ReduceSse2(const std::int32_t *elements, size_t size) {
+  const __m128i init = op == ReduceOp::Sum ? _mm_setzero_si128() : _mm_set1_epi32(elements[0]);
+  __m128i acc[4] = {init, init, init, init};
+  size_t i = 0;
+  for (; i + 16 <= size; i += 16) {
+    for (size_t k = 0; k < 4; ++k) {
+      const __m128i x = _mm_loadu_si128(reinterpret_cast<const __m128i *>(elements + i + 4 * k));
+      if constexpr (op == ReduceOp::Sum) {
+        acc[k] = _mm_add_epi32(acc[k], x);
+      } else {
+        const __m128i take_x = op == ReduceOp::Min ? _mm_cmpgt_epi32(acc[k], x) : _mm_cmpgt_epi32(x, acc[k]);
+        acc[k] = _mm_or_si128(_mm_and_si128(take_x, x), _mm_andnot_si128(take_x, acc[k]));
+      }
+    }
+  }
+  alignas(16) std::int32_t lanes[16];
+  for (size_t k = 0; k < 4; ++k)
+    _mm_store_si128(reinterpret_cast<__m128i *>(lanes + 4 * k), acc[k]);
+  return FinishReduce<op>(lanes, 16, elements + i, size - i, false);
+}
+
+template <ReduceOp op>
+CINQ_SIMD_TARGET("sse2") reduce_type_t<op, std::int64_t> ReduceSse2(const std::int64_t *elements, size_t size) {
+  static_assert(op == ReduceOp::Sum);
+  __m128i acc[4] = {_mm_setzero_si128(), _mm_setzero_si128(), _mm_setzero_si128(), _mm_setzero_si128()};
+  size_t i = 0;
+  for (; i + 8 <= size; i += 8) {
+    for (size_t k = 0; k < 4; ++k)
+      acc[k] = _mm_add_epi64(acc[k], _mm_loadu_si128(reinterpret_cast<const __m128i *>(elements + i + 2 * k)));
+  }
+  alignas(16) std::int64_t lanes[8];
+  for (size_t k = 0; k < 4; ++k)
+    _mm_store_si128(reinterpret_cast<__m128i *>(lanes + 2 * k), acc[k]);
+  return FinishReduce<op>(lanes, 8, elements + i, size - i, false);
+}
+
+template <ReduceOp op>
+CINQ_SIMD_TARGET("avx2") reduce_type_t<op, double> ReduceAvx2(const double *elements, size_t size) {
+  const __m256d init = op == ReduceOp::Sum ? _mm256_setzero_pd() : _mm256_set1_pd(elements[0]);
+  __m256d acc[4] = {init, init, init, init};
+  __m256d unordered = _mm256_setzero_pd();
+  size_t i = 0;
+  for (; i + 16 <= size; i += 16) {
+    for (size_t k = 0; k < 4; ++k) {
+      const __m256d x = _mm256_loadu_pd(elements + i + 4 * k);
+      if constexpr (op == ReduceOp::Sum)
+        acc[k] = _mm256_add_pd(acc[k], x);
+      else
+        acc[k] = op == ReduceOp::Min ? _mm256_min_pd(acc[k], x) : _mm256_max_pd(acc[k], x);
+      if constexpr (op != ReduceOp::Sum)
+        unordered = _mm256_or_pd(unordered, _mm256_cmp_pd(x, x, _CMP_UNORD_Q));
+    }
+  }
+  alignas(32) double lanes[16];
+  for (size_t k = 0; k < 4; ++k)
+    _mm256_store_pd(lanes + 4 * k, acc[k]);
+  return FinishReduce<op>(lanes, 16, elements + i, size - i, _mm256_movemask_pd(unordered) != 0);
+}
+
+template <ReduceOp op>
+CINQ_SIMD_TARGET("avx2") reduce_type_t<op, float> ReduceAvx2(const float *elements, size_t size) {
+  size_t i = 0;
+  if constexpr (op == ReduceOp::Sum) {
+    __m256d acc[4] = {_mm256_setzero_pd(), _mm256_setzero_pd(), _mm256_setzero_pd(), _mm256_setzero_pd()};
+    for (; i + 16 <= size; i += 16) {
+      for (size_t k = 0; k < 4; ++k)
+        acc[k] = _mm256_add_pd(acc[k], _mm256_cvtps_pd(_mm_loadu_ps(elements + i + 4 * k)));
+    }
+    alignas(32) double lanes[16];
+    for (size_t k = 0; k < 4; ++k)
+      _mm256_store_pd(lanes + 4 * k, acc[k]);
+    return FinishReduce<op>(lanes, 16, elements + i, size - i, false);
+  } else {
+    const __m256 init = _mm256_set1_ps(elements[0]);
+    __m256 acc[4] = {init, init, init, init};
+    __m256 unordered = _mm256_setzero_ps();
+    for (; i + 32 <= size; i += 32) {
+      for (size_t k = 0; k < 4; ++k) {
+        const __m256 x = _mm256_loadu_ps(elements + i + 8 * k);
+        acc[k] = op == ReduceOp::Min ? _mm256_min_ps(acc[k], x) : _mm256_max_ps(acc[k], x);
+        unordered = _mm256_or_ps(unordered, _mm256_cmp_ps(x, x, _CMP_UNORD_Q));
+      }
+    }
+    alignas(32) float lanes[32];
+    for (size_t k = 0; k < 4; ++k)
+      _mm256_store_ps(lanes + 8 * k, acc[k]);
+    return FinishReduce<op>(lanes, 32, elements + i, size - i, _mm256_movemask_ps(unordered) != 0);
+  }
+}
+
+template <ReduceOp op>
+CINQ_SIMD_TARGET("avx2") reduce_type_t<op, std::int32_t> ReduceAvx2(const std::int32_t *elements, size_t size) {
+  const __m256i init = op == ReduceOp::Sum ? _mm256_setzero_si256() : _mm256_set1_epi32(elements[0]);
+  __m256i acc[4] = {init, init, init, init};
+  size_t i = 0;
+  for (; i + 32 <= size; i += 32) {
+    for (size_t k = 0; k < 4; ++k) {
+      const __m256i x = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(elements + i + 8 * k));
+      if constexpr (op == ReduceOp::Sum)
+        acc[k] = _mm256_add_epi32(acc[k], x);
+      else
+        acc[k] = op == ReduceOp::Min ? _mm256_min_epi32(acc[k], x) : _mm256_max_epi32(acc[k], x);
+    }
+  }
+  alignas(32) std::int32_t lanes[32];
+  for (size_t k = 0; k < 4; ++k)
+    _mm256_store_si256(reinterpret_cast<__m256i *>(lanes + 8 * k), acc[k]);
+  return FinishReduce<op>(lanes, 32, elements + i, size - i, false);
+}
+
+template <ReduceOp op>
+CINQ_SIMD_TARGET("avx2") reduce_type_t<op, std::int64_t> ReduceAvx2(const std::int64_t *elements, size_t size) {
+  const __m256i init = op == ReduceOp::Sum ? _mm256_setzero_si256() : _mm256_set1_epi64x(elements[0]);
+  __m256i acc[4] = {init, init, init, init};
+  size_t i = 0;
+  for (; i + 16 <= size; i += 16) {
+    for (size_t k = 0; k < 4; ++k) {
+      const __m256i x = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(elements + i + 4 * k));
+      if constexpr (op == ReduceOp::Sum) {
+        acc[k] = _mm256_add_epi64(acc[k], x);
+      } else {
+        const __m256i take_x = op == ReduceOp::Min ? _mm256_cmpgt_epi64(acc[k], x) : _mm256_cmpgt_epi64(x, acc[k]);
+        acc[k] = _mm256_blendv_epi8(acc[k], x, take_x);
+      }
+    }
+  }
+  alignas(32) std::int64_t lanes[16];
+  for (size_t k = 0; k < 4; ++k)
+    _mm256_store_si256(reinterpret_cast<__m256i *>(lanes + 4 * k), acc[k]);
+  return FinishReduce<op>(lanes, 16, elements + i, size - i, false);
+}
+
+// The AVX-512 min and max intrinsics of GCC pass an undefined vector as the unused source of their masked instruction, which
+//   -Wmaybe-uninitialized reports once they're inlined.
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wmaybe-uninitialized"
+#endif
+template <ReduceOp op>
+CINQ_SIMD_TARGET("avx512f") reduce_type_t<op, double> ReduceAvx512(const double *elements, size_t size) {
+  const __m512d init = op == ReduceOp::Sum ? _mm512_setzero_pd() : _mm512_set1_pd(elements[0]);
+  __m512d acc[4] = {init, init, init, init};
+  __mmask8 unordered = 0;
+  size_t i = 0;
+  for (; i + 32 <= size; i += 32) {
+    for (size_t k = 0; k < 4; ++k) {
+      const __m512d x = _mm512_loadu_pd(elements + i + 8 * k);
+      if constexpr (op == ReduceOp::Sum)
+        acc[k] = _mm512_add_pd(acc[k], x);
+      else
+        acc[k] = op == ReduceOp::Min ? _mm512_min_pd(acc[k], x) : _mm512_max_pd(acc[k], x);
+      if constexpr (op != ReduceOp::Sum)
+        unordered |= _mm512_cmp_pd_mask(x, x, _CMP_UNORD_Q);
+    }
+  }
+  alignas(64) double lanes[32];
+  for (size_t k = 0; k < 4; ++k)
+    _mm512_store_pd(lanes + 8 * k, acc[k]);
+  return FinishReduce<op>(lanes, 32, elements + i, size - i, unordered != 0);
+}
+
+template <ReduceOp op>
+CINQ_SIMD_TARGET("avx512f") reduce_type_t<op, float> ReduceAvx512(const float *elements, size_t size) {
+  size_t i = 0;
+  if constexpr (op == ReduceOp::Sum) {
+    __m512d acc[4] = {_mm512_setzero_pd(), _mm512_setzero_pd(), _mm512_setzero_pd(), _mm512_setzero_pd()};
+    for (; i + 32 <= size; i += 32) {
+      for (size_t k = 0; k < 4; ++k)
+        acc[k] = _mm512_add_pd(acc[k], _mm512_cvtps_pd(_mm256_loadu_ps(elements + i + 8 * k)));
+    }
+    alignas(64) double lanes[32];
+    for (size_t k = 0; k < 4; ++k)
+      _mm512_store_pd(lanes + 8 * k, acc[k]);
+    return FinishReduce<op>(lanes, 32, elements + i, size - i, false);
+  } else {
+    const __m512 init = _mm512_set1_ps(elements[0]);
+    __m512 acc[4] = {init, init, init, init};
+    __mmask16 unordered = 0;
+    for (; i + 64 <= size; i += 64) {
+      for (size_t k = 0; k < 4; ++k) {
+        const __m512 x = _mm512_loadu_ps(elements + i + 16 * k);
+        acc[k] = op == ReduceOp::Min ? _mm512_min_ps(acc[k], x) : _mm512_max_ps(acc[k], x);
+        unordered |= _mm512_cmp_ps_mask(x, x, _CMP_UNORD_Q);
+      }
+    }
+    alignas(64) float lanes[64];
+    for (size_t k = 0; k < 4; ++k)
+      _mm512_store_ps(lanes + 16 * k, acc[k]);
+    return FinishReduce<op>(lanes, 64, elements + i, size - i, unordered != 0);
+  }
+}
+
+template <ReduceOp op>
+CINQ_SIMD_TARGET("avx512f") reduce_type_t<op, std::int32_t> ReduceAvx512(const std::int32_t *elements, size_t size) {
+  const __m512i init = op == ReduceOp::Sum ? _mm512_setzero_si512() : _mm512_set1_epi32(elements[0]);
+  __m512i acc[4] = {init, init, init, init};
+  size_t i = 0;
+  for (; i + 64 <= size; i += 64) {
+    for (size_t k = 0; k < 4; ++k) {
+      const __m512i x = _mm512_loadu_si512(elements + i + 16 * k);
+      if constexpr (op == ReduceOp::Sum)
+        acc[k] = _mm512_add_epi32(acc[k], x);
+      else
+        acc[k] = op == ReduceOp::Min ? _mm512_min_epi32(acc[k], x) : _mm512_max_epi32(acc[k], x);
+    }
+  }
+  alignas(64) std::int32_t lanes[64];
+  for (size_t k = 0; k < 4; ++k)
+    _mm512_store_si512(lanes + 16 * k, acc[k]);
+  return FinishReduce<op>(lanes, 64, elements + i, size - i, false);
+}
+
+template <ReduceOp op>
+CINQ_SIMD_TARGET("avx512f") reduce_type_t<op, std::int64_t> ReduceAvx512(const std::int64_t *elements, size_t size) {
+  const __m512i init = op == ReduceOp::Sum ? _mm512_setzero_si512() : _mm512_set1_epi64(elements[0]);
+  __m512i acc[4] = {init, init, init, init};
+  size_t i = 0;
+  for (; i + 32 <= size; i += 32) {
+    for (size_t k = 0; k < 4; ++k) {
+      const __m512i x = _mm512_loadu_si512(elements + i + 8 * k);
+      if constexpr (op == ReduceOp::Sum)
+        acc[k] = _mm512_add_epi64(acc[k], x);
+      else
+        acc[k] = op == ReduceOp::Min ? _mm512_min_epi64(acc[k], x) : _mm512_max_epi64(acc[k], x);
+    }
+  }
+  alignas(64) std::int64_t lanes[32];
+  for (size_t k = 0; k < 4; ++k)
+    _mm512_store_si512(lanes + 8 * k, acc[k]);
+  return FinishReduce<op>(lanes, 32, elements + i, size - i, false);
+}
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic pop
+#endif
+#endif // CINQ_SIMD_X86
+
+// Reduces elements with the kernel of isa, or the scalar kernel if there isn't one. size must not be 0 for Min and Max.
+template <Isa isa, ReduceOp op, class T>
+reduce_type_t<op, T> ReduceDense(const T *elements, size_t size) {
+  using KernelType = kernel_type_t<T>;
+  if constexpr (!std::is_void_v<KernelType> && has_reduce_kernel<isa, KernelType, op>) {
+    const auto *kernel_elements = reinterpret_cast<const KernelType *>(elements);
+#ifdef CINQ_SIMD_X86
+    if constexpr (isa == Isa::Avx512)
+      return ReduceAvx512<op>(kernel_elements, size);
+    else if constexpr (isa == Isa::Avx2)
+      return ReduceAvx2<op>(kernel_elements, size);
+    else if constexpr (isa == Isa::Sse2)
+      return ReduceSse2<op>(kernel_elements, size);
+#endif
+  }
+  return ScalarReduce<op>(elements, size);
+}
+
+// Dispatches ReduceDense to the active instruction set.
+template <ReduceOp op, class T>
+reduce_type_t<op, T> Reduce(const T *elements, size_t size) {
+  switch (ActiveIsa()) {
+  case Isa::Avx512:
+    return ReduceDense<Isa::Avx512, op>(elements, size);
+  case Isa::Avx2:
+    return ReduceDense<Isa::Avx2, op>(elements, size);
+  case Isa::Sse2:
+    return ReduceDense<Isa::Sse2, op>(elements, size);
+  default:
+    return ReduceDense<Isa::Scalar, op>(elements, size);
+  }
+}
+
+} // namespace cinq::detail::simd
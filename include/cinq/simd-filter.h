@@ -0,0 +1,411 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <type_traits>
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define CINQ_SIMD_X86
+#include <immintrin.h>
+#if defined(_MSC_VER) && !defined(__clang__)
+#include <intrin.h>
+// MSVC compiles intrinsics of any instruction set without per function options.
+#define CINQ_SIMD_TARGET(isa)
+#else
+#define CINQ_SIMD_TARGET(isa) __attribute__((target(isa)))
+#endif
+#endif
+
+namespace cinq::detail::simd {
+// Vectorized comparisons used by the Where kernels (see FilterBatch). Each kernel compares a block of 64 elements with a value,
+//   and returns a bit mask whose i-th bit is set if the i-th element satisfies the comparison.
+// The instruction set is chosen at runtime (see ActiveIsa), kernels are compiled for it with per function target options,
+//   so no compile flag is required.
+enum class CompareOp { Equal, Less, Greater, LessEqual, GreaterEqual };
+
+enum class Isa { Scalar, Sse2, Avx2, Avx512 };
+
+inline constexpr size_t block_size = 64;
+
+template <CompareOp op, class T, class U>
+bool Compare(const T &lhs, const U &rhs) {
+  if constexpr (op == CompareOp::Equal)
+    return lhs == rhs;
+  else if constexpr (op == CompareOp::Less)
+    return lhs < rhs;
+  else if constexpr (op == CompareOp::Greater)
+    return lhs > rhs;
+  else if constexpr (op == CompareOp::LessEqual)
+    return lhs <= rhs;
+  else
+    return lhs >= rhs;
+}
+
+// The type the kernels work on for elements of type T: 32 and 64 bits signed integers, float and double. Otherwise void.
+template <class T>
+using kernel_type_t = std::conditional_t<std::is_same_v<T, float> || std::is_same_v<T, double>, T,
+  std::conditional_t<std::is_integral_v<T> && std::is_signed_v<T> && sizeof(T) == 4, std::int32_t,
+  std::conditional_t<std::is_integral_v<T> && std::is_signed_v<T> && sizeof(T) == 8, std::int64_t, void>>>;
+
+// The scalar kernel, used for the types an instruction set doesn't support (see has_kernel).
+template <CompareOp op, class T, class U>
+std::uint64_t ScalarCompareMask(const T *elements, const U &value) {
+  std::uint64_t mask = 0;
+  for (size_t i = 0; i < block_size; ++i)
+    mask |= static_cast<std::uint64_t>(Compare<op>(elements[i], value)) << i;
+  return mask;
+}
+
+// Provides the vectorized CompareMask<op>(const T *elements, T value) of an instruction set, T is a kernel type.
+template <Isa isa, class T>
+struct Kernel;
+
+// SSE2 has no 64 bits integer comparison.
+#ifdef CINQ_SIMD_X86
+template <Isa isa, class T>
+inline constexpr bool has_kernel = isa == Isa::Avx512 || isa == Isa::Avx2 || isa == Isa::Sse2 && !std::is_same_v<T, std::int64_t>;
+#else
+template <Isa isa, class T>
+inline constexpr bool has_kernel = false;
+#endif
+
+inline size_t CountBits(std::uint32_t bits) {
+#if defined(_MSC_VER) && !defined(__clang__)
+  return __popcnt(bits);
+#else
+  return static_cast<size_t>(__builtin_popcount(bits));
+#endif
+}
+
+#ifdef CINQ_SIMD_X86
+template <CompareOp op>
+constexpr int float_predicate = op == CompareOp::Equal ? _CMP_EQ_OQ :
+  op == CompareOp::Less ? _CMP_LT_OQ :
+  op == CompareOp::Greater ? _CMP_GT_OQ :
+  op == CompareOp::LessEqual ? _CMP_LE_OQ : _CMP_GE_OQ;
+
+template <CompareOp op>
+constexpr int integer_predicate = op == CompareOp::Equal ? _MM_CMPINT_EQ :
+  op == CompareOp::Less ? _MM_CMPINT_LT :
+  op == CompareOp::Greater ? _MM_CMPINT_NLE :
+  op == CompareOp::LessEqual ? _MM_CMPINT_LE : _MM_CMPINT_NLT;
+
+// Before AVX-512, integers only have equal and greater (and less for SSE2) comparisons, the others are derived from them.
+template <CompareOp op>
+CINQ_SIMD_TARGET("sse2") std::uint64_t CompareMaskSse2(const std::int32_t *elements, std::int32_t value) {
+  const __m128i v = _mm_set1_epi32(value);
+  std::uint64_t mask = 0;
+  for (size_t i = 0; i < block_size; i += 4) {
+    const __m128i x = _mm_loadu_si128(reinterpret_cast<const __m128i *>(elements + i));
+    __m128i result;
+    if constexpr (op == CompareOp::Equal)
+      result = _mm_cmpeq_epi32(x, v);
+    else if constexpr (op == CompareOp::Less)
+      result = _mm_cmplt_epi32(x, v);
+    else if constexpr (op == CompareOp::Greater)
+      result = _mm_cmpgt_epi32(x, v);
+    else if constexpr (op == CompareOp::LessEqual)
+      result = _mm_xor_si128(_mm_cmpgt_epi32(x, v), _mm_set1_epi32(-1));
+    else
+      result = _mm_xor_si128(_mm_cmplt_epi32(x, v), _mm_set1_epi32(-1));
+    mask |= static_cast<std::uint64_t>(_mm_movemask_ps(_mm_castsi128_ps(result))) << i;
+  }
+  return mask;
+}
+
+template <CompareOp op>
+CINQ_SIMD_TARGET("sse2") std::uint64_t CompareMaskSse2(const float *elements, float value) {
+  const __m128 v = _mm_set1_ps(value);
+  std::uint64_t mask = 0;
+  for (size_t i = 0; i < block_size; i += 4) {
+    const __m128 x = _mm_loadu_ps(elements + i);
+    __m128 result;
+    if constexpr (op == CompareOp::Equal)
+      result = _mm_cmpeq_ps(x, v);
+    else if constexpr (op == CompareOp::Less)
+      result = _mm_cmplt_ps(x, v);
+    else if constexpr (op == CompareOp::Greater)
+      result = _mm_cmpgt_ps(x, v);
+    else if constexpr (op == CompareOp::LessEqual)
+      result = _mm_cmple_ps(x, v);
+    else
+      result = _mm_cmpge_ps(x, v);
+    mask |= static_cast<std::uint64_t>(_mm_movemask_ps(result)) << i;
+  }
+  return mask;
+}
+
+template <CompareOp op>
+CINQ_SIMD_TARGET("sse2") std::uint64_t CompareMaskSse2(const double *elements, double value) {
+  const __m128d v = _mm_set1_pd(value);
+  std::uint64_t mask = 0;
+  for (size_t i = 0; i < block_size; i += 2) {
+    const __m128d x = _mm_loadu_pd(elements + i);
+    __m128d result;
+    if constexpr (op == CompareOp::Equal)
+      result = _mm_cmpeq_pd(x, v);
+    else if constexpr (op == CompareOp::Less)
+      result = _mm_cmplt_pd(x, v);
+    else if constexpr (op == CompareOp::Greater)
+      result = _mm_cmpgt_pd(x, v);
+    else if constexpr (op == CompareOp::LessEqual)
+      result = _mm_cmple_pd(x, v);
+    else
+      result = _mm_cmpge_pd(x, v);
+    mask |= static_cast<std::uint64_t>(_mm_movemask_pd(result)) << i;
+  }
+  return mask;
+}
+
+template <CompareOp op>
+CINQ_SIMD_TARGET("avx2") std::uint64_t CompareMaskAvx2(const std::int32_t *elements, std::int32_t value) {
+  const __m256i v = _mm256_set1_epi32(value);
+  std::uint64_t mask = 0;
+  for (size_t i = 0; i < block_size; i += 8) {
+    const __m256i x = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(elements + i));
+    __m256i result;
+    if constexpr (op == CompareOp::Equal)
+      result = _mm256_cmpeq_epi32(x, v);
+    else if constexpr (op == CompareOp::Less)
+      result = _mm256_cmpgt_epi32(v, x);
+    else if constexpr (op == CompareOp::Greater)
+      result = _mm256_cmpgt_epi32(x, v);
+    else if constexpr (op == CompareOp::LessEqual)
+      result = _mm256_xor_si256(_mm256_cmpgt_epi32(x, v), _mm256_set1_epi32(-1));
+    else
+      result = _mm256_xor_si256(_mm256_cmpgt_epi32(v, x), _mm256_set1_epi32(-1));
+    mask |= static_cast<std::uint64_t>(_mm256_movemask_ps(_mm256_castsi256_ps(result))) << i;
+  }
+  return mask;
+}
+
+template <CompareOp op>
+CINQ_SIMD_TARGET("avx2") std::uint64_t CompareMaskAvx2(const std::int64_t *elements, std::int64_t value) {
+  const __m256i v = _mm256_set1_epi64x(value);
+  std::uint64_t mask = 0;
+  for (size_t i = 0; i < block_size; i += 4) {
+    const __m256i x = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(elements + i));
+    __m256i result;
+    if constexpr (op == CompareOp::Equal)
+      result = _mm256_cmpeq_epi64(x, v);
+    else if constexpr (op == CompareOp::Less)
+      result = _mm256_cmpgt_epi64(v, x);
+    else if constexpr (op == CompareOp::Greater)
+      result = _mm256_cmpgt_epi64(x, v);
+    else if constexpr (op == CompareOp::LessEqual)
+      result = _mm256_xor_si256(_mm256_cmpgt_epi64(x, v), _mm256_set1_epi64x(-1));
+    else
+      result = _mm256_xor_si256(_mm256_cmpgt_epi64(v, x), _mm256_set1_epi64x(-1));
+    mask |= static_cast<std::uint64_t>(_mm256_movemask_pd(_mm256_castsi256_pd(result))) << i;
+  }
+  return mask;
+}
+
+template <CompareOp op>
+CINQ_SIMD_TARGET("avx2") std::uint64_t CompareMaskAvx2(const float *elements, float value) {
+  const __m256 v = _mm256_set1_ps(value);
+  std::uint64_t mask = 0;
+  for (size_t i = 0; i < block_size; i += 8)
+    mask |= static_cast<std::uint64_t>(_mm256_movemask_ps(_mm256_cmp_ps(_mm256_loadu_ps(elements + i), v, float_predicate<op>))) << i;
+  return mask;
+}
+
+template <CompareOp op>
+CINQ_SIMD_TARGET("avx2") std::uint64_t CompareMaskAvx2(const double *elements, double value) {
+  const __m256d v = _mm256_set1_pd(value);
+  std::uint64_t mask = 0;
+  for (size_t i = 0; i < block_size; i += 4)
+    mask |= static_cast<std::uint64_t>(_mm256_movemask_pd(_mm256_cmp_pd(_mm256_loadu_pd(elements + i), v, float_predicate<op>))) << i;
+  return mask;
+}
+
+template <CompareOp op>
+CINQ_SIMD_TARGET("avx512f") std::uint64_t CompareMaskAvx512(const std::int32_t *elements, std::int32_t value) {
+  const __m512i v = _mm512_set1_epi32(value);
+  std::uint64_t mask = 0;
+  for (size_t i = 0; i < block_size; i += 16)
+    mask |= static_cast<std::uint64_t>(_mm512_cmp_epi32_mask(_mm512_loadu_si512(elements + i), v, integer_predicate<op>)) << i;
+  return mask;
+}
+
+template <CompareOp op>
+CINQ_SIMD_TARGET("avx512f") std::uint64_t CompareMaskAvx512(const std::int64_t *elements, std::int64_t value) {
+  const __m512i v = _mm512_set1_epi64(value);
+  std::uint64_t mask = 0;
+  for (size_t i = 0; i < block_size; i += 8)
+    mask |= static_cast<std::uint64_t>(_mm512_cmp_epi64_mask(_mm512_loadu_si512(elements + i), v, integer_predicate<op>)) << i;
+  return mask;
+}
+
+template <CompareOp op>
+CINQ_SIMD_TARGET("avx512f") std::uint64_t CompareMaskAvx512(const float *elements, float value) {
+  const __m512 v = _mm512_set1_ps(value);
+  std::uint64_t mask = 0;
+  for (size_t i = 0; i < block_size; i += 16)
+    mask |= static_cast<std::uint64_t>(_mm512_cmp_ps_mask(_mm512_loadu_ps(elements + i), v, float_predicate<op>)) << i;
+  return mask;
+}
+
+template <CompareOp op>
+CINQ_SIMD_TARGET("avx512f") std::uint64_t CompareMaskAvx512(const double *elements, double value) {
+  const __m512d v = _mm512_set1_pd(value);
+  std::uint64_t mask = 0;
+  for (size_t i = 0; i < block_size; i += 8)
+    mask |= static_cast<std::uint64_t>(_mm512_cmp_pd_mask(_mm512_loadu_pd(elements + i), v, float_predicate<op>)) << i;
+  return mask;
+}
+
+template <>
+struct Kernel<Isa::Sse2, std::int32_t> {
+  template <CompareOp op>
+  static std::uint64_t CompareMask(const std::int32_t *elements, std::int32_t value) { return CompareMaskSse2<op>(elements, value); }
+};
+template <>
+struct Kernel<Isa::Sse2, float> {
+  template <CompareOp op>
+  static std::uint64_t CompareMask(const float *elements, float value) { return CompareMaskSse2<op>(elements, value); }
+};
+template <>
+struct Kernel<Isa::Sse2, double> {
+  template <CompareOp op>
+  static std::uint64_t CompareMask(const double *elements, double value) { return CompareMaskSse2<op>(elements, value); }
+};
+
+template <class T>
+struct Kernel<Isa::Avx2, T> {
+  template <CompareOp op>
+  static std::uint64_t CompareMask(const T *elements, T value) { return CompareMaskAvx2<op>(elements, value); }
+};
+
+template <class T>
+struct Kernel<Isa::Avx512, T> {
+  template <CompareOp op>
+  static std::uint64_t CompareMask(const T *elements, T value) { return CompareMaskAvx512<op>(elements, value); }
+};
+
+// Stores the indices (offset by base) of the set bits of a 16 bits mask, and returns the number of them.
+// It writes 16 indices, of which only the returned number are meaningful.
+CINQ_SIMD_TARGET("avx512f") inline size_t CompressAvx512(std::uint32_t mask, std::uint32_t base, std::uint32_t *output) {
+  const __m512i indices = _mm512_add_epi32(_mm512_set1_epi32(static_cast<int>(base)),
+    _mm512_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15));
+  _mm512_storeu_si512(output, _mm512_maskz_compress_epi32(static_cast<__mmask16>(mask), indices));
+  return CountBits(mask);
+}
+
+inline Isa DetectIsa() {
+#if defined(_MSC_VER) && !defined(__clang__)
+  int info[4];
+  __cpuid(info, 0);
+  const int max_leaf = info[0];
+  __cpuid(info, 1);
+  const bool has_sse2 = (info[3] & (1 << 26)) != 0;
+  const bool has_os_ymm = (info[2] & (1 << 27)) != 0 && (_xgetbv(0) & 0x6) == 0x6;
+  const bool has_os_zmm = has_os_ymm && (_xgetbv(0) & 0xe6) == 0xe6;
+  bool has_avx2 = false, has_avx512 = false;
+  if (max_leaf >= 7) {
+    __cpuidex(info, 7, 0);
+    has_avx2 = has_os_ymm && (info[1] & (1 << 5)) != 0;
+    has_avx512 = has_os_zmm && (info[1] & (1 << 16)) != 0;
+  }
+#else
+  __builtin_cpu_init();
+  const bool has_sse2 = __builtin_cpu_supports("sse2");
+  const bool has_avx2 = __builtin_cpu_supports("avx2");
+  const bool has_avx512 = __builtin_cpu_supports("avx512f");
+#endif
+  return has_avx512 ? Isa::Avx512 : has_avx2 ? Isa::Avx2 : has_sse2 ? Isa::Sse2 : Isa::Scalar;
+}
+#else
+inline Isa DetectIsa() {
+  return Isa::Scalar;
+}
+#endif // CINQ_SIMD_X86
+
+// The best instruction set supported by the CPU (and the OS), detected once.
+inline Isa ActiveIsa() {
+  static const Isa isa = DetectIsa();
+  return isa;
+}
+
+inline size_t CountTrailingZeros(std::uint64_t bits) {
+#if defined(_MSC_VER) && !defined(__clang__)
+  unsigned long index;
+  _BitScanForward64(&index, bits);
+  return index;
+#else
+  return static_cast<size_t>(__builtin_ctzll(bits));
+#endif
+}
+
+// Builds the selection vector of the elements satisfying pred (see ComparisonPredicate) in output, with the kernels of isa,
+//   and returns the number of selected elements. The elements after the last full block are tested one by one.
+template <Isa isa, class TPredicate, class T>
+size_t FilterDense(const TPredicate &pred, const T *elements, size_t size, std::uint32_t *output) {
+  size_t selected = 0;
+  size_t first = 0;
+  for (; first + block_size <= size; first += block_size) {
+    std::uint64_t mask = pred.template CompareMask<isa>(elements + first);
+#ifdef CINQ_SIMD_X86
+    if constexpr (isa == Isa::Avx512) {
+      for (size_t i = 0; i < block_size; i += 16)
+        selected += CompressAvx512(static_cast<std::uint32_t>(mask >> i) & 0xffff, static_cast<std::uint32_t>(first + i), output + selected);
+      continue;
+    }
+#endif
+    for (; mask; mask &= mask - 1)
+      output[selected++] = static_cast<std::uint32_t>(first + CountTrailingZeros(mask));
+  }
+
+  for (; first < size; ++first) {
+    output[selected] = static_cast<std::uint32_t>(first);
+    selected += static_cast<bool>(pred(elements[first]));
+  }
+  return selected;
+}
+
+// Dispatches FilterDense to the active instruction set. size must not be greater than the size of output.
+template <class TPredicate, class T>
+size_t FilterBatch(const TPredicate &pred, const T *elements, size_t size, std::uint32_t *output) {
+  switch (ActiveIsa()) {
+  case Isa::Avx512:
+    return FilterDense<Isa::Avx512>(pred, elements, size, output);
+  case Isa::Avx2:
+    return FilterDense<Isa::Avx2>(pred, elements, size, output);
+  case Isa::Sse2:
+    return FilterDense<Isa::Sse2>(pred, elements, size, output);
+  default:
+    return FilterDense<Isa::Scalar>(pred, elements, size, output);
+  }
+}
+
+// Counts the elements satisfying pred with the kernels of isa, by counting the bits of the masks.
+template <Isa isa, class TPredicate, class T>
+size_t CountDense(const TPredicate &pred, const T *elements, size_t size) {
+  size_t count = 0;
+  size_t first = 0;
+  for (; first + block_size <= size; first += block_size) {
+    const std::uint64_t mask = pred.template CompareMask<isa>(elements + first);
+    count += CountBits(static_cast<std::uint32_t>(mask)) + CountBits(static_cast<std::uint32_t>(mask >> 32));
+  }
+
+  for (; first < size; ++first)
+    count += static_cast<bool>(pred(elements[first]));
+  return count;
+}
+
+// Dispatches CountDense to the active instruction set.
+template <class TPredicate, class T>
+size_t CountBatch(const TPredicate &pred, const T *elements, size_t size) {
+  switch (ActiveIsa()) {
+  case Isa::Avx512:
+    return CountDense<Isa::Avx512>(pred, elements, size);
+  case Isa::Avx2:
+    return CountDense<Isa::Avx2>(pred, elements, size);
+  case Isa::Sse2:
+    return CountDense<Isa::Sse2>(pred, elements, size);
+  default:
+    return CountDense<Isa::Scalar>(pred, elements, size);
+  }
+}
+
+} // namespace cinq::detail::simd
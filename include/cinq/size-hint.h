@@ -0,0 +1,53 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <limits>
+
+namespace cinq::detail {
+// The number of elements of an enumerable, either exactly or as an upper bound, as far as it's known without enumerating it.
+// Each query derives it from the ones of its sources: Select preserves it, Concat sums it, Where and Distinct bound it by their source,
+//   and Join bounds it by the product of its sources. An unknown size is the upper bound unknown_size.
+struct SizeHint {
+  static constexpr size_t unknown_size = std::numeric_limits<size_t>::max();
+
+  size_t size = unknown_size;
+  bool is_exact = false;
+
+  bool IsKnown() const {
+    return size != unknown_size;
+  }
+
+  // The size is an upper bound of the enumerable derived from this one.
+  SizeHint UpperBound() const {
+    return {size, false};
+  }
+
+  // The sizes saturate at unknown_size.
+  friend SizeHint operator+(const SizeHint &lhs, const SizeHint &rhs) {
+    if (!lhs.IsKnown() || !rhs.IsKnown() || lhs.size > unknown_size - rhs.size)
+      return {};
+    return {lhs.size + rhs.size, lhs.is_exact && rhs.is_exact};
+  }
+
+  friend SizeHint operator*(const SizeHint &lhs, const SizeHint &rhs) {
+    if (lhs.size == 0 && lhs.is_exact || rhs.size == 0 && rhs.is_exact)
+      return {0, true};
+    if (!lhs.IsKnown() || !rhs.IsKnown() || rhs.size != 0 && lhs.size > unknown_size / rhs.size)
+      return {};
+    return {lhs.size * rhs.size, lhs.is_exact && rhs.is_exact};
+  }
+
+  // The smaller upper bound, e.g. of an intersection.
+  friend SizeHint Min(const SizeHint &lhs, const SizeHint &rhs) {
+    return {std::min(lhs.size, rhs.size), false};
+  }
+};
+
+// The SizeHint of a source of a query, which is an EnumerableSource or an Enumerable. Cinq provides its own overload.
+template <class TSource>
+SizeHint SourceSizeHint(TSource &source) {
+  return source.GetSizeHint();
+}
+
+} // namespace cinq::detail
@@ -0,0 +1,85 @@
+#pragma once
+
+#include <algorithm>
+#include <iterator>
+#include <optional>
+#include <type_traits>
+#include <utility>
+
+#include "detail/utility.h"
+
+namespace cinq::detail {
+// Advances first to the first element of [first, last) for which is_before is false, is_before being true for a prefix of the elements.
+// A random access iterator gallops, i.e. it doubles its steps while is_before holds, then binary searches the last step, so that
+//   skipping n elements costs O(log n) comparisons. The other iterators step one by one.
+template <class TIterator, class Pred>
+void GallopPast(TIterator &first, const TIterator &last, Pred is_before) {
+  if constexpr (cinq::utility::is_random_access_iterator_v<TIterator>) {
+    if (first == last || !is_before(*first))
+      return;
+
+    auto size = last - first;
+    decltype(size) step = 1;
+    while (step < size && is_before(*(first + step))) {
+      first += step;
+      size -= step;
+      step *= 2;
+    }
+    first = std::partition_point(first + 1, first + std::min(step, size), is_before);
+  } else {
+    while (first != last && is_before(*first))
+      ++first;
+  }
+}
+
+// The element a merge keeps while it advances its sources past it, e.g. the last one yielded by SortedDistinct.
+// It refers to the element of the source if is_aliasing, i.e. the source yields stable references (see yields_stable_references),
+//   otherwise it's a copy.
+template <class T, bool is_aliasing>
+class MergedElement {
+public:
+  bool HasValue() const {
+    return value_.has_value();
+  }
+
+  const T &operator*() const {
+    return *value_;
+  }
+
+  template <class U>
+  void Assign(U &&element) {
+    value_.emplace(std::forward<U>(element));
+  }
+
+  void Reset() {
+    value_.reset();
+  }
+
+private:
+  std::optional<T> value_;
+};
+
+template <class T>
+class MergedElement<T, true> {
+public:
+  bool HasValue() const {
+    return value_ != nullptr;
+  }
+
+  const T &operator*() const {
+    return *value_;
+  }
+
+  void Assign(const T &element) {
+    value_ = &element;
+  }
+
+  void Reset() {
+    value_ = nullptr;
+  }
+
+private:
+  const T *value_ = nullptr;
+};
+
+} // namespace cinq::detail
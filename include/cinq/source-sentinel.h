@@ -0,0 +1,54 @@
+#pragma once
+
+#include <type_traits>
+#include <utility>
+
+namespace cinq::detail {
+// Whether TIterator tells by itself whether it's past the end, with IsPastTheEnd(). The iterators of the queries do, as far as their
+//   sources allow it.
+template <class TIterator, class = void>
+struct has_past_the_end_check : std::false_type {};
+template <class TIterator>
+struct has_past_the_end_check<TIterator, std::void_t<decltype(std::declval<const TIterator &>().IsPastTheEnd())>> : std::true_type {};
+
+// The end of a source, which the iterators of the source are compared with.
+// If the iterators tell by themselves whether they are past the end (see has_past_the_end_check), it's empty. Otherwise (e.g. the
+//   iterators of a container) it's the past-the-end iterator.
+// The query iterators derive from it, so that it takes no space when it's empty. Storing the past-the-end iterator of a query iterator
+//   would double the size of the iterators with each query of a chain, which grows linearly instead.
+template <class TIterator, class = void>
+class SourceSentinel {
+public:
+  SourceSentinel() = default;
+
+  explicit SourceSentinel(TIterator last) : last_(std::move(last)) {}
+
+  friend bool operator==(const TIterator &ite, const SourceSentinel &sentinel) {
+    return ite == sentinel.last_;
+  }
+
+  friend bool operator!=(const TIterator &ite, const SourceSentinel &sentinel) {
+    return ite != sentinel.last_;
+  }
+
+private:
+  TIterator last_ = TIterator();
+};
+
+template <class TIterator>
+class SourceSentinel<TIterator, std::enable_if_t<has_past_the_end_check<TIterator>::value>> {
+public:
+  SourceSentinel() = default;
+
+  explicit SourceSentinel(const TIterator &) {}
+
+  friend bool operator==(const TIterator &ite, const SourceSentinel &) {
+    return ite.IsPastTheEnd();
+  }
+
+  friend bool operator!=(const TIterator &ite, const SourceSentinel &) {
+    return !ite.IsPastTheEnd();
+  }
+};
+
+} // namespace cinq::detail
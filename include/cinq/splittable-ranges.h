@@ -0,0 +1,38 @@
+#pragma once
+
+#include <cstddef>
+#include <utility>
+
+namespace cinq::detail {
+// The elements of a range splittable enumerable (see is_range_splittable), indexed by the elements of its underlying source.
+// It's built once per evaluation, and holds what is shared by all ranges (e.g. the hash table of Join), then ForEachInRange
+//   can be called concurrently with disjoint ranges.
+template <class TForEachInRange>
+class SplittableRanges {
+public:
+  SplittableRanges(size_t size, TForEachInRange for_each_in_range)
+    : size_(size), for_each_in_range_(std::move(for_each_in_range)) {}
+
+  size_t Size() const {
+    return size_;
+  }
+
+  // Calls sink with each element coming from the indices in [first, last) in order, until sink returns false.
+  // Returns false if it's stopped by sink.
+  template <class Sink>
+  bool ForEachInRange(size_t first, size_t last, Sink &&sink) const {
+    return for_each_in_range_(first, last, sink);
+  }
+
+private:
+  size_t size_;
+  TForEachInRange for_each_in_range_;
+};
+
+// Builds the SplittableRanges of a source of a query, which is an EnumerableSource or an Enumerable. Cinq provides its own overload.
+template <class TSource>
+auto MakeSourceRanges(TSource &source) {
+  return source.MakeRanges();
+}
+
+} // namespace cinq::detail
@@ -0,0 +1,264 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+namespace cinq::detail {
+// A process-wide work stealing scheduler, shared by every parallel query.
+// Every thread which runs tasks (a worker, or a thread calling ParallelFor) owns a deque of tasks. A task is a range of indices,
+//   the thread running it keeps splitting it in halves until it's not greater than the grain, pushing the upper halves to the back
+//   of its own deque. Then it pops tasks from the back of its own deque, and when that's empty, steals the front (i.e. the largest)
+//   task of another deque.
+// So a deque holds at most log2(size / grain) tasks per ParallelFor being run by its owner.
+// Workers are created lazily, up to the largest concurrency ever requested minus one, since the calling thread always takes part.
+class ThreadPool {
+public:
+  static ThreadPool &Instance() {
+    static ThreadPool pool;
+    return pool;
+  }
+
+  ThreadPool(const ThreadPool &) = delete;
+  ThreadPool &operator=(const ThreadPool &) = delete;
+
+  ~ThreadPool() {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      is_stopping_ = true;
+    }
+    task_pushed_.notify_all();
+    for (auto &worker : workers_)
+      worker.join();
+  }
+
+  // Calls fn(first, last) for disjoint ranges covering [0, size), each of them is not greater than grain (unless grain is 0),
+  //   and returns after all of them have returned.
+  // Other threads steal a task of this call only while less than concurrency threads are running its tasks.
+  // If any call throws, the ranges which are not started yet are skipped, and the first exception is rethrown.
+  template <class Fn>
+  void ParallelFor(size_t size, size_t grain, size_t concurrency, Fn &&fn) {
+    if (size == 0)
+      return ;
+
+    grain = std::max<size_t>(grain, 1);
+    concurrency = std::max<size_t>(concurrency, 1);
+    if (concurrency == 1 || size <= grain) {
+      for (size_t first = 0; first < size; first += grain)
+        fn(first, std::min(first + grain, size));
+      return ;
+    }
+
+    EnsureWorkers(concurrency - 1);
+
+    auto job = std::make_shared<Job>(size, grain, concurrency, &fn, [](void *fn, size_t first, size_t last) {
+        (*static_cast<std::remove_reference_t<Fn> *>(fn))(first, last);
+      });
+
+    TaskDeque &own_deque = OwnDeque();
+    ++job->running_count;
+    RunTask(Task{job, 0, size}, own_deque);
+
+    while (job->remaining_count.load() != 0) {
+      if (auto task = PopOwnTask(own_deque, job.get()); task || (task = StealTask(&own_deque, job.get()))) {
+        RunTask(std::move(*task), own_deque);
+        continue;
+      }
+
+      // The remaining tasks of this call are being run by other threads.
+      std::unique_lock<std::mutex> lock(job->mutex);
+      job->all_finished.wait_for(lock, std::chrono::milliseconds(1), [&job]() { return job->remaining_count.load() == 0; });
+    }
+
+    if (job->exception)
+      std::rethrow_exception(job->exception);
+  }
+
+private:
+  ThreadPool() = default;
+
+  struct Job {
+    Job(size_t size, size_t grain, size_t concurrency, void *fn, void (*invoke)(void *, size_t, size_t))
+      : grain(grain), concurrency(concurrency), fn(fn), invoke(invoke), remaining_count(size) {}
+
+    // Only a thread which is already running a task of this job can take a task without checking the concurrency.
+    bool TryEnter() {
+      for (size_t count = running_count.load(); count < concurrency; ) {
+        if (running_count.compare_exchange_weak(count, count + 1))
+          return true;
+      }
+      return false;
+    }
+
+    const size_t grain;
+    const size_t concurrency;
+    void *const fn;
+    void (*const invoke)(void *, size_t, size_t);
+
+    std::atomic<size_t> remaining_count; // number of indices not finished
+    std::atomic<size_t> running_count{0}; // number of threads running a task of this job
+    std::atomic<bool> is_cancelled{false};
+
+    std::mutex mutex;
+    std::condition_variable all_finished;
+    std::exception_ptr exception;
+  };
+
+  struct Task {
+    std::shared_ptr<Job> job;
+    size_t first;
+    size_t last;
+  };
+
+  struct TaskDeque {
+    std::mutex mutex;
+    std::deque<Task> tasks;
+  };
+
+  // Unregisters the deque of a thread when the thread exits.
+  struct OwnDequeHolder {
+    ~OwnDequeHolder() {
+      if (deque)
+        pool->Unregister(deque.get());
+    }
+
+    ThreadPool *pool = nullptr;
+    std::unique_ptr<TaskDeque> deque;
+  };
+
+  TaskDeque &OwnDeque() {
+    thread_local OwnDequeHolder holder;
+    if (!holder.deque) {
+      holder.pool = this;
+      holder.deque = std::make_unique<TaskDeque>();
+      std::lock_guard<std::mutex> lock(mutex_);
+      deques_.push_back(holder.deque.get());
+    }
+    return *holder.deque;
+  }
+
+  void Unregister(TaskDeque *deque) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    deques_.erase(std::find(deques_.begin(), deques_.end(), deque));
+  }
+
+  void EnsureWorkers(size_t count) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    while (workers_.size() < count)
+      workers_.emplace_back([this]() { WorkerLoop(); });
+  }
+
+  // The calling thread must have entered the job of the task, it leaves the job after the task is finished.
+  void RunTask(Task task, TaskDeque &own_deque) {
+    Job &job = *task.job;
+    while (task.last - task.first > job.grain) {
+      auto middle = task.first + (task.last - task.first) / 2;
+      PushTask(own_deque, Task{task.job, middle, task.last});
+      task.last = middle;
+    }
+
+    if (!job.is_cancelled.load(std::memory_order_relaxed)) {
+      try {
+        job.invoke(job.fn, task.first, task.last);
+      } catch (...) {
+        std::lock_guard<std::mutex> lock(job.mutex);
+        if (!job.exception)
+          job.exception = std::current_exception();
+        job.is_cancelled = true;
+      }
+    }
+
+    --job.running_count;
+    if (job.remaining_count.fetch_sub(task.last - task.first) == task.last - task.first) {
+      std::lock_guard<std::mutex> lock(job.mutex);
+      job.all_finished.notify_all();
+    }
+  }
+
+  void PushTask(TaskDeque &deque, Task task) {
+    {
+      std::lock_guard<std::mutex> lock(deque.mutex);
+      deque.tasks.push_back(std::move(task));
+    }
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      ++queued_task_count_;
+    }
+    task_pushed_.notify_one();
+  }
+
+  // If job is not null, only a task of this job is taken.
+  std::optional<Task> PopOwnTask(TaskDeque &deque, Job *job) {
+    std::lock_guard<std::mutex> lock(deque.mutex);
+    if (deque.tasks.empty() || job && deque.tasks.back().job.get() != job)
+      return std::nullopt;
+
+    ++deque.tasks.back().job->running_count;
+    auto task = std::move(deque.tasks.back());
+    deque.tasks.pop_back();
+    --queued_task_count_;
+    return task;
+  }
+
+  std::optional<Task> StealTask(TaskDeque *own_deque, Job *job) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto first_victim = steal_index_++;
+    for (size_t i = 0; i < deques_.size(); ++i) {
+      TaskDeque *victim = deques_[(first_victim + i) % deques_.size()];
+      if (victim == own_deque)
+        continue;
+
+      std::lock_guard<std::mutex> victim_lock(victim->mutex);
+      if (victim->tasks.empty())
+        continue;
+      Task &front = victim->tasks.front();
+      if (job && front.job.get() != job || !front.job->TryEnter())
+        continue;
+
+      auto task = std::move(front);
+      victim->tasks.pop_front();
+      --queued_task_count_;
+      return task;
+    }
+    return std::nullopt;
+  }
+
+  void WorkerLoop() {
+    TaskDeque &own_deque = OwnDeque();
+    for (;;) {
+      if (auto task = PopOwnTask(own_deque, nullptr); task || (task = StealTask(&own_deque, nullptr))) {
+        RunTask(std::move(*task), own_deque);
+        continue;
+      }
+
+      std::unique_lock<std::mutex> lock(mutex_);
+      if (is_stopping_)
+        return ;
+      // The queued tasks may belong to jobs which can't be entered for now, check them again later.
+      if (queued_task_count_ == 0)
+        task_pushed_.wait(lock, [this]() { return is_stopping_ || queued_task_count_ != 0; });
+      else
+        task_pushed_.wait_for(lock, std::chrono::milliseconds(1));
+    }
+  }
+
+  std::mutex mutex_; // guards deques_, steal_index_, workers_ and is_stopping_, and the increments of queued_task_count_
+  std::condition_variable task_pushed_;
+  std::vector<TaskDeque *> deques_;
+  std::atomic<size_t> queued_task_count_{0};
+  size_t steal_index_ = 0;
+  std::vector<std::thread> workers_;
+  bool is_stopping_ = false;
+};
+
+} // namespace cinq::detail
@@ -1,43 +1,225 @@
 #pragma once
 
-#include <cassert>
-#include <algorithm>
+#include <functional>
+#include <map>
+#include <set>
 #include <type_traits>
+#include <unordered_map>
+#include <unordered_set>
 
 #include "cinq/enumerable-source.h"
 #include "cinq/enumerable.h"
-#include "cinq.h"
+#include "cinq/query-category.h"
 #include "detail/utility.h"
 
 namespace cinq::utility {
+// Whether the elements of a container are unique by construction, i.e. it's a std::set or a std::map (or their unordered versions) using
+//   the default comparison, and the comparator which orders them (std::less<> for a std::set or a std::map), void if they aren't sorted.
 template <class T>
-struct CinqTraits {
+struct ContainerTraits {
+  static constexpr bool is_elements_unique = false;
+  using Compare = void;
+};
+
+template <class TKey, class TCompare, class TAllocator>
+struct ContainerTraits<std::set<TKey, TCompare, TAllocator>> {
+  static constexpr bool is_elements_unique = std::is_same_v<TCompare, std::less<TKey>> || std::is_same_v<TCompare, std::less<>>;
+  using Compare = std::conditional_t<is_elements_unique, std::less<>, void>;
+};
+
+// The keys are unique, hence so are the pairs, which are sorted as their keys.
+template <class TKey, class TValue, class TCompare, class TAllocator>
+struct ContainerTraits<std::map<TKey, TValue, TCompare, TAllocator>> {
+  static constexpr bool is_elements_unique = std::is_same_v<TCompare, std::less<TKey>> || std::is_same_v<TCompare, std::less<>>;
+  using Compare = std::conditional_t<is_elements_unique, std::less<>, void>;
+};
+
+template <class TKey, class THash, class TEqual, class TAllocator>
+struct ContainerTraits<std::unordered_set<TKey, THash, TEqual, TAllocator>> {
+  static constexpr bool is_elements_unique = std::is_same_v<TEqual, std::equal_to<TKey>> || std::is_same_v<TEqual, std::equal_to<>>;
+  using Compare = void;
+};
+
+template <class TKey, class TValue, class THash, class TEqual, class TAllocator>
+struct ContainerTraits<std::unordered_map<TKey, TValue, THash, TEqual, TAllocator>> {
+  static constexpr bool is_elements_unique = std::is_same_v<TEqual, std::equal_to<TKey>> || std::is_same_v<TEqual, std::equal_to<>>;
+  using Compare = void;
 };
 
+// How much is known statically about the number of elements of an enumerable, see detail::SizeHint for the value known at run time.
+// Exact: the size is known without enumerating it, Bounded: an upper bound is known, Unknown: nothing is known.
+enum class SizeClass {
+  Unknown,
+  Bounded,
+  Exact
+};
+
+constexpr SizeClass UpperBound(SizeClass size_class) {
+  return size_class == SizeClass::Unknown ? SizeClass::Unknown : SizeClass::Bounded;
+}
+
+// The size of the first elements of an enumerable, up to a count, is bounded by the count.
+constexpr SizeClass Truncated(SizeClass size_class) {
+  return size_class == SizeClass::Exact ? SizeClass::Exact : SizeClass::Bounded;
+}
+
+template <class... SizeClasses>
+constexpr SizeClass MinSizeClass(SizeClasses... size_classes) {
+  SizeClass result = SizeClass::Exact;
+  ((result = size_classes < result ? size_classes : result), ...);
+  return result;
+}
+
+// The properties of an enumerable (an EnumerableSource, an Enumerable or a Cinq) known at compile time, which drive the rewrites of the
+//   queries built on it (e.g. Cinq::Distinct is dropped if the elements are already unique, and Cinq::Count doesn't enumerate an enumerable
+//   of exact size).
+// is_elements_unique: no two elements are equal. Compare: the comparator which orders the elements (std::less<> for operator<), void if
+//   they aren't known to be sorted, see Cinq::AssumeSorted. size_class: see SizeClass. is_const: the elements are yielded as const.
+//   has_domain: the elements are integers whose domain is declared, see Cinq::WithDomain.
 template <class T>
 struct EnumerableTraits {
   static constexpr bool is_member = false;
 
   static constexpr bool is_elements_unique = false;
+  using Compare = void;
+  static constexpr bool is_sorted = false;
+  static constexpr SizeClass size_class = SizeClass::Unknown;
+  static constexpr bool is_const = false;
+  static constexpr bool has_domain = false;
 };
 
-template <bool ConstVersion, OperatorType operator_type, class Fn, class... Sources>
-struct EnumerableTraits<detail::Enumerable<ConstVersion, operator_type, Fn, Sources...>> {
+template <bool ConstVersion, class TSource>
+struct EnumerableTraits<detail::EnumerableSource<ConstVersion, TSource>> {
+  using Source = detail::EnumerableSource<ConstVersion, TSource>;
+  using Container = std::remove_const_t<typename Source::ContainerType>;
+
   static constexpr bool is_member = true;
 
-  static constexpr bool is_elements_unique = operator_type == OperatorType::Distinct || right_fold_and_v<EnumerableTraits<Sources>::is_elements_unique...>;
+  static constexpr bool is_elements_unique = ContainerTraits<Container>::is_elements_unique;
+  using Compare = typename ContainerTraits<Container>::Compare;
+  static constexpr bool is_sorted = !std::is_void_v<Compare>;
+  static constexpr SizeClass size_class =
+    detail::is_sized_container<typename Source::ContainerType>::value || is_random_access_iterator_v<typename Source::ResultIterator>
+      ? SizeClass::Exact
+      : SizeClass::Unknown;
+  static constexpr bool is_const = ConstVersion;
+  static constexpr bool has_domain = false;
 };
 
-template <bool ConstVersion, class Source>
-struct EnumerableTraits<detail::EnumerableSource<ConstVersion, Source>> {
+// The properties of a query, derived from the ones of its sources.
+template <bool ConstVersion, bool unique, class TCompare, SizeClass size, bool domain = false>
+struct QueryTraits {
   static constexpr bool is_member = true;
 
-  static constexpr bool is_elements_unique = EnumerableTraits<Source>::is_elements_unique;
+  static constexpr bool is_elements_unique = unique;
+  using Compare = TCompare;
+  static constexpr bool is_sorted = !std::is_void_v<Compare>;
+  static constexpr SizeClass size_class = size;
+  static constexpr bool is_const = ConstVersion;
+  static constexpr bool has_domain = domain;
 };
 
-template <class T>
-struct SpecializedIteratorTraits {
-  
-};
+// SelectMany knows nothing of its elements, nor does Join.
+template <bool ConstVersion, class QueryTag, class TTupleFns, class... TSources>
+struct EnumerableTraits<detail::Enumerable<ConstVersion, QueryTag, TTupleFns, TSources...>>
+  : QueryTraits<ConstVersion, false, void, SizeClass::Unknown> {};
+
+template <bool ConstVersion, class TTupleFns, class TSource, class TSource2>
+struct EnumerableTraits<detail::Enumerable<ConstVersion, detail::QueryCategory::Join, TTupleFns, TSource, TSource2>>
+  : QueryTraits<ConstVersion, false, void,
+      UpperBound(MinSizeClass(EnumerableTraits<TSource>::size_class, EnumerableTraits<TSource2>::size_class))> {};
+
+// The selector may map different elements to equal values.
+template <bool ConstVersion, class TFn, class TSource>
+struct EnumerableTraits<detail::Enumerable<ConstVersion, detail::QueryCategory::Select, std::tuple<TFn>, TSource>>
+  : QueryTraits<ConstVersion, false, void, EnumerableTraits<TSource>::size_class> {};
+
+template <bool ConstVersion, class TFn, class TSource>
+struct EnumerableTraits<detail::Enumerable<ConstVersion, detail::QueryCategory::Where, std::tuple<TFn>, TSource>>
+  : QueryTraits<ConstVersion, EnumerableTraits<TSource>::is_elements_unique, typename EnumerableTraits<TSource>::Compare,
+      UpperBound(EnumerableTraits<TSource>::size_class), EnumerableTraits<TSource>::has_domain> {};
+
+template <bool ConstVersion, class TFn, class TSource>
+struct EnumerableTraits<detail::Enumerable<ConstVersion, detail::QueryCategory::Batched, std::tuple<TFn>, TSource>>
+  : QueryTraits<ConstVersion, EnumerableTraits<TSource>::is_elements_unique, typename EnumerableTraits<TSource>::Compare,
+      EnumerableTraits<TSource>::size_class, EnumerableTraits<TSource>::has_domain> {};
+
+// Distinct keeps the first occurrence of each element, in the order of its source.
+template <bool ConstVersion, class TTupleFns, class TSource>
+struct EnumerableTraits<detail::Enumerable<ConstVersion, detail::QueryCategory::Distinct, TTupleFns, TSource>>
+  : QueryTraits<ConstVersion, true, typename EnumerableTraits<TSource>::Compare, UpperBound(EnumerableTraits<TSource>::size_class),
+      EnumerableTraits<TSource>::has_domain> {};
+
+// Union yields the elements of its sources one after another, so they aren't sorted.
+template <bool ConstVersion, class TTupleFns, class... TSources>
+struct EnumerableTraits<detail::Enumerable<ConstVersion, detail::QueryCategory::Union, TTupleFns, TSources...>>
+  : QueryTraits<ConstVersion, true, void, UpperBound(MinSizeClass(EnumerableTraits<TSources>::size_class...))> {};
+
+// An intersection is bounded by any of its sources.
+template <bool ConstVersion, class TTupleFns, class... TSources>
+struct EnumerableTraits<detail::Enumerable<ConstVersion, detail::QueryCategory::Intersect, TTupleFns, TSources...>>
+  : QueryTraits<ConstVersion, true, void,
+      ((EnumerableTraits<TSources>::size_class != SizeClass::Unknown) || ...) ? SizeClass::Bounded : SizeClass::Unknown> {};
+
+// Except keeps the order of the first source, made distinct by Cinq::Except.
+template <bool ConstVersion, class TTupleFns, class TSource, class... TExcluded>
+struct EnumerableTraits<detail::Enumerable<ConstVersion, detail::QueryCategory::Except, TTupleFns, TSource, TExcluded...>>
+  : QueryTraits<ConstVersion, EnumerableTraits<TSource>::is_elements_unique, typename EnumerableTraits<TSource>::Compare,
+      UpperBound(EnumerableTraits<TSource>::size_class), EnumerableTraits<TSource>::has_domain> {};
+
+template <bool ConstVersion, class TFn, class TSource>
+struct EnumerableTraits<detail::Enumerable<ConstVersion, detail::QueryCategory::AssumeSorted, std::tuple<TFn>, TSource>>
+  : QueryTraits<ConstVersion, EnumerableTraits<TSource>::is_elements_unique, TFn, EnumerableTraits<TSource>::size_class,
+      EnumerableTraits<TSource>::has_domain> {};
+
+// The merges yield distinct elements in the order of their sources.
+template <bool ConstVersion, class TFn, class TSource>
+struct EnumerableTraits<detail::Enumerable<ConstVersion, detail::QueryCategory::SortedDistinct, std::tuple<TFn>, TSource>>
+  : QueryTraits<ConstVersion, true, TFn, UpperBound(EnumerableTraits<TSource>::size_class), EnumerableTraits<TSource>::has_domain> {};
+
+template <bool ConstVersion, class TFn, class... TSources>
+struct EnumerableTraits<detail::Enumerable<ConstVersion, detail::QueryCategory::SortedUnion, std::tuple<TFn>, TSources...>>
+  : QueryTraits<ConstVersion, true, TFn, UpperBound(MinSizeClass(EnumerableTraits<TSources>::size_class...))> {};
+
+template <bool ConstVersion, class TFn, class... TSources>
+struct EnumerableTraits<detail::Enumerable<ConstVersion, detail::QueryCategory::SortedIntersect, std::tuple<TFn>, TSources...>>
+  : QueryTraits<ConstVersion, true, TFn,
+      ((EnumerableTraits<TSources>::size_class != SizeClass::Unknown) || ...) ? SizeClass::Bounded : SizeClass::Unknown> {};
+
+template <bool ConstVersion, class TFn, class TSource, class... TExcluded>
+struct EnumerableTraits<detail::Enumerable<ConstVersion, detail::QueryCategory::SortedExcept, std::tuple<TFn>, TSource, TExcluded...>>
+  : QueryTraits<ConstVersion, true, TFn, UpperBound(EnumerableTraits<TSource>::size_class), EnumerableTraits<TSource>::has_domain> {};
+
+template <bool ConstVersion, class TFn, class TSource>
+struct EnumerableTraits<detail::Enumerable<ConstVersion, detail::QueryCategory::WithDomain, std::tuple<TFn>, TSource>>
+  : QueryTraits<ConstVersion, EnumerableTraits<TSource>::is_elements_unique, typename EnumerableTraits<TSource>::Compare,
+      EnumerableTraits<TSource>::size_class, true> {};
+
+// The set operations over integers filter their first source in its order.
+template <bool ConstVersion, class TFn, class TSource, class... TProbes>
+struct EnumerableTraits<detail::Enumerable<ConstVersion, detail::QueryCategory::DomainSetOperation, std::tuple<TFn>, TSource, TProbes...>>
+  : QueryTraits<ConstVersion, true, typename EnumerableTraits<TSource>::Compare, UpperBound(EnumerableTraits<TSource>::size_class),
+      EnumerableTraits<TSource>::has_domain> {};
+
+// OrderBy keeps the elements of its source, sorted by their keys rather than by the elements. Take bounds the size by its count.
+template <bool ConstVersion, class TFn, class TSource>
+struct EnumerableTraits<detail::Enumerable<ConstVersion, detail::QueryCategory::OrderBy, std::tuple<TFn>, TSource>>
+  : QueryTraits<ConstVersion, EnumerableTraits<TSource>::is_elements_unique, void,
+      TFn::is_partial ? Truncated(EnumerableTraits<TSource>::size_class) : EnumerableTraits<TSource>::size_class,
+      EnumerableTraits<TSource>::has_domain> {};
+
+template <bool ConstVersion, class TFn, class TSource>
+struct EnumerableTraits<detail::Enumerable<ConstVersion, detail::QueryCategory::Take, std::tuple<TFn>, TSource>>
+  : QueryTraits<ConstVersion, EnumerableTraits<TSource>::is_elements_unique, typename EnumerableTraits<TSource>::Compare,
+      Truncated(EnumerableTraits<TSource>::size_class), EnumerableTraits<TSource>::has_domain> {};
+
+template <bool ConstVersion, class TTupleFns, class... TSources>
+struct EnumerableTraits<detail::Enumerable<ConstVersion, detail::QueryCategory::Concat, TTupleFns, TSources...>>
+  : QueryTraits<ConstVersion, false, void, MinSizeClass(EnumerableTraits<TSources>::size_class...),
+      (EnumerableTraits<TSources>::has_domain && ...)> {};
+
+// Cinq::Const only changes the constness of the following queries, the elements of this one are the ones of its enumerable.
+template <bool ConstVersion, class TEnumerable>
+struct EnumerableTraits<detail::Cinq<ConstVersion, TEnumerable>> : EnumerableTraits<TEnumerable> {};
 
 } // namespace cinq::utility
@@ -1,6 +1,9 @@
 #pragma once
 
+#include <functional>
+#include <iterator>
 #include <memory>
+#include <stdexcept>
 #include <type_traits>
 
 namespace cinq::utility {
@@ -43,10 +46,24 @@ constexpr bool right_fold_and() {
 template <bool... value>
 inline constexpr bool right_fold_and_v = right_fold_and<value...>();
 
+// The category of an iterator, or std::input_iterator_tag if it doesn't declare one (a user provided iterator may not).
+template <class TIterator, class = void>
+struct iterator_category {
+  using type = std::input_iterator_tag;
+};
+template <class TIterator>
+struct iterator_category<TIterator, std::void_t<typename std::iterator_traits<TIterator>::iterator_category>> {
+  using type = typename std::iterator_traits<TIterator>::iterator_category;
+};
+template <class TIterator>
+using iterator_category_t = typename iterator_category<TIterator>::type;
+template <class TIterator>
+inline constexpr bool is_random_access_iterator_v = std::is_base_of_v<std::random_access_iterator_tag, iterator_category_t<TIterator>>;
+
 template <class T, class = void>
 struct is_hashable : std::false_type {};
 template <class T>
-struct is_hashable<T, std::void_t<std::hash<T>>> : std::true_type {};
+struct is_hashable<T, std::void_t<decltype(std::hash<T>{}(std::declval<const T &>()))>> : std::true_type {};
 template <class T>
 inline constexpr bool is_hashable_v = is_hashable<T>::value;
 
@@ -98,6 +115,25 @@ struct transform_to_function_object_argument {
 template <bool ConstVersion, class SourceYieldType>
 using transform_to_function_object_argument_t = typename transform_to_function_object_argument<ConstVersion, SourceYieldType>::type;
 
+// Calls fn with v as a TArgument (see transform_to_function_object_argument) without letting fn consume v, so that v can still be
+//   forwarded afterward. An rvalue argument is passed as a const lvalue instead, or as a copy if fn only accepts rvalues
+//   (a move-only v is moved as a last resort).
+template <class TArgument, class Fn, class T>
+decltype(auto) InvokeWithoutConsuming(Fn &&fn, T &v) {
+  if constexpr (std::is_lvalue_reference_v<TArgument>) {
+    return std::invoke(std::forward<Fn>(fn), static_cast<TArgument>(v));
+  } else {
+    const std::remove_reference_t<TArgument> &argument = v;
+    using Copy = std::remove_cv_t<std::remove_reference_t<TArgument>>;
+    if constexpr (std::is_invocable_v<Fn, decltype(argument)>)
+      return std::invoke(std::forward<Fn>(fn), argument);
+    else if constexpr (std::is_copy_constructible_v<Copy>)
+      return std::invoke(std::forward<Fn>(fn), Copy(argument));
+    else // Can't be preserved.
+      return std::invoke(std::forward<Fn>(fn), static_cast<TArgument>(v));
+  }
+}
+
 template <class...>
 struct is_all_same;
 template <class T1, class T2, class... Args>
@@ -1,10 +1,15 @@
 #pragma once
 
+#include <algorithm>
 #include <any>
+#include <atomic>
+#include <cmath>
+#include <cstdint>
 #include <deque>
 #include <forward_list>
 #include <iostream>
 #include <iterator>
+#include <limits>
 #include <list>
 #include <memory>
 #include <utility>
@@ -12,6 +17,8 @@
 #include <numeric>
 #include <string>
 #include <functional>
+#include <stdexcept>
+#include <thread>
 
 #include "cinq.h"
 #include "cinq-test-utility.h"
@@ -37,11 +44,17 @@ void IntersectTest();
 void UnionTest();
 void ConcatTest();
 void DistinctTest();
+void ExceptTest();
+void SortedSetOperationTest();
+void DomainSetOperationTest();
+void EnumerableTraitsTest();
 
 void NoCopyGuaranteeTest();
 void SetOperationInternalContainerTest();
 void SetOperationAliasTest();
 
+void LongQueryIteratorSizeTest();
+
 class MiniContainer {
 public:
   auto begin() { return std::begin(data); }
@@ -133,6 +146,41 @@ void TestCinqSelectMany() {
       std::equal(vtr.begin(), vtr.begin(), five_elements.begin())
     );
   }
+
+  // only the current produced enumerable is kept alive # set operations copy the elements of released enumerables
+  {
+    auto tracker = std::make_shared<int>(0);
+    auto query = Cinq(five_elements).SelectMany([&tracker](auto) {return std::vector<std::shared_ptr<int>>{ tracker, tracker }; });
+    size_t count = 0;
+    for (auto first = query.begin(), last = query.end(); first != last; ++first, ++count) {
+      auto copy = first;
+      cinq::utility::CinqAssert(copy == first && *copy == tracker && tracker.use_count() == 3);
+    }
+    cinq::utility::CinqAssert(count == 10 && tracker.use_count() == 1);
+
+    std::vector<int> source{ 1, 2, 2, 3 };
+    auto distinct_query = Cinq(source).SelectMany([](int x) {return std::vector<int>{ x, x + 1 }; }).Distinct();
+    cinq::utility::CinqAssert(ToVector(distinct_query) == std::vector<int>{ 1, 2, 3, 4 });
+  }
+
+  // the size is exact if the selector yields references to sized containers
+  {
+    std::vector<std::vector<int>> source{ {1, 2}, {}, {3}, {4, 5, 6} };
+    auto query = Cinq(source).SelectMany([](const std::vector<int> &x) -> const std::vector<int> & {return x; });
+    auto hint = SourceSizeHint(query);
+    auto vtr = query.ToVector();
+    cinq::utility::CinqAssert(hint.is_exact && hint.size == 6 && vtr == std::vector<int>{ 1, 2, 3, 4, 5, 6 } && vtr.capacity() == 6);
+
+    auto owned_query = Cinq(source).SelectMany([](const std::vector<int> &x) {return x; });
+    cinq::utility::CinqAssert(!SourceSizeHint(owned_query).IsKnown() && owned_query.ToVector() == vtr);
+
+    // a query source isn't enumerated for the size
+    size_t called = 0;
+    auto where_query = Cinq(source).Where([](auto &) {return true; })
+      .SelectMany([&called](const std::vector<int> &x) -> const std::vector<int> & {++called; return x; });
+    cinq::utility::CinqAssert(!SourceSizeHint(where_query).IsKnown() && called == 0);
+    cinq::utility::CinqAssert(where_query.ToVector() == vtr && called == 4);
+  }
 }
 
 void TestCinqSelect() {
@@ -172,6 +220,44 @@ void TestCinqSelect() {
       std::equal(vtr.begin(), vtr.begin(), five_elements.begin())
     );
   }
+
+  // consecutive Selects are fused into one # the result of a selector is passed to the next one as a Select would pass it
+  {
+    std::vector<int> source{ 1, 2, 3, 4, 5 };
+    auto query = Cinq(source).Select([](int &x) -> int & {return x; })
+      .Select([](int &x) {return &x; })
+      .Select([](int *x) {return std::to_string(*x); })
+      .Select([](std::string &&x) {return x + "!"; });
+    using Fused = cinq::detail::fusible_query<false, cinq::detail::QueryCategory::Select, std::decay_t<decltype(GetEnumerable(std::move(query)))>>;
+    static_assert(Fused::value && cinq::detail::is_enumerable_source_v<typename Fused::Source>);
+
+    auto vtr = ToVector(query);
+    cinq::utility::CinqAssert(vtr == std::vector<std::string>{ "1!", "2!", "3!", "4!", "5!" });
+    cinq::utility::CinqAssert(ToVector(query) == vtr);
+
+    auto const_query = Cinq(source).Const().Select([](const int &x) -> const int & {return x; }).Select([](const int &x) {return x * 2; });
+    cinq::utility::CinqAssert(ToVector(const_query) == std::vector<int>{ 2, 4, 6, 8, 10 });
+  }
+
+  // $ is random access # is random access # $ is bidirectional # is bidirectional
+  {
+    std::vector<int> source{ 1, 3, 5, 7, 9 };
+    auto query = Cinq(source).Select([](int x) {return x * 2; });
+    using Iterator = decltype(query.begin());
+    static_assert(std::is_same_v<std::iterator_traits<Iterator>::iterator_category, std::random_access_iterator_tag>);
+    cinq::utility::CinqAssert(std::distance(query.begin(), query.end()) == 5 && query.begin()[2] == 10 && *(query.end() - 1) == 18);
+    cinq::utility::CinqAssert(*std::lower_bound(query.begin(), query.end(), 13) == 14 && query.begin() + 5 == query.end());
+    cinq::utility::CinqAssert(std::vector<int>(query.begin(), query.end()) == ToVector(query));
+
+    std::list<int> list_source(source.begin(), source.end());
+    auto list_query = Cinq(list_source).Select([](int x) {return x; });
+    static_assert(std::is_same_v<std::iterator_traits<decltype(list_query.begin())>::iterator_category, std::bidirectional_iterator_tag>);
+    cinq::utility::CinqAssert(*--list_query.end() == 9 && std::equal(source.rbegin(), source.rend(),
+      std::make_reverse_iterator(list_query.end()), std::make_reverse_iterator(list_query.begin())));
+
+    auto where_query = Cinq(source).Where([](int) {return true; });
+    static_assert(std::is_same_v<std::iterator_traits<decltype(where_query.begin())>::iterator_category, std::input_iterator_tag>);
+  }
 }
 
 void TestCinqJoin() {
@@ -220,6 +306,69 @@ void TestCinqJoin() {
     }
   }
 
+  // # key is not hashable
+  {
+    struct Key {
+      int value;
+      bool operator==(const Key &rhs) const { return value == rhs.value; }
+    };
+
+    auto query = ToVector(Cinq(five_elements).Join(five_elements, [](auto x) {return Key{x%2};}, [](auto x) {return Key{x%2};}, [](auto a, auto b) {return a*1000 + b;}));
+    std::vector<int> hand_write_result;
+    for (int x : five_elements) {
+      for (int y : five_elements)
+        if (x%2 == y%2)
+          hand_write_result.push_back(x*1000 + y);
+    }
+    cinq::utility::CinqAssert(query.size() == hand_write_result.size() &&
+      std::equal(query.begin(), query.end(), hand_write_result.begin()));
+  }
+
+  // # keys are of different types
+  {
+    auto query = ToVector(Cinq(five_elements).Join(five_elements, [](auto x) {return int(x);}, [](auto x) {return static_cast<long long>(x) - 1;}, [](auto a, auto b) {return a*1000 + b;}));
+    cinq::utility::CinqAssert(query.size() == 4 && query.front() == 1 && query.back() == 3004);
+  }
+
+  // # key is less than comparable but not hashable # the order is the one of the outer source, as for a hashable key
+  {
+    struct Key {
+      int value;
+      bool operator<(const Key &rhs) const { return value < rhs.value; }
+    };
+
+    auto query = ToVector(Cinq(five_elements).Join(five_elements, [](auto x) {return Key{x%2};}, [](auto x) {return Key{x%2};}, [](auto a, auto b) {return a*1000 + b;}));
+    std::vector<int> hand_write_result;
+    for (int x : five_elements) {
+      for (int y : five_elements)
+        if (x%2 == y%2)
+          hand_write_result.push_back(x*1000 + y);
+    }
+    auto hashed_query = ToVector(Cinq(five_elements).Join(five_elements, [](auto x) {return x%2;}, [](auto x) {return x%2;}, [](auto a, auto b) {return a*1000 + b;}));
+    cinq::utility::CinqAssert(std::equal(hashed_query.begin(), hashed_query.end(), hand_write_result.begin(), hand_write_result.end()));
+    cinq::utility::CinqAssert(query.size() == hand_write_result.size() &&
+      std::equal(query.begin(), query.end(), hand_write_result.begin()));
+  }
+
+  // # both sides are ordered by key
+  {
+    std::vector<int> outer{1, 2, 2, 3, 5, 7, 7};
+    std::vector<int> inner{0, 2, 2, 3, 4, 5, 7};
+
+    auto query = ToVector(Cinq(outer).Join(inner, [](auto x) {return x;}, [](auto x) {return x;}, [](auto a, auto b) {return std::make_tuple(a, b);}, cinq::ordered_by_key));
+    std::vector<std::tuple<int, int>> hand_write_result;
+    for (auto x : outer) {
+      for (auto y : inner)
+        if (x == y)
+          hand_write_result.emplace_back(x, y);
+    }
+    cinq::utility::CinqAssert(query.size() == hand_write_result.size() &&
+      std::equal(query.begin(), query.end(), hand_write_result.begin()));
+
+    auto empty_query = ToVector(Cinq(outer).Join(std::vector<int>{}, [](auto x) {return x;}, [](auto x) {return x;}, [](auto a, auto b) {return a + b;}, cinq::ordered_by_key));
+    cinq::utility::CinqAssert(empty_query.size() == 0);
+  }
+
   std::vector<std::vector<int>> sources;
   sources.resize(10);
 
@@ -312,10 +461,679 @@ void TestCinqWhere() {
     cinq::utility::CinqAssert(vtr.size() == five_elements.size() &&
       std::equal(vtr.begin(), vtr.end(), five_elements.begin()));
   }
+
+  // comparison predicates # compared with lambdas # every instruction set supported by the CPU
+  {
+    auto check = [](const auto &source, const auto &pred, const auto &fn) {
+      using T = typename std::decay_t<decltype(source)>::value_type;
+      std::vector<T> expected;
+      std::copy_if(source.begin(), source.end(), std::back_inserter(expected), fn);
+      auto vtr = Cinq(std::ref(source)).Where(pred).ToVector();
+      cinq::utility::CinqAssert(vtr == expected);
+
+      namespace simd = cinq::detail::simd;
+      std::vector<std::uint32_t> selection(source.size());
+      for (auto isa : { simd::Isa::Scalar, simd::Isa::Sse2, simd::Isa::Avx2, simd::Isa::Avx512 }) {
+        if (isa > simd::ActiveIsa())
+          continue;
+        size_t size = isa == simd::Isa::Avx512 ? simd::FilterDense<simd::Isa::Avx512>(pred, source.data(), source.size(), selection.data()) :
+          isa == simd::Isa::Avx2 ? simd::FilterDense<simd::Isa::Avx2>(pred, source.data(), source.size(), selection.data()) :
+          isa == simd::Isa::Sse2 ? simd::FilterDense<simd::Isa::Sse2>(pred, source.data(), source.size(), selection.data()) :
+          simd::FilterDense<simd::Isa::Scalar>(pred, source.data(), source.size(), selection.data());
+        cinq::utility::CinqAssert(size == expected.size());
+        for (size_t i = 0; i < size; ++i)
+          cinq::utility::CinqAssert(source[selection[i]] == expected[i]);
+      }
+    };
+
+    for (size_t size : { 0, 1, 63, 64, 65, 1025, 3000 }) {
+      std::vector<int> ints(size);
+      std::vector<long long> longs(size);
+      std::vector<float> floats(size);
+      std::vector<double> doubles(size);
+      for (size_t i = 0; i < size; ++i) {
+        ints[i] = static_cast<int>(i * 7 % 11) - 5;
+        longs[i] = static_cast<long long>(ints[i]) * (1ll << 33);
+        floats[i] = ints[i] * 0.5f;
+        doubles[i] = ints[i] * 0.25;
+      }
+
+      check(ints, cinq::Equal(3), [](int x) {return x == 3; });
+      check(ints, cinq::Less(-2) || cinq::GreaterEqual(4), [](int x) {return x < -2 || x >= 4; });
+      check(longs, cinq::Greater(1ll << 33), [](long long x) {return x > 1ll << 33; });
+      check(longs, cinq::Between(-(2ll << 33), 2ll << 33), [](long long x) {return x >= -(2ll << 33) && x <= 2ll << 33; });
+      check(floats, cinq::LessEqual(0.5f) && cinq::Greater(-1.5f), [](float x) {return x <= 0.5f && x > -1.5f; });
+      check(doubles, cinq::Greater(0) || cinq::Equal(-1.25), [](double x) {return x > 0 || x == -1.25; });
+    }
+  }
+
+  // consecutive Wheres are fused into one # comparison predicates stay vectorized # the second predicate only sees the elements passing the first
+  {
+    std::vector<int> source{ 5, 1, 4, 2, 3 };
+    size_t call_count = 0;
+    auto query = Cinq(source).Where([](int x) {return x != 4; }).Where([&call_count](int &x) {++call_count; return x > 1; });
+    using Fused = cinq::detail::fusible_query<false, cinq::detail::QueryCategory::Where, std::decay_t<decltype(GetEnumerable(std::move(query)))>>;
+    static_assert(Fused::value && cinq::detail::is_enumerable_source_v<typename Fused::Source>);
+    cinq::utility::CinqAssert(ToVector(query) == std::vector<int>{ 5, 2, 3 } && call_count == 4);
+
+    auto comparison_query = Cinq(source).Where(cinq::Greater(1)).Where(cinq::Less(5));
+    using ComparisonQuery = std::decay_t<decltype(GetEnumerable(std::move(comparison_query)))>;
+    static_assert(cinq::detail::is_fusible_query_v<false, cinq::detail::QueryCategory::Where, ComparisonQuery> &&
+      cinq::detail::prefers_batch_evaluation_v<ComparisonQuery>);
+    cinq::utility::CinqAssert(ToVector(comparison_query) == std::vector<int>{ 4, 2, 3 });
+
+    auto mixed_query = Cinq(source).Where(cinq::Greater(1)).Where([](int x) {return x % 2 == 1; });
+    using MixedQuery = std::decay_t<decltype(GetEnumerable(std::move(mixed_query)))>;
+    static_assert(!cinq::detail::is_enumerable_source_v<typename cinq::detail::fusible_query<false, cinq::detail::QueryCategory::Where, MixedQuery>::Source>);
+    cinq::utility::CinqAssert(ToVector(mixed_query) == std::vector<int>{ 5, 3 });
+
+    auto prvalue_query = Cinq(source).Select([](int x) {return std::to_string(x); })
+      .Where([](std::string x) {return x != "4"; })
+      .Where([](std::string x) {return x != "1"; });
+    std::vector<std::string> expected{ "5", "2", "3" };
+    cinq::utility::CinqAssert(ToVector(prvalue_query) == expected && prvalue_query.ToVector() == expected);
+  }
 }
 
 void TestCinqToVector() {
   // postpond. ToVector is trivial and is used in most unit test.
+
+  // size hint # is exact for Select and Concat # is bounded by Where, Distinct and Join # is unknown for forward_list
+  {
+    std::vector<int> source{ 1, 2, 2, 3, 4 };
+    std::list<int> list_source(source.begin(), source.end());
+    std::forward_list<int> forward_list_source(source.begin(), source.end());
+
+    auto select_query = Cinq(source).Select([](int x) {return x * 2; });
+    auto select_hint = SourceSizeHint(select_query);
+    cinq::utility::CinqAssert(select_hint.is_exact && select_hint.size == 5);
+    auto vtr = select_query.ToVector();
+    cinq::utility::CinqAssert(vtr == std::vector<int>{ 2, 4, 4, 6, 8 } && vtr.capacity() == 5);
+
+    auto concat_query = Cinq(source).Concat(list_source);
+    auto concat_hint = SourceSizeHint(concat_query);
+    cinq::utility::CinqAssert(concat_hint.is_exact && concat_hint.size == 10 && concat_query.ToVector().capacity() == 10);
+
+    auto where_query = Cinq(source).Where([](int x) {return x > 2; });
+    auto distinct_query = Cinq(list_source).Distinct();
+    auto where_hint = SourceSizeHint(where_query);
+    auto distinct_hint = SourceSizeHint(distinct_query);
+    cinq::utility::CinqAssert(!where_hint.is_exact && where_hint.size == 5 && !distinct_hint.is_exact && distinct_hint.size == 5);
+
+    auto join_query = Cinq(source).Join(list_source, [](int x) {return x; }, [](int x) {return x; }, [](int x, int) {return x; });
+    auto join_hint = SourceSizeHint(join_query);
+    cinq::utility::CinqAssert(!join_hint.is_exact && join_hint.size == 25);
+
+    auto unknown_query = Cinq(forward_list_source).Select([](int x) {return x; }).Concat(source);
+    auto unknown_hint = SourceSizeHint(unknown_query);
+    cinq::utility::CinqAssert(!unknown_hint.IsKnown() && !unknown_hint.is_exact);
+
+    auto empty_join_query = Cinq(forward_list_source).Join(std::vector<int>{}, [](int x) {return x; }, [](int x) {return x; },
+      [](int x, int) {return x; });
+    auto empty_join_hint = SourceSizeHint(empty_join_query);
+    cinq::utility::CinqAssert(empty_join_hint.size == 0);
+  }
+}
+
+void TestCinqForEach() {
+  // $ is empty
+  {
+    size_t count = 0;
+    Cinq(empty_source).Where([](auto) {return true; }).ForEach([&count](auto) { ++count; });
+    cinq::utility::CinqAssert(count == 0);
+    cinq::utility::CinqAssert(Cinq(empty_source).Count() == 0);
+    cinq::utility::CinqAssert(Cinq(empty_source).Aggregate(1, [](int sum, int x) { return sum + x; }) == 1);
+    cinq::utility::CinqAssert(Cinq(empty_source).All([](auto) {return false; }));
+  }
+
+  // $ has one element
+  {
+    std::vector<int> vtr;
+    Cinq(one_element).Select([](auto x) {return x * 2; }).ForEach([&vtr](int x) { vtr.push_back(x); });
+    cinq::utility::CinqAssert(vtr == std::vector<int>{ one_element.front() * 2 });
+    cinq::utility::CinqAssert(Cinq(one_element).Count() == 1);
+  }
+
+  // $ has five elements # order is kept # elements are passed as lvalues of the source
+  {
+    std::vector<const LifeTimeCheckInt *> addresses;
+    Cinq(std::ref(five_elements)).ForEach([&addresses](const LifeTimeCheckInt &x) { addresses.push_back(&x); });
+    cinq::utility::CinqAssert(addresses.size() == five_elements.size());
+    for (size_t i = 0; i < addresses.size(); ++i)
+      cinq::utility::CinqAssert(addresses[i] == &five_elements[i]);
+
+    auto sum = Cinq(five_elements).Aggregate(0, [](int sum, const LifeTimeCheckInt &x) { return sum + x; });
+    cinq::utility::CinqAssert(sum == std::accumulate(five_elements.begin(), five_elements.end(), 0));
+    cinq::utility::CinqAssert(Cinq(five_elements).Where([](auto x) {return x != five_elements[2]; }).Count() == 4);
+  }
+
+  // All stops at the first element which doesn't satisfy the predicate
+  {
+    size_t called = 0;
+    auto result = Cinq(five_elements).Select([](auto x) {return x; }).All([&called](auto x) { ++called; return x != five_elements[1]; });
+    cinq::utility::CinqAssert(!result && called == 2);
+  }
+
+  // chained queries are pushed # compared with the iterators
+  {
+    std::vector<int> many_elements(1000);
+    std::iota(many_elements.begin(), many_elements.end(), 0);
+    auto query = Cinq(many_elements)
+      .Where([](int x) {return x % 2 == 0; })
+      .Select([](int x) {return x / 2; })
+      .Where([](int x) {return x % 3 != 0; })
+      .SelectMany([](int x) {return std::vector<int>(x % 3, x); })
+      .Join(many_elements, [](int x) {return x; }, [](int x) {return x / 2; }, [](int x, int y) {return x * 10000 + y; });
+    auto pushed = query.ToVector();
+    auto pulled = ToVector(query);
+    cinq::utility::CinqAssert(!pushed.empty() && pushed == pulled);
+    cinq::utility::CinqAssert(query.Count() == pulled.size());
+  }
+
+  // the predicate of a pushed Where takes prvalues by value # the element passed to the sink is left intact
+  {
+    std::vector<int> source{ 1, 2, 3 };
+    auto query = Cinq(source).Select([](int x) {return std::to_string(x); }).Where([](std::string x) {return x != "2"; });
+    std::vector<std::string> vtr;
+    query.ForEach([&vtr](std::string x) { vtr.push_back(std::move(x)); });
+    cinq::utility::CinqAssert(vtr == std::vector<std::string>{ "1", "3" });
+    cinq::utility::CinqAssert(query.ToVector() == vtr && ToVector(query) == vtr);
+  }
+
+  // queries which are not pushed are evaluated by iterators
+  {
+    auto vtr = Cinq(five_elements).Concat(one_element).Distinct().Select([](auto x) {return x; }).ToVector();
+    auto result = ToVector(Cinq(five_elements).Concat(one_element).Distinct());
+    cinq::utility::CinqAssert(vtr.size() == result.size() && std::equal(vtr.begin(), vtr.end(), result.begin()));
+  }
+}
+
+void TestCinqAsBatched() {
+  // $ is empty
+  {
+    auto vtr = Cinq(empty_source).AsBatched().Where([](auto) {return true; }).ToVector();
+    cinq::utility::CinqAssert(vtr.size() == 0);
+  }
+
+  // $ has five elements # elements are passed as lvalues of the source # includes the first # excludes a middle
+  {
+    std::vector<const LifeTimeCheckInt *> addresses;
+    Cinq(std::ref(five_elements)).AsBatched().Where([](auto &x) {return x != five_elements[2]; })
+      .ForEach([&addresses](const LifeTimeCheckInt &x) { addresses.push_back(&x); });
+    cinq::utility::CinqAssert(addresses == std::vector<const LifeTimeCheckInt *>{
+      &five_elements[0], &five_elements[1], &five_elements[3], &five_elements[4] });
+  }
+
+  // $ spans multiple batches # compared with the iterators
+  for (size_t size : { 1, 1023, 1024, 1025, 5000 }) {
+    std::vector<int> many_elements(size);
+    std::iota(many_elements.begin(), many_elements.end(), 0);
+    auto query = Cinq(std::ref(many_elements))
+      .Where([](int x) {return x % 3 != 0; })
+      .AsBatched()
+      .Select([](int x) {return x * 0.5; })
+      .Where([](double x) {return x < 1000; });
+    auto batched = query.ToVector();
+    auto pulled = ToVector(query);
+    cinq::utility::CinqAssert(batched == pulled && query.Count() == pulled.size());
+
+    size_t called = 0;
+    auto result = Cinq(std::ref(many_elements)).AsBatched().Where([](int x) {return x >= 0; })
+      .All([&called](const int &x) { ++called; return x < 1000; });
+    cinq::utility::CinqAssert(size <= 1000 ? result && called == size : !result && called == 1001);
+  }
+
+  // $ is not contiguous # evaluated per element
+  {
+    std::list<int> list_source{ 0, 1, 2, 3, 4 };
+    auto vtr = Cinq(list_source).AsBatched().Where([](int x) {return x % 2 == 0; }).ToVector();
+    cinq::utility::CinqAssert(vtr == std::vector<int>{ 0, 2, 4 });
+  }
+}
+
+void TestCinqNumericAggregates() {
+  // $ is empty
+  {
+    std::vector<double> empty_doubles;
+    cinq::utility::CinqAssert(Cinq(empty_doubles).Sum() == 0 && Cinq(empty_doubles).Sum(cinq::pairwise_summation) == 0);
+    cinq::utility::CinqAssert(Cinq(empty_doubles).Count(cinq::Greater(0.0)) == 0);
+
+    size_t thrown = 0;
+    for (auto aggregate : std::vector<std::function<void()>>{ [&]() { Cinq(empty_doubles).Min(); },
+        [&]() { Cinq(empty_doubles).Max(); }, [&]() { Cinq(empty_doubles).Average(); } }) {
+      try {
+        aggregate();
+      } catch (std::runtime_error &) {
+        ++thrown;
+      }
+    }
+    cinq::utility::CinqAssert(thrown == 3);
+  }
+
+  // $ has five elements # not arithmetic # with selectors
+  {
+    cinq::utility::CinqAssert(Cinq(five_elements).Sum([](const LifeTimeCheckInt &x) {return static_cast<int>(x); }) ==
+      std::accumulate(five_elements.begin(), five_elements.end(), 0));
+    cinq::utility::CinqAssert(Cinq(five_elements).Min() == *std::min_element(five_elements.begin(), five_elements.end()));
+    cinq::utility::CinqAssert(Cinq(five_elements).Max() == *std::max_element(five_elements.begin(), five_elements.end()));
+
+    std::vector<std::string> strings{ "b", "a", "c" };
+    cinq::utility::CinqAssert(Cinq(strings).Min() == "a" && Cinq(strings).Max([](const std::string &x) {return x + "!"; }) == "c!");
+  }
+
+  // $ spans multiple blocks and batches # compared with plain loops # every instruction set supported by the CPU
+  {
+    auto check = [](const auto &source) {
+      using T = typename std::decay_t<decltype(source)>::value_type;
+      using SumType = std::conditional_t<std::is_floating_point_v<T>, double, long long>;
+      SumType sum = 0;
+      for (auto x : source)
+        sum += x;
+      auto min = source.empty() ? T() : *std::min_element(source.begin(), source.end());
+      auto max = source.empty() ? T() : *std::max_element(source.begin(), source.end());
+      auto count = std::count_if(source.begin(), source.end(), [](T x) {return x > T(1); });
+
+      std::list<T> list_source(source.begin(), source.end());
+      cinq::utility::CinqAssert(static_cast<SumType>(Cinq(std::ref(source)).Sum()) == sum);
+      cinq::utility::CinqAssert(static_cast<SumType>(Cinq(std::ref(source)).Sum(cinq::pairwise_summation)) == sum);
+      cinq::utility::CinqAssert(static_cast<SumType>(Cinq(list_source).Sum()) == sum);
+      cinq::utility::CinqAssert(static_cast<SumType>(Cinq(std::ref(source)).Select([](T x) {return x * 2; }).Sum()) == sum * 2);
+      cinq::utility::CinqAssert(static_cast<SumType>(Cinq(std::ref(source)).Sum([](T x) {return x * 2; })) == sum * 2);
+      cinq::utility::CinqAssert(Cinq(std::ref(source)).Count(cinq::Greater(T(1))) == static_cast<size_t>(count));
+      cinq::utility::CinqAssert(Cinq(list_source).Count(cinq::Greater(T(1))) == static_cast<size_t>(count));
+      cinq::utility::CinqAssert(Cinq(std::ref(source)).Count([](T x) {return x > T(1); }) == static_cast<size_t>(count));
+      if (source.empty())
+        return ;
+
+      cinq::utility::CinqAssert(Cinq(std::ref(source)).Min() == min && Cinq(std::ref(source)).Max() == max);
+      cinq::utility::CinqAssert(Cinq(list_source).Min() == min && Cinq(list_source).Max() == max);
+      cinq::utility::CinqAssert(Cinq(std::ref(source)).Where([](T x) {return x != T(1); }).Max() == max);
+      cinq::utility::CinqAssert(min == max || Cinq(std::ref(source)).Where(cinq::Greater(min)).Min() != min);
+      auto average = static_cast<double>(Cinq(std::ref(source)).Average());
+      cinq::utility::CinqAssert(std::abs(average - static_cast<double>(sum) / source.size()) <= 1e-6 * std::abs(average));
+
+      namespace simd = cinq::detail::simd;
+      auto reduce = [&source](auto isa) {
+        constexpr auto value = decltype(isa)::value;
+        return std::make_tuple(static_cast<SumType>(simd::ReduceDense<value, simd::ReduceOp::Sum>(source.data(), source.size())),
+          simd::ReduceDense<value, simd::ReduceOp::Min>(source.data(), source.size()),
+          simd::ReduceDense<value, simd::ReduceOp::Max>(source.data(), source.size()));
+      };
+      for (auto isa : { simd::Isa::Scalar, simd::Isa::Sse2, simd::Isa::Avx2, simd::Isa::Avx512 }) {
+        if (isa > simd::ActiveIsa())
+          continue;
+        auto result = isa == simd::Isa::Avx512 ? reduce(std::integral_constant<simd::Isa, simd::Isa::Avx512>()) :
+          isa == simd::Isa::Avx2 ? reduce(std::integral_constant<simd::Isa, simd::Isa::Avx2>()) :
+          isa == simd::Isa::Sse2 ? reduce(std::integral_constant<simd::Isa, simd::Isa::Sse2>()) :
+          reduce(std::integral_constant<simd::Isa, simd::Isa::Scalar>());
+        cinq::utility::CinqAssert(result == std::make_tuple(sum, min, max));
+      }
+    };
+
+    for (size_t size : { 0, 1, 15, 16, 17, 63, 64, 65, 1023, 1025, 3000 }) {
+      std::vector<int> ints(size);
+      std::vector<long long> longs(size);
+      std::vector<unsigned short> shorts(size);
+      std::vector<float> floats(size);
+      std::vector<double> doubles(size);
+      for (size_t i = 0; i < size; ++i) {
+        ints[i] = static_cast<int>(i * 7919 % 1001) - 500;
+        longs[i] = static_cast<long long>(ints[i]) * (1ll << 33);
+        shorts[i] = static_cast<unsigned short>(ints[i] + 500);
+        floats[i] = ints[i] * 0.5f;
+        doubles[i] = ints[i] * 0.25;
+      }
+
+      check(ints);
+      check(longs);
+      check(shorts);
+      check(floats);
+      check(doubles);
+    }
+  }
+
+  // Min and Max are NaN if any element is NaN # Average of integers doesn't overflow
+  {
+    std::vector<double> doubles(100, 1.0);
+    doubles[70] = std::numeric_limits<double>::quiet_NaN();
+    cinq::utility::CinqAssert(std::isnan(Cinq(doubles).Min()) && std::isnan(Cinq(doubles).Max()));
+
+    std::vector<int> ints(3000, 2000000000);
+    cinq::utility::CinqAssert(Cinq(ints).Average() == 2000000000.0);
+  }
+
+  // pairwise summation keeps the rounding error of long sequences small
+  {
+    std::vector<double> doubles(1 << 22, 0.1);
+    double naive = 0;
+    for (double x : doubles)
+      naive += x;
+    double exact = 0.1 * doubles.size();
+    cinq::utility::CinqAssert(std::abs(Cinq(doubles).Sum(cinq::pairwise_summation) - exact) < std::abs(naive - exact));
+  }
+}
+
+void TestCinqAsParallel() {
+  std::vector<int> many_elements(10000);
+  std::iota(many_elements.begin(), many_elements.end(), 0);
+
+  // $ is empty
+  {
+    auto vtr = Cinq(empty_source).AsParallel(4).Where([](auto) {return true; }).ToVector();
+    cinq::utility::CinqAssert(vtr.size() == 0);
+    cinq::utility::CinqAssert(Cinq(empty_source).AsParallel(4).All([](auto) {return false; }));
+  }
+
+  // $ has five elements # order is kept
+  {
+    auto vtr = Cinq(five_elements).AsParallel(4).AsOrdered().Select([](auto x) {return x * 2; }).ToVector();
+    std::vector<int> result{ 0, 2, 4, 6, 8 };
+    cinq::utility::CinqAssert(vtr == result);
+
+    // the element is not default constructible
+    struct NoDefault {
+      explicit NoDefault(int x) : value(x) {}
+      int value;
+    };
+    auto elements = Cinq(std::cref(five_elements)).AsParallel(4).AsOrdered()
+      .Where([](auto x) {return x != 2; })
+      .Select([](int x) {return NoDefault(x); })
+      .ToVector();
+    static_assert(!std::is_default_constructible_v<decltype(elements)::value_type>);
+    cinq::utility::CinqAssert(elements.size() == 4 && elements[1].value == 1 && elements[2].value == 3);
+  }
+
+  // $ has many elements # chained Where and Select
+  {
+    auto vtr = Cinq(std::cref(many_elements)).AsParallel(4).AsOrdered()
+      .Where([](int x) {return x % 3 == 0; })
+      .Select([](int x) {return std::to_string(x); })
+      .Where([](const std::string &x) {return x.back() != '0'; })
+      .ToVector();
+    auto result = Cinq(std::cref(many_elements))
+      .Where([](int x) {return x % 3 == 0; })
+      .Select([](int x) {return std::to_string(x); })
+      .Where([](const std::string &x) {return x.back() != '0'; })
+      .ToVector();
+    cinq::utility::CinqAssert(vtr.size() == result.size() && vtr == result);
+
+    cinq::utility::CinqAssert(Cinq(std::cref(many_elements)).AsParallel(4).All([](int x) {return x >= 0; }));
+    cinq::utility::CinqAssert(!Cinq(std::cref(many_elements)).AsParallel(4).All([](int x) {return x != 5000; }));
+  }
+
+  // # unordered
+  {
+    auto vtr = Cinq(std::cref(many_elements)).AsParallel(4).Where([](int x) {return x % 3 == 0; }).ToVector();
+    std::sort(vtr.begin(), vtr.end());
+    auto result = Cinq(std::cref(many_elements)).Where([](int x) {return x % 3 == 0; }).ToVector();
+    cinq::utility::CinqAssert(vtr == result);
+
+    auto ordered_vtr = Cinq(std::cref(many_elements)).AsParallel(4).AsOrdered().AsUnordered().Where([](int x) {return x % 3 == 0; }).ToVector();
+    std::sort(ordered_vtr.begin(), ordered_vtr.end());
+    cinq::utility::CinqAssert(ordered_vtr == result);
+  }
+
+  // SelectMany produces enumerables of very different sizes
+  {
+    auto selector = [](int x) {return std::vector<int>(x % 1000 == 0 ? 1000 : x % 3, x); };
+    auto vtr = Cinq(std::cref(many_elements)).AsParallel(4).AsOrdered().SelectMany(selector).ToVector();
+    auto result = Cinq(std::cref(many_elements)).SelectMany(selector).ToVector();
+    cinq::utility::CinqAssert(vtr.size() == result.size() && vtr == result);
+  }
+
+  // Join with hashable key # keys are skewed
+  {
+    auto outer_key = [](int x) {return x % 1000 == 0 ? 0 : x; };
+    auto inner_key = [](int x) {return x % 2 == 0 ? 0 : x; };
+    auto result_selector = [](int x, int y) {return std::make_pair(x, y); };
+    auto vtr = Cinq(std::cref(many_elements)).AsParallel(4).AsOrdered().Join(many_elements, outer_key, inner_key, result_selector).ToVector();
+    auto result = Cinq(std::cref(many_elements)).Join(many_elements, outer_key, inner_key, result_selector).ToVector();
+    cinq::utility::CinqAssert(vtr.size() == result.size() && vtr == result);
+  }
+
+  // Join over Select, which yields prvalues # both sides are ordered by key (evaluated sequentially)
+  {
+    auto key = [](const std::string &x) {return x.size(); };
+    auto result_selector = [](const std::string &x, const std::string &y) {return x + y; };
+    auto to_string = [](int x) {return std::to_string(x); };
+    auto vtr = Cinq(std::cref(many_elements)).AsParallel(4).AsOrdered().Select(to_string).Join(Cinq(one_element).Select(to_string), key, key, result_selector).ToVector();
+    auto ordered_vtr = Cinq(std::cref(many_elements)).AsParallel(4).Select(to_string)
+      .Join(Cinq(one_element).Select(to_string), key, key, result_selector, cinq::ordered_by_key).ToVector();
+    cinq::utility::CinqAssert(vtr.size() == 10 && vtr.front() == "00" && vtr.back() == "90" && vtr == ordered_vtr);
+  }
+
+  // queries running at the same time
+  {
+    std::vector<std::thread> threads;
+    std::atomic<bool> is_all_equal = true;
+    for (int i = 0; i < 4; ++i) {
+      threads.emplace_back([&many_elements, &is_all_equal, i]() {
+        auto selector = [i](int x) {return std::vector<int>((x + 1) % (i + 2), x); };
+        auto vtr = Cinq(std::cref(many_elements)).AsParallel(3).AsOrdered().SelectMany(selector).Where([](int x) {return x % 2 == 0; }).ToVector();
+        auto result = Cinq(std::cref(many_elements)).SelectMany(selector).Where([](int x) {return x % 2 == 0; }).ToVector();
+        if (vtr != result)
+          is_all_equal = false;
+      });
+    }
+    for (auto &th : threads)
+      th.join();
+    cinq::utility::CinqAssert(is_all_equal);
+  }
+
+  // source is not random access
+  {
+    std::list<int> source(many_elements.begin(), many_elements.end());
+    auto vtr = Cinq(std::ref(source)).AsParallel(4).Where([](int x) {return x % 2 == 0; }).ToVector();
+    cinq::utility::CinqAssert(vtr.size() == 5000 && vtr.front() == 0 && vtr.back() == 9998);
+    cinq::utility::CinqAssert(Cinq(std::ref(source)).AsParallel(4).Sum() == 49995000 && Cinq(std::ref(source)).AsParallel(4).Count() == 10000);
+  }
+
+  // aggregates # the partial results of the chunks are combined in order
+  {
+    auto is_odd = [](int x) {return x % 2 == 1; };
+    auto to_string = [](int x) {return std::to_string(x); };
+    auto parallel = [&many_elements](size_t thread_count) {return Cinq(std::cref(many_elements)).AsParallel(thread_count); };
+    cinq::utility::CinqAssert(parallel(4).Sum() == Cinq(std::cref(many_elements)).Sum() && parallel(4).Where(is_odd).Sum() == 25000000);
+    cinq::utility::CinqAssert(parallel(4).Sum([](int x) {return x * 0.5; }) == 24997500.0 && parallel(3).Average() == 4999.5);
+    cinq::utility::CinqAssert(parallel(4).Where(is_odd).Count() == 5000 && parallel(4).Count(cinq::Less(100)) == 100);
+    cinq::utility::CinqAssert(parallel(4).Count([](int x) {return x % 3 == 0; }) == 3334 && parallel(4).Count() == 10000);
+    cinq::utility::CinqAssert(parallel(4).Where(is_odd).Min() == 1 && parallel(4).Max() == 9999);
+    cinq::utility::CinqAssert(parallel(4).Select(to_string).Max() == "9999" && parallel(4).Min(to_string) == "0");
+    cinq::utility::CinqAssert(parallel(4).Aggregate(0, [](int sum, int x) {return sum + x % 2; }) == 5000);
+
+    std::vector<float> floats(many_elements.size());
+    std::transform(many_elements.begin(), many_elements.end(), floats.begin(), [](int x) {return 1.0f / (x + 1); });
+    auto sum = Cinq(std::cref(floats)).AsParallel(4).Sum(cinq::pairwise_summation);
+    cinq::utility::CinqAssert(sum == Cinq(std::cref(floats)).AsParallel(4).Sum(cinq::pairwise_summation));
+    cinq::utility::CinqAssert(std::abs(sum - Cinq(std::cref(floats)).Sum(cinq::pairwise_summation)) < 1e-4f);
+
+    bool is_thrown = false;
+    try {
+      Cinq(empty_source).AsParallel(4).Min();
+    } catch (std::runtime_error &) {
+      is_thrown = true;
+    }
+    cinq::utility::CinqAssert(is_thrown);
+  }
+
+  // AsSequential
+  {
+    auto query = Cinq(five_elements).AsParallel(2).Where([](auto x) {return x != 0; }).AsSequential();
+    cinq::utility::CinqAssert(ToVector(query).size() == 4);
+  }
+
+  // function object throws
+  {
+    struct Thrown {};
+    bool is_thrown = false;
+    try {
+      Cinq(std::cref(many_elements)).AsParallel(4).Select([](int x) {if (x == 5000) throw Thrown{}; return x; }).ToVector();
+    } catch (Thrown &) {
+      is_thrown = true;
+    }
+    cinq::utility::CinqAssert(is_thrown);
+  }
+}
+
+void TestCinqOrderBy() {
+  // $ is empty
+  {
+    auto vtr = Cinq(empty_source).OrderBy([](auto x) {return x; }).ToVector();
+    cinq::utility::CinqAssert(vtr.empty());
+    cinq::utility::CinqAssert(ToVector(Cinq(empty_source).OrderByDescending([](auto x) {return x; })).empty());
+  }
+
+  // elements are passed as lvalues of the source # sorted stably # each key is selected once
+  {
+    std::vector<std::string> words{ "pear", "fig", "apple", "kiwi", "plum", "date" };
+    size_t called = 0;
+    std::vector<const std::string *> addresses;
+    Cinq(std::cref(words)).OrderBy([&called](const std::string &x) { ++called; return x.size(); })
+      .ForEach([&addresses](const std::string &x) { addresses.push_back(&x); });
+    cinq::utility::CinqAssert(called == words.size());
+    cinq::utility::CinqAssert(addresses == std::vector<const std::string *>{ &words[1], &words[0], &words[3], &words[4], &words[5], &words[2] });
+  }
+
+  // OrderByDescending # ThenBy # ThenByDescending # comparator
+  {
+    std::vector<std::string> words{ "pear", "fig", "apple", "kiwi", "plum", "date" };
+    auto size = [](const std::string &x) {return x.size(); };
+    auto identity = [](const std::string &x) {return x; };
+
+    size_t called = 0;
+    auto vtr = Cinq(words).OrderBy([&called](const std::string &x) { ++called; return x.size(); })
+      .ThenBy([&called](const std::string &x) { ++called; return x; }).ToVector();
+    cinq::utility::CinqAssert(vtr == std::vector<std::string>{ "fig", "date", "kiwi", "pear", "plum", "apple" });
+    cinq::utility::CinqAssert(called == words.size() * 2);
+
+    vtr = Cinq(words).OrderByDescending(size).ThenByDescending(identity).ToVector();
+    cinq::utility::CinqAssert(vtr == std::vector<std::string>{ "apple", "plum", "pear", "kiwi", "date", "fig" });
+
+    vtr = Cinq(words).OrderBy(size, std::greater<>()).ThenBy([](const std::string &x) {return x.back(); }).ToVector();
+    cinq::utility::CinqAssert(vtr == std::vector<std::string>{ "apple", "date", "kiwi", "plum", "pear", "fig" });
+
+    vtr = ToVector(Cinq(words).OrderByDescending(size, std::greater<>()).ThenByDescending(identity, std::greater<>()));
+    cinq::utility::CinqAssert(vtr == std::vector<std::string>{ "fig", "date", "kiwi", "pear", "plum", "apple" });
+  }
+
+  // $ yields prvalues # elements are copied # compared with std::stable_sort
+  {
+    std::vector<int> many_elements(1000);
+    std::iota(many_elements.begin(), many_elements.end(), 0);
+    auto query = Cinq(many_elements)
+      .Select([](int x) {return x * 7919 % 1000; })
+      .OrderBy([](int x) {return x % 10; })
+      .ThenByDescending([](int x) {return x / 10; });
+    auto pushed = query.ToVector();
+    auto pulled = ToVector(query);
+
+    std::vector<int> result;
+    for (int x : many_elements)
+      result.push_back(x * 7919 % 1000);
+    std::stable_sort(result.begin(), result.end(), [](int lhs, int rhs) {
+      return lhs % 10 < rhs % 10 || lhs % 10 == rhs % 10 && lhs / 10 > rhs / 10;
+    });
+    cinq::utility::CinqAssert(pushed == result && pulled == result);
+    cinq::utility::CinqAssert(query.Count() == result.size());
+  }
+
+  // followed by Take # elements are passed as lvalues of the source # equivalent keys are kept in the order of the source
+  {
+    std::vector<std::string> words{ "pear", "fig", "apple", "kiwi", "plum", "date" };
+    size_t called = 0;
+    std::vector<const std::string *> addresses;
+    Cinq(std::cref(words)).OrderBy([&called](const std::string &x) { ++called; return x.size(); }).Take(3)
+      .ForEach([&addresses](const std::string &x) { addresses.push_back(&x); });
+    cinq::utility::CinqAssert(called == words.size());
+    cinq::utility::CinqAssert(addresses == std::vector<const std::string *>{ &words[1], &words[0], &words[3] });
+
+    auto vtr = ToVector(Cinq(words).OrderByDescending([](const std::string &x) {return x.size(); }).ThenBy([](const std::string &x) {return x; }).Take(4));
+    cinq::utility::CinqAssert(vtr == std::vector<std::string>{ "apple", "date", "kiwi", "pear" });
+    cinq::utility::CinqAssert(Cinq(words).OrderBy([](const std::string &x) {return x; }).Take(10).Take(2).Count() == 2);
+    cinq::utility::CinqAssert(Cinq(words).OrderBy([](const std::string &x) {return x; }).Take(0).ToVector().empty());
+    cinq::utility::CinqAssert(Cinq(words).OrderByDescending([](const std::string &x) {return x; }).First() == "plum");
+  }
+
+  // followed by Take # $ is of unknown size # elements are copied # compared with the full sort
+  for (size_t count : { 1, 10, 99, 100, 1000 }) {
+    std::vector<int> many_elements(1000);
+    std::iota(many_elements.begin(), many_elements.end(), 0);
+    auto make_query = [&many_elements]() {
+      return Cinq(many_elements).Where([](int x) {return x % 5 != 0; }).Select([](int x) {return x * 7919 % 1000; });
+    };
+    auto result = make_query().OrderByDescending([](int x) {return x % 10; }).ToVector();
+    result.resize(std::min(result.size(), count));
+
+    auto query = make_query().OrderByDescending([](int x) {return x % 10; }).Take(count);
+    cinq::utility::CinqAssert(query.ToVector() == result && ToVector(query) == result);
+    cinq::utility::CinqAssert(query.Count() == result.size());
+  }
+
+  // keys are radix sorted # integers of each size and signedness # floating point values # strings of long common prefixes # compared with std::stable_sort
+  {
+    std::vector<int> many_elements(2000);
+    std::iota(many_elements.begin(), many_elements.end(), -1000);
+    auto is_stably_sorted = [&many_elements](auto key, auto compare) {
+      auto vtr = Cinq(std::cref(many_elements)).OrderBy(key, compare).ToVector();
+      auto result = many_elements;
+      std::stable_sort(result.begin(), result.end(), [&key, &compare](int lhs, int rhs) {return compare(key(lhs), key(rhs)); });
+      return vtr == result;
+    };
+    cinq::utility::CinqAssert(is_stably_sorted([](int x) {return static_cast<char>(x * 37); }, std::less<>()));
+    cinq::utility::CinqAssert(is_stably_sorted([](int x) {return static_cast<std::int8_t>(x); }, std::greater<>()));
+    cinq::utility::CinqAssert(is_stably_sorted([](int x) {return static_cast<std::uint16_t>(x * 7919); }, std::less<std::uint16_t>()));
+    cinq::utility::CinqAssert(is_stably_sorted([](int x) {return x % 2 == 0 ? x * 1000003LL : -x * 1000003LL; }, std::less<>()));
+    cinq::utility::CinqAssert(is_stably_sorted([](int x) {return static_cast<std::uint64_t>(x) << 40; }, std::greater<>()));
+    cinq::utility::CinqAssert(is_stably_sorted([](int x) {return x % 7 * 0.5 - 1.5; }, std::less<>()));
+    cinq::utility::CinqAssert(is_stably_sorted([](int x) {return x % 3 == 0 ? -0.0f : x % 3 == 1 ? 0.0f : x * 0.25f; }, std::less<>()));
+    cinq::utility::CinqAssert(is_stably_sorted([](int x) {return "common prefix " + std::to_string(x % 100); }, std::less<>()));
+    cinq::utility::CinqAssert(is_stably_sorted([](int x) {return std::string(x % 13 + 13, static_cast<char>(x % 3 == 0 ? 'a' : -1)); }, std::greater<>()));
+
+    auto vtr = Cinq(std::cref(many_elements))
+      .OrderByDescending([](int x) {return x / 100; })
+      .ThenByDescending([](int x) {return x % 10 * 1.5; })
+      .ToVector();
+    auto result = many_elements;
+    std::stable_sort(result.begin(), result.end(), [](int lhs, int rhs) {
+      return lhs / 100 > rhs / 100 || lhs / 100 == rhs / 100 && lhs % 10 * 1.5 > rhs % 10 * 1.5;
+    });
+    cinq::utility::CinqAssert(vtr == result);
+  }
+}
+
+void TestCinqTake() {
+  // $ is empty
+  {
+    cinq::utility::CinqAssert(Cinq(empty_source).Take(3).ToVector().empty());
+    cinq::utility::CinqAssert(ToVector(Cinq(empty_source).Take(3)).empty());
+    bool is_thrown = false;
+    try {
+      Cinq(empty_source).First();
+    } catch (std::runtime_error &) {
+      is_thrown = true;
+    }
+    cinq::utility::CinqAssert(is_thrown);
+  }
+
+  // $ has five elements # elements are passed as lvalues of the source # count is larger than the size
+  {
+    std::vector<const LifeTimeCheckInt *> addresses;
+    Cinq(std::ref(five_elements)).Take(2).ForEach([&addresses](const LifeTimeCheckInt &x) { addresses.push_back(&x); });
+    cinq::utility::CinqAssert(addresses == std::vector<const LifeTimeCheckInt *>{ &five_elements[0], &five_elements[1] });
+    cinq::utility::CinqAssert(ToVector(Cinq(five_elements).Take(10)).size() == 5 && Cinq(five_elements).Take(10).Count() == 5);
+    cinq::utility::CinqAssert(Cinq(five_elements).Take(0).Count() == 0);
+    cinq::utility::CinqAssert(Cinq(five_elements).Where([](auto x) {return x != five_elements[0]; }).First() == five_elements[1]);
+  }
+
+  // the elements following the last one are not evaluated
+  {
+    size_t called = 0;
+    auto query = Cinq(five_elements).Select([&called](auto x) { ++called; return x; }).Take(2);
+    auto pushed = query.ToVector();
+    cinq::utility::CinqAssert(pushed.size() == 2 && called == 2);
+    auto pulled = ToVector(query);
+    cinq::utility::CinqAssert(pulled == pushed && called == 4);
+  }
 }
 
 } // namespace cinq_test
@@ -7,7 +7,37 @@
 
 using cinq::Cinq;
 
-// pend until ToVector impl
 namespace cinq_test {
+// The size of the iterator of a chain of queries grows linearly with its length, see SourceSentinel.
+void LongQueryIteratorSizeTest() {
+  std::vector<LifeTimeCheckInt> vtr{ 1, 2, 3, 4, 5, 6, 2, 4, 6 };
+  auto is_even = [](const LifeTimeCheckInt &x) { return x % 2 == 0; };
+  auto identity = [](const LifeTimeCheckInt &x) -> const LifeTimeCheckInt & { return x; };
+
+  // Consecutive Where are fused, hence they are separated by Select.
+  auto where1 = Cinq(std::ref(vtr)).Where(is_even);
+  auto where2 = Cinq(std::ref(vtr)).Where(is_even).Select(identity).Where(is_even);
+  auto where3 = Cinq(std::ref(vtr)).Where(is_even).Select(identity).Where(is_even).Select(identity).Where(is_even);
+  auto where5 = Cinq(std::ref(vtr)).Where(is_even).Select(identity).Where(is_even).Select(identity).Where(is_even)
+    .Select(identity).Where(is_even).Select(identity).Where(is_even);
+
+  constexpr auto where_step = sizeof(where2.begin()) - sizeof(where1.begin());
+  static_assert(sizeof(where3.begin()) - sizeof(where2.begin()) == where_step);
+  static_assert(sizeof(where5.begin()) - sizeof(where3.begin()) == 2 * where_step);
+  cinq::utility::CinqAssert(ToVector(where5) == std::vector<LifeTimeCheckInt>{ 2, 4, 6, 2, 4, 6 });
+
+  // Distinct of distinct elements is dropped, hence they are separated by Select.
+  auto distinct1 = Cinq(std::ref(vtr)).Distinct();
+  auto distinct2 = Cinq(std::ref(vtr)).Distinct().Select(identity).Distinct();
+  auto distinct3 = Cinq(std::ref(vtr)).Distinct().Select(identity).Distinct().Select(identity).Distinct();
+  auto distinct5 = Cinq(std::ref(vtr)).Distinct().Select(identity).Distinct().Select(identity).Distinct()
+    .Select(identity).Distinct().Select(identity).Distinct();
+
+  constexpr auto distinct_step = sizeof(distinct2.begin()) - sizeof(distinct1.begin());
+  static_assert(sizeof(distinct2.begin()) > sizeof(distinct1.begin()));
+  static_assert(sizeof(distinct3.begin()) - sizeof(distinct2.begin()) == distinct_step);
+  static_assert(sizeof(distinct5.begin()) - sizeof(distinct3.begin()) == 2 * distinct_step);
+  cinq::utility::CinqAssert(ToVector(distinct5) == std::vector<LifeTimeCheckInt>{ 1, 2, 3, 4, 5, 6 });
+}
 
 } // namespace cinq_test
@@ -112,16 +112,27 @@ int main() try {
   threads.emplace_back(cinq_test::NoCopyGuaranteeTest);
   threads.emplace_back(cinq_test::SetOperationInternalContainerTest);
   threads.emplace_back(cinq_test::SetOperationAliasTest);
+  threads.emplace_back(cinq_test::LongQueryIteratorSizeTest);
 
   threads.emplace_back(cinq_test::TestCinqSelectMany);
   threads.emplace_back(cinq_test::TestCinqSelect);
   threads.emplace_back(cinq_test::TestCinqJoin);
   threads.emplace_back(cinq_test::TestCinqWhere);
   threads.emplace_back(cinq_test::TestCinqToVector);
+  threads.emplace_back(cinq_test::TestCinqForEach);
+  threads.emplace_back(cinq_test::TestCinqAsBatched);
+  threads.emplace_back(cinq_test::TestCinqNumericAggregates);
+  threads.emplace_back(cinq_test::TestCinqAsParallel);
+  threads.emplace_back(cinq_test::TestCinqOrderBy);
+  threads.emplace_back(cinq_test::TestCinqTake);
   threads.emplace_back(cinq_test::IntersectTest);
   threads.emplace_back(cinq_test::UnionTest);
   threads.emplace_back(cinq_test::ConcatTest);
   threads.emplace_back(cinq_test::DistinctTest);
+  threads.emplace_back(cinq_test::ExceptTest);
+  threads.emplace_back(cinq_test::SortedSetOperationTest);
+  threads.emplace_back(cinq_test::DomainSetOperationTest);
+  threads.emplace_back(cinq_test::EnumerableTraitsTest);
 
   for (auto &th : threads)
     th.join();
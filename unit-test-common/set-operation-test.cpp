@@ -2,6 +2,17 @@
 #include <vector>
 #include <string>
 #include <algorithm>
+#include <cstdlib>
+#include <forward_list>
+#include <functional>
+#include <limits>
+#include <list>
+#include <map>
+#include <random>
+#include <set>
+#include <stdexcept>
+#include <iterator>
+#include <type_traits>
 
 #include "cinq.h"
 #include "cinq-test-utility.h"
@@ -80,6 +91,49 @@ void IntersectTest() {
     vtr = ToVector(query);
     cinq::utility::CinqAssert(vtr.size() == 0);
   }
+
+  // # the smallest source is enumerated first, the evaluation stops once no candidate is left # the order is the one of the first source
+  {
+    size_t visited = 0;
+    auto count = [&visited](const LifeTimeCheckInt &) { ++visited; return true; };
+    std::vector<LifeTimeCheckInt> large{ 1, 2, 3, 4, 5, 6, 7, 8 }, small{ 3, 9, 1, 3 }, disjoint{ 10 };
+
+    auto vtr = ToVector(Cinq(large).Where(count).Intersect(disjoint, small));
+    cinq::utility::CinqAssert(vtr.empty() && visited == 0);
+    vtr = ToVector(Cinq(large).Where(count).Intersect(empty_source));
+    cinq::utility::CinqAssert(vtr.empty() && visited == 0);
+    vtr = ToVector(Cinq(large).Where(count).Intersect(small));
+    cinq::utility::CinqAssert(vtr.size() == 2 && vtr[0] == 1 && vtr[1] == 3 && visited == 8);
+    vtr = ToVector(Cinq(small).Intersect(large));
+    cinq::utility::CinqAssert(vtr.size() == 2 && vtr[0] == 3 && vtr[1] == 1);
+
+    // each source is enumerated once
+    size_t selected = 0;
+    auto select = [&selected](const LifeTimeCheckInt &x) { ++selected; return x; };
+    vtr = ToVector(Cinq(small).Select(select).Intersect(large));
+    cinq::utility::CinqAssert(vtr.size() == 2 && selected == 4);
+    selected = 0;
+    vtr = ToVector(Cinq(large).Select(select).Intersect(small));
+    cinq::utility::CinqAssert(vtr.size() == 2 && selected == 8);
+  }
+
+  // # the copies of an iterator share the internal storage, and are incremented independently
+  {
+    std::vector<LifeTimeCheckInt> special1{ 1, 2, 3, 4, 5, 6 }, special2{ 6, 5, 3, 2, 1 };
+    auto query = Cinq(special1).Select([](int x) -> LifeTimeCheckInt { return x; }).Intersect(special2);
+    auto iter = query.begin();
+    auto copy = iter++;
+    auto other = iter;
+
+    std::vector<int> from_copy, from_iter;
+    while (copy != query.end() || iter != query.end()) {
+      if (iter != query.end())
+        from_iter.push_back(*iter++);
+      if (copy != query.end())
+        from_copy.push_back(*copy++);
+    }
+    cinq::utility::CinqAssert(from_copy == std::vector<int>{ 1, 2, 3, 5, 6 } && from_iter == std::vector<int>{ 2, 3, 5, 6 } && *other == 2);
+  }
 }
 
 void UnionTest() {
@@ -141,6 +195,12 @@ void UnionTest() {
         std::sort(vtr2.begin(), vtr2.end());
         cinq::utility::CinqAssert(vtr2.size() == result3.size() &&
           std::equal(vtr2.begin(), vtr2.end(), result3.begin()));
+
+        auto query3 = Cinq(source1).Union(source2, source3, cinq::unordered);
+        auto vtr3 = ToVector(query3);
+        std::sort(vtr3.begin(), vtr3.end());
+        cinq::utility::CinqAssert(vtr3.size() == result3.size() &&
+          std::equal(vtr3.begin(), vtr3.end(), result3.begin()));
       }
     }
   }
@@ -152,6 +212,27 @@ void UnionTest() {
     cinq::utility::CinqAssert(vtr.size() == 0);
     vtr = ToVector(query);
     cinq::utility::CinqAssert(vtr.size() == 0);
+    vtr = ToVector(Cinq(empty_source).Union(empty_source, empty_source, cinq::unordered));
+    cinq::utility::CinqAssert(vtr.size() == 0);
+  }
+
+  // # the elements are yielded in the order of their first occurrence, one source after another, both pulled and pushed
+  {
+    std::vector<LifeTimeCheckInt> first{ 3, 1, 3, 2 }, second{ 4, 1, 5, 4 };
+    auto vtr = ToVector(Cinq(first).Union(second));
+    cinq::utility::CinqAssert(vtr == std::vector<LifeTimeCheckInt>{ 3, 1, 2, 4, 5 });
+
+    std::vector<LifeTimeCheckInt> pushed;
+    Cinq(first).Union(second).ForEach([&pushed](const LifeTimeCheckInt &x) { pushed.push_back(x); });
+    cinq::utility::CinqAssert(pushed == vtr);
+
+    // unordered is the same query
+    using UnorderedType = decltype(Cinq(first).Union(second, cinq::unordered));
+    static_assert(std::is_same_v<UnorderedType, decltype(Cinq(first).Union(second))>);
+    auto query = Cinq(first).Union(second, cinq::unordered);
+    auto iter = query.begin();
+    auto copy = iter++;
+    cinq::utility::CinqAssert(copy != iter && *copy != *iter && ++copy == iter && ToVector(query) == vtr);
   }
 }
 
@@ -178,6 +259,15 @@ void ConcatTest() {
       cinq::utility::CinqAssert(vtr.size() == result1.size() &&
         std::equal(vtr.begin(), vtr.end(), result1.begin()));
 
+      // # is random access
+      static_assert(std::is_same_v<std::iterator_traits<decltype(query1.begin())>::iterator_category, std::random_access_iterator_tag>);
+      static_assert(!std::is_polymorphic_v<decltype(query1.begin())>);
+      auto first = query1.begin();
+      auto size = static_cast<std::ptrdiff_t>(result1.size());
+      cinq::utility::CinqAssert(query1.end() - first == size && first + size == query1.end());
+      for (std::ptrdiff_t i = 0; i < size; ++i)
+        cinq::utility::CinqAssert(first[i] == result1[i] && *(query1.end() - (size - i)) == result1[i] && first + i < query1.end());
+
       for (auto &s3 : sources) {
         std::vector<LifeTimeCheckInt> result2(result1);
         std::copy(s3.begin(), s3.end(), std::back_inserter(result2));
@@ -189,6 +279,11 @@ void ConcatTest() {
         vtr2 = ToVector(query2);
         cinq::utility::CinqAssert(vtr2.size() == vtr2.size() &&
           std::equal(vtr2.begin(), vtr2.end(), result2.begin()));
+
+        // # the sources push their elements in turn
+        std::vector<LifeTimeCheckInt> pushed;
+        query2.ForEach([&pushed](const LifeTimeCheckInt &x) { pushed.push_back(x); });
+        cinq::utility::CinqAssert(pushed == result2);
       }
     }
   }
@@ -201,6 +296,24 @@ void ConcatTest() {
     vtr = ToVector(query);
     cinq::utility::CinqAssert(vtr.size() == 0);
   }
+
+  // # is bidirectional over std::list sources, the empty sources are stepped over backward
+  {
+    std::list<int> list1{ 1, 2 }, empty, list2{ 3 };
+    auto query = Cinq(std::ref(list1)).Concat(std::ref(empty), std::ref(list2), std::ref(empty));
+    static_assert(std::is_same_v<std::iterator_traits<decltype(query.begin())>::iterator_category, std::bidirectional_iterator_tag>);
+
+    std::vector<int> backward;
+    for (auto iter = query.end(); iter != query.begin(); )
+      backward.push_back(*--iter);
+    auto iter = std::next(query.begin(), 2);
+    cinq::utility::CinqAssert(backward == std::vector<int>{ 3, 2, 1 } && *iter == 3 && *--iter == 2 && *++iter == 3 && ++iter == query.end());
+
+    std::forward_list<int> forward{ 4, 5 };
+    auto forward_query = Cinq(std::ref(list1)).Concat(std::ref(forward));
+    static_assert(std::is_same_v<std::iterator_traits<decltype(forward_query.begin())>::iterator_category, std::forward_iterator_tag>);
+    cinq::utility::CinqAssert(ToVector(forward_query) == std::vector<int>{ 1, 2, 4, 5 });
+  }
 }
 
 void DistinctTest() {
@@ -252,6 +365,370 @@ void DistinctTest() {
     cinq::utility::CinqAssert(vtr.size() == special.size() &&
       std::equal(vtr.begin(), vtr.end(), special.begin()));
   }
+
+  // # has many, the internal storage grows several times
+  {
+    std::vector<LifeTimeCheckInt> special;
+    for (int i = 0; i < 3000; ++i)
+      special.push_back(i % 1000);
+
+    auto aliased = ToVector(Cinq(special).Distinct());
+    auto copied = ToVector(Cinq(special).Select([](int x) -> LifeTimeCheckInt { return x; }).Distinct());
+    cinq::utility::CinqAssert(aliased.size() == 1000 && copied.size() == 1000 &&
+      std::equal(aliased.begin(), aliased.end(), special.begin()) && std::equal(copied.begin(), copied.end(), special.begin()));
+
+    auto query = Cinq(special).Select([](int x) -> LifeTimeCheckInt { return x; }).Distinct();
+    auto iter = query.begin();
+    std::advance(iter, 500);
+    auto copy = iter;
+    auto moved = std::move(iter);
+    cinq::utility::CinqAssert(*copy == 500 && *moved == 500 && std::distance(copy, query.end()) == 500);
+
+    // the references to the copied elements are valid for the lifetime of the iterator
+    auto string_query = Cinq(special).Select([](int x) { return std::to_string(x); }).Distinct();
+    auto string_iter = string_query.begin();
+    const auto &first = *string_iter;
+    std::advance(string_iter, 100);
+    auto union_query = Cinq(special).Select([](int x) { return std::to_string(x); }).Union(std::vector<std::string>{ "a" });
+    auto union_iter = union_query.begin();
+    const auto &union_first = *union_iter;
+    std::advance(union_iter, 100);
+    cinq::utility::CinqAssert(first == "0" && *string_iter == "100" && union_first == "0" && *union_iter == "100");
+  }
+
+  // # the copies of an iterator share the internal storage, and are incremented independently
+  {
+    std::vector<LifeTimeCheckInt> special{
+      1, 2, 2, 3, 1, 4, 5, 4
+    };
+    size_t calls = 0;
+    auto query = Cinq(special).Select([&calls](int x) -> LifeTimeCheckInt { ++calls; return x; }).Distinct();
+    auto iter = query.begin();
+    auto copy = iter++;
+    auto other = iter;
+
+    std::vector<int> from_copy, from_iter;
+    while (copy != query.end() || iter != query.end()) {
+      if (iter != query.end())
+        from_iter.push_back(*iter++);
+      if (copy != query.end())
+        from_copy.push_back(*copy++);
+    }
+    cinq::utility::CinqAssert(from_copy == std::vector<int>{ 1, 2, 3, 4, 5 } && from_iter == std::vector<int>{ 2, 3, 4, 5 } && *other == 2);
+
+    // the storage is copied rather than rebuilt, so the selector is called once per element enumerated by each copy
+    cinq::utility::CinqAssert(calls == special.size() + special.size() - 1);
+  }
+}
+
+
+void EnumerableTraitsTest() {
+  using cinq::utility::EnumerableTraits;
+  using cinq::utility::SizeClass;
+
+  std::set<int> set1{ 1, 3, 5, 7 }, set2{ 3, 4, 5 };
+  std::vector<int> vtr{ 5, 1, 5, 3, 1 };
+  std::forward_list<int> list{ 1, 2, 2 };
+  std::map<int, int> map{ { 1, 2 }, { 3, 4 } };
+
+  // $ the properties of the sources
+  {
+    using SetTraits = EnumerableTraits<decltype(Cinq(set1))>;
+    using VectorTraits = EnumerableTraits<decltype(Cinq(vtr))>;
+    static_assert(SetTraits::is_elements_unique && SetTraits::is_sorted && SetTraits::size_class == SizeClass::Exact);
+    static_assert(!VectorTraits::is_elements_unique && !VectorTraits::is_sorted && VectorTraits::size_class == SizeClass::Exact);
+    static_assert(EnumerableTraits<decltype(Cinq(list))>::size_class == SizeClass::Unknown);
+    static_assert(EnumerableTraits<decltype(Cinq(map))>::is_elements_unique);
+    static_assert(!EnumerableTraits<decltype(Cinq(vtr))>::is_const && EnumerableTraits<decltype(Cinq(vtr).Const().Distinct())>::is_const);
+  }
+
+  // $ the properties derived by the queries
+  {
+    auto predicate = [](int x) { return x > 1; };
+    auto selector = [](int x) { return x / 2; };
+    using WhereTraits = EnumerableTraits<decltype(Cinq(set1).Where(predicate))>;
+    using SelectTraits = EnumerableTraits<decltype(Cinq(set1).Select(selector))>;
+    using DistinctTraits = EnumerableTraits<decltype(Cinq(vtr).Distinct())>;
+    using UnionTraits = EnumerableTraits<decltype(Cinq(set1).Union(vtr))>;
+    using ConcatTraits = EnumerableTraits<decltype(Cinq(vtr).Concat(set1))>;
+    static_assert(WhereTraits::is_elements_unique && WhereTraits::is_sorted && WhereTraits::size_class == SizeClass::Bounded);
+    static_assert(!SelectTraits::is_elements_unique && !SelectTraits::is_sorted && SelectTraits::size_class == SizeClass::Exact);
+    static_assert(DistinctTraits::is_elements_unique && !DistinctTraits::is_sorted && DistinctTraits::size_class == SizeClass::Bounded);
+    static_assert(UnionTraits::is_elements_unique && !UnionTraits::is_sorted && UnionTraits::size_class == SizeClass::Bounded);
+    static_assert(!ConcatTraits::is_elements_unique && ConcatTraits::size_class == SizeClass::Exact);
+    static_assert(EnumerableTraits<decltype(Cinq(list).Concat(vtr))>::size_class == SizeClass::Unknown);
+    static_assert(EnumerableTraits<decltype(Cinq(list).Intersect(vtr))>::size_class == SizeClass::Bounded);
+  }
+
+  // $ Distinct is dropped on unique elements yielded as const lvalues
+  {
+    static_assert(std::is_same_v<decltype(Cinq(set1).Distinct()), decltype(Cinq(set1))>);
+    static_assert(std::is_same_v<decltype(Cinq(vtr).Distinct().Distinct()), decltype(Cinq(vtr).Distinct())>);
+    static_assert(!std::is_same_v<decltype(Cinq(map).Distinct()), decltype(Cinq(map))>);
+    static_assert(!std::is_same_v<decltype(Cinq(vtr).Distinct()), decltype(Cinq(vtr))>);
+
+    auto vtr1 = ToVector(Cinq(set1).Distinct());
+    auto vtr2 = ToVector(Cinq(vtr).Distinct().Distinct());
+    cinq::utility::CinqAssert(vtr1 == std::vector<int>{ 1, 3, 5, 7 } && vtr2 == std::vector<int>{ 5, 1, 3 });
+  }
+
+  // $ the set operations don't make unique sources distinct again
+  {
+    auto intersect = Cinq(set1).Intersect(set2, vtr).ToSet();
+    auto union_set = Cinq(set1).Union(set2, vtr).ToSet();
+    cinq::utility::CinqAssert(intersect == std::set<int>{ 3, 5 } && union_set == std::set<int>{ 1, 3, 4, 5, 7 });
+    cinq::utility::CinqAssert(Cinq(set1).Union(set2).Count() == 5 && Cinq(set1).Intersect(set2).Count() == 2);
+  }
+
+  // $ Count doesn't enumerate an enumerable of exact size
+  {
+    int calls = 0;
+    auto query = Cinq(vtr).Select([&calls](int x) { ++calls; return x; }).Concat(set1);
+    cinq::utility::CinqAssert(query.Count() == vtr.size() + set1.size() && calls == 0);
+    cinq::utility::CinqAssert(Cinq(list).Count() == 3 && Cinq(vtr).Where([](int x) { return x == 5; }).Count() == 2);
+  }
+}
+
+
+void ExceptTest() {
+  std::vector<LifeTimeCheckInt> source{ 5, 1, 2, 2, 3, 4, 5, 1 };
+  std::vector<LifeTimeCheckInt> excluded1{ 2, 4 }, excluded2{ 5, 7 };
+
+  // $ is empty
+  {
+    cinq::utility::CinqAssert(ToVector(Cinq(empty_source).Except(excluded1)).empty());
+  }
+
+  // $ has multiple # the elements are distinct, in the order of the source
+  {
+    auto query = Cinq(source).Except(excluded1);
+    std::vector<int> pulled;
+    for (auto &&x : query)
+      pulled.push_back(x);
+    auto pushed = ToVector(query);
+    cinq::utility::CinqAssert(pulled == std::vector<int>{ 5, 1, 3 } && pushed.size() == 3 && pushed[0] == 5 && pushed[2] == 3);
+  }
+
+  // # several excluded sources # nothing excluded
+  {
+    auto vtr1 = ToVector(Cinq(source).Except(excluded1, excluded2));
+    auto vtr2 = ToVector(Cinq(source).Except(std::vector<LifeTimeCheckInt>()));
+    cinq::utility::CinqAssert(vtr1.size() == 2 && vtr1[0] == 1 && vtr1[1] == 3);
+    cinq::utility::CinqAssert(vtr2.size() == 5 && vtr2[0] == 5 && vtr2[4] == 4);
+  }
+
+  // # the excluded elements are copied from a prvalue source
+  {
+    auto vtr = ToVector(Cinq(source).Except(Cinq(excluded1).Select([](int x) -> LifeTimeCheckInt { return x + 1; })));
+    cinq::utility::CinqAssert(vtr.size() == 3 && vtr[0] == 1 && vtr[1] == 2 && vtr[2] == 4);
+  }
+}
+
+void SortedSetOperationTest() {
+  std::vector<int> source1{ 1, 1, 2, 4, 4, 6, 8, 9 }, source2{ 2, 3, 4, 4, 8, 10 }, source3{ 0, 2, 4, 8, 8 };
+
+  // $ the sorted sources are merged
+  {
+    using DistinctType = decltype(Cinq(source1).AssumeSorted().Distinct());
+    using IntersectType = decltype(Cinq(source1).AssumeSorted().Intersect(Cinq(source2).AssumeSorted()));
+    using MixedType = decltype(Cinq(source2).Intersect(Cinq(source1).AssumeSorted()));
+    static_assert(cinq::utility::EnumerableTraits<DistinctType>::is_sorted && cinq::utility::EnumerableTraits<IntersectType>::is_sorted);
+    static_assert(!cinq::utility::EnumerableTraits<MixedType>::is_sorted);
+
+    auto distinct = Cinq(source1).AssumeSorted().Distinct().ToVector();
+    auto intersect = Cinq(source1).AssumeSorted().Intersect(Cinq(source2).AssumeSorted(), Cinq(source3).AssumeSorted()).ToVector();
+    auto union_vtr = Cinq(source1).AssumeSorted().Union(Cinq(source2).AssumeSorted()).ToVector();
+    auto except = Cinq(source1).AssumeSorted().Except(Cinq(source2).AssumeSorted()).ToVector();
+    cinq::utility::CinqAssert(distinct == std::vector<int>{ 1, 2, 4, 6, 8, 9 } && intersect == std::vector<int>{ 2, 4, 8 });
+    cinq::utility::CinqAssert(union_vtr == std::vector<int>{ 1, 2, 3, 4, 6, 8, 9, 10 } && except == std::vector<int>{ 1, 6, 9 });
+  }
+
+  // $ empty sources
+  {
+    auto intersect = ToVector(Cinq(source1).AssumeSorted().Intersect(Cinq(std::vector<int>()).AssumeSorted()));
+    auto empty_first = ToVector(Cinq(std::vector<int>()).AssumeSorted().Intersect(Cinq(source1).AssumeSorted()));
+    auto union_vtr = ToVector(Cinq(std::vector<int>()).AssumeSorted().Union(Cinq(std::vector<int>()).AssumeSorted()));
+    auto except = ToVector(Cinq(std::vector<int>()).AssumeSorted().Except(Cinq(source1).AssumeSorted()));
+    cinq::utility::CinqAssert(intersect.empty() && empty_first.empty() && union_vtr.empty() && except.empty());
+
+    std::set<int> empty_set, set{ 1, 2 };
+    auto query = Cinq(empty_set).Intersect(std::ref(set));
+    cinq::utility::CinqAssert(!(query.begin() != query.end()) && query.ToVector().empty());
+  }
+
+  // $ a std::set is sorted by std::less<>, a comparator is shared by its type
+  {
+    std::set<int> set{ 2, 5, 9 };
+    auto union_vtr = ToVector(Cinq(source2).AssumeSorted().Union(set));
+    cinq::utility::CinqAssert(union_vtr == std::vector<int>{ 2, 3, 4, 5, 8, 9, 10 });
+
+    std::vector<int> descending1{ 9, 7, -7, 5, 3 }, descending2{ -9, 8, 7, 3, 3, 1 };
+    auto by_absolute_value = [](int lhs, int rhs) { return std::abs(lhs) > std::abs(rhs); };
+    auto intersect = ToVector(Cinq(descending1).AssumeSorted(by_absolute_value).Intersect(Cinq(descending2).AssumeSorted(by_absolute_value)));
+    auto greater = ToVector(Cinq(std::vector<int>{ 9, 8, 8, 5, 1, 1 }).AssumeSorted(std::greater<>()).Distinct());
+    cinq::utility::CinqAssert(intersect == std::vector<int>{ 9, 7, 3 } && greater == std::vector<int>{ 9, 8, 5, 1 });
+  }
+
+  // $ the elements of prvalue sources are copied
+  {
+    auto doubled = [](int x) { return x * 2; };
+    auto distinct = ToVector(Cinq(source1).Select(doubled).AssumeSorted().Distinct());
+    auto union_vtr = ToVector(Cinq(source1).Select(doubled).AssumeSorted().Union(Cinq(source2).AssumeSorted()));
+    cinq::utility::CinqAssert(distinct == std::vector<int>{ 2, 4, 8, 12, 16, 18 } && union_vtr == std::vector<int>{ 2, 3, 4, 8, 10, 12, 16, 18 });
+  }
+
+  // $ the copies of an iterator are incremented independently
+  {
+    auto query = Cinq(source1).AssumeSorted().Union(Cinq(source2).AssumeSorted());
+    auto iter = query.begin();
+    auto copy = iter++;
+    cinq::utility::CinqAssert(*copy == 1 && *iter == 2 && *++copy == 2 && copy == iter && std::distance(iter, query.end()) == 7);
+  }
+
+  // $ long sources are galloped over, the results are the ones of the hashing set operations
+  {
+    std::mt19937 engine(20261017);
+    for (int round = 0; round < 20; ++round) {
+      std::vector<int> sources[3];
+      for (auto &source : sources) {
+        std::uniform_int_distribution<int> distribution(0, round % 2 == 0 ? 100 : 10000);
+        source.resize(round * 50);
+        for (auto &x : source)
+          x = distribution(engine);
+        std::sort(source.begin(), source.end());
+      }
+
+      auto merged_intersect = Cinq(sources[0]).AssumeSorted().Intersect(Cinq(sources[1]).AssumeSorted(), Cinq(sources[2]).AssumeSorted()).ToVector();
+      auto merged_union = Cinq(sources[0]).AssumeSorted().Union(Cinq(sources[1]).AssumeSorted(), Cinq(sources[2]).AssumeSorted()).ToVector();
+      auto merged_except = Cinq(sources[0]).AssumeSorted().Except(Cinq(sources[1]).AssumeSorted(), Cinq(sources[2]).AssumeSorted()).ToVector();
+      auto hashed_intersect = Cinq(sources[0]).Intersect(sources[1], sources[2]).ToSet();
+      auto hashed_union = Cinq(sources[0]).Union(sources[1], sources[2]).ToSet();
+      auto hashed_except = Cinq(sources[0]).Except(sources[1], sources[2]).ToSet();
+      cinq::utility::CinqAssert(std::equal(merged_intersect.begin(), merged_intersect.end(), hashed_intersect.begin(), hashed_intersect.end()));
+      cinq::utility::CinqAssert(std::equal(merged_union.begin(), merged_union.end(), hashed_union.begin(), hashed_union.end()));
+      cinq::utility::CinqAssert(std::equal(merged_except.begin(), merged_except.end(), hashed_except.begin(), hashed_except.end()));
+    }
+  }
+}
+
+
+void DomainSetOperationTest() {
+  std::vector<int> source{ 5, 1, 2, 2, 9, 4, 5, 1, 6 }, evens{ 2, 4, 6, 8, 100 }, small{ 4, 6, 7 };
+
+  // $ the domain is found by a pre-pass # the elements keep the order of the first source, and alias its elements
+  {
+    auto distinct = Cinq(source).Distinct().ToVector();
+    auto intersect = Cinq(source).Intersect(evens, small).ToVector();
+    auto union_vtr = Cinq(source).Union(evens, small).ToVector();
+    auto except = Cinq(source).Except(evens).ToVector();
+    cinq::utility::CinqAssert(distinct == std::vector<int>{ 5, 1, 2, 9, 4, 6 } && intersect == std::vector<int>{ 4, 6 });
+    cinq::utility::CinqAssert(union_vtr == std::vector<int>{ 5, 1, 2, 9, 4, 6, 8, 100, 7 } && except == std::vector<int>{ 5, 1, 9 });
+
+    std::vector<const int *> addresses;
+    Cinq(std::ref(source)).Distinct().ForEach([&addresses](const int &x) { addresses.push_back(&x); });
+    cinq::utility::CinqAssert(addresses.size() == 6 && addresses[0] == &source[0] && addresses[5] == &source[8]);
+  }
+
+  // $ the domain is declared # the elements of the other sources out of it are ignored, the ones of the first source throw
+  {
+    auto doubled = [](int x) { return x * 2; };
+    auto distinct = ToVector(Cinq(source).Select(doubled).WithDomain(0, 18).Distinct());
+    auto intersect = ToVector(Cinq(source).WithDomain(1, 9).Intersect(evens));
+    auto union_vtr = ToVector(Cinq(source).WithDomain(0, 9).Union(Cinq(evens).WithDomain(0, 100)));
+    auto except = ToVector(Cinq(source).WithDomain(1, 9).Except(evens, small));
+    cinq::utility::CinqAssert(distinct == std::vector<int>{ 10, 2, 4, 18, 8, 12 } && intersect == std::vector<int>{ 2, 4, 6 });
+    cinq::utility::CinqAssert(union_vtr == std::vector<int>{ 5, 1, 2, 9, 4, 6, 8, 100 } && except == std::vector<int>{ 5, 1, 9 });
+
+    using WithDomainType = decltype(Cinq(source).WithDomain(0, 9));
+    static_assert(cinq::utility::EnumerableTraits<WithDomainType>::has_domain);
+
+    bool is_thrown = false;
+    try {
+      Cinq(source).WithDomain(0, 4).Distinct().ToVector();
+    } catch (std::runtime_error &) {
+      is_thrown = true;
+    }
+    cinq::utility::CinqAssert(is_thrown);
+  }
+
+  // $ a declared domain sparse for the size of the first source is hashed, and still throws
+  {
+    constexpr auto int_min = std::numeric_limits<int>::min(), int_max = std::numeric_limits<int>::max();
+    constexpr auto ll_min = std::numeric_limits<long long>::min(), ll_max = std::numeric_limits<long long>::max();
+    std::vector<long long> wide{ ll_max, 5, ll_min, 5 };
+    auto distinct = ToVector(Cinq(source).WithDomain(int_min, int_max).Distinct());
+    auto intersect = ToVector(Cinq(wide).WithDomain(ll_min, ll_max).Intersect(std::vector<long long>{ ll_min, 5 }));
+    auto unknown_size = ToVector(Cinq(source).SelectMany([](int x) { return std::vector<int>(x % 2, x); }).WithDomain(0, 9).Distinct());
+    cinq::utility::CinqAssert(distinct == std::vector<int>{ 5, 1, 2, 9, 4, 6 } && intersect == std::vector<long long>{ 5, ll_min });
+    cinq::utility::CinqAssert(unknown_size == std::vector<int>{ 5, 1, 9 });
+
+    bool is_thrown = false;
+    try {
+      Cinq(source).WithDomain(int_min, 4).Distinct().ToVector();
+    } catch (std::runtime_error &) {
+      is_thrown = true;
+    }
+    cinq::utility::CinqAssert(is_thrown);
+  }
+
+  // $ sparse elements are hashed # empty sources
+  {
+    std::vector<long long> sparse{ 1000000000000, 5, 5, -1000000000000, 7 };
+    auto distinct = ToVector(Cinq(sparse).Distinct());
+    auto intersect = ToVector(Cinq(sparse).Intersect(std::vector<long long>{ 7, -1000000000000, 8 }));
+    cinq::utility::CinqAssert(distinct == std::vector<long long>{ 1000000000000, 5, -1000000000000, 7 });
+    cinq::utility::CinqAssert(intersect == std::vector<long long>{ -1000000000000, 7 });
+    cinq::utility::CinqAssert(ToVector(Cinq(std::vector<int>()).Union(std::vector<int>())).empty());
+    cinq::utility::CinqAssert(ToVector(Cinq(source).Except(source)).empty());
+  }
+
+  // $ Intersect doesn't enumerate the first source once no candidate is left
+  {
+    size_t visited = 0;
+    auto count = [&visited](int) { ++visited; return true; };
+    auto intersect = ToVector(Cinq(source).Where(count).WithDomain(0, 9).Intersect(evens, std::vector<int>{ 100 }));
+    cinq::utility::CinqAssert(intersect.empty() && visited == 0);
+  }
+
+  // $ the copies of an iterator are incremented independently
+  {
+    auto query = Cinq(source).Distinct();
+    auto iter = query.begin();
+    auto copy = iter++;
+    ++iter;
+    cinq::utility::CinqAssert(*++copy == 1 && *iter == 2 && *++copy == 2 && copy == iter && std::distance(iter, query.end()) == 4);
+  }
+
+  // $ the results are the ones of the sets of the elements
+  {
+    std::mt19937 engine(20261017);
+    for (int round = 0; round < 20; ++round) {
+      std::vector<int> sources[3];
+      std::set<int> sets[3];
+      for (int i = 0; i < 3; ++i) {
+        std::uniform_int_distribution<int> distribution(-100, round % 2 == 0 ? 100 : 100000);
+        sources[i].resize(round * 50);
+        for (auto &x : sources[i])
+          sets[i].insert(x = distribution(engine));
+      }
+
+      std::set<int> intersect, union_set(sets[1].begin(), sets[1].end()), except;
+      for (int x : sets[0]) {
+        if (sets[1].count(x) && sets[2].count(x))
+          intersect.insert(x);
+        if (!sets[1].count(x) && !sets[2].count(x))
+          except.insert(x);
+      }
+      union_set.insert(sets[0].begin(), sets[0].end());
+      union_set.insert(sets[2].begin(), sets[2].end());
+
+      cinq::utility::CinqAssert(Cinq(sources[0]).Distinct().ToSet() == sets[0] && Cinq(sources[0]).Distinct().Count() == sets[0].size());
+      cinq::utility::CinqAssert(Cinq(sources[0]).Intersect(sources[1], sources[2]).ToSet() == intersect);
+      cinq::utility::CinqAssert(Cinq(sources[0]).Union(sources[1], sources[2]).Count() == union_set.size());
+      cinq::utility::CinqAssert(Cinq(sources[0]).Union(sources[1], sources[2]).ToSet() == union_set);
+      cinq::utility::CinqAssert(Cinq(sources[0]).Except(sources[1], sources[2]).ToSet() == except);
+    }
+  }
 }
 
 } // namespace cinq_test